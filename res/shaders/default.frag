@@ -1,11 +1,32 @@
 #version 330 core
 in vec2 TexCoords;
 in vec4 Colour;
+flat in int TextureSlot;
+flat in int TextureLayer;
 out vec4 FragColor;
 
-uniform sampler2D image;
+uniform sampler2D images[8];
+uniform sampler2DArray sprite_sheets;
+
+vec4 SampleImage(vec2 uv)
+{
+    // sampler arrays can't be indexed with a varying in GLSL 330, so pick the sampler with a switch
+    switch(TextureSlot)
+    {
+        case 1: return texture(images[1], uv);
+        case 2: return texture(images[2], uv);
+        case 3: return texture(images[3], uv);
+        case 4: return texture(images[4], uv);
+        case 5: return texture(images[5], uv);
+        case 6: return texture(images[6], uv);
+        case 7: return texture(images[7], uv);
+        // sprite sheets in a texture array, see CreateSpriteSheetArray
+        case 8: return texture(sprite_sheets, vec3(uv, TextureLayer));
+        default: return texture(images[0], uv);
+    }
+}
 
 void main()
 {    
-    FragColor = texture(image, TexCoords) * vec4(Colour.rgb * Colour.a, Colour.a);
+    FragColor = SampleImage(TexCoords) * vec4(Colour.rgb * Colour.a, Colour.a);
 }
\ No newline at end of file
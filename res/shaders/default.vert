@@ -2,18 +2,27 @@
 layout (location = 0) in vec3 vertex; 
 layout (location = 1) in vec2 tex_coords;
 layout (location = 2) in vec4 colour;
+layout (location = 3) in uint packed_indices;
 
 layout (std140) uniform Matrices
 {
     mat4 projection;
 };
 
+uniform vec2 translation;
+
 out vec2 TexCoords;
 out vec4 Colour;
+flat out int TextureSlot;
+flat out int MaterialIndex;
+flat out int TextureLayer;
 
 void main()
 {
     TexCoords = tex_coords;
     Colour = colour;
-    gl_Position = projection * vec4(vertex.xy, 0.0, 1.0);
+    TextureSlot = int(packed_indices & 0xffu);
+    TextureLayer = int((packed_indices >> 8) & 0xffu);
+    MaterialIndex = int(packed_indices >> 16);
+    gl_Position = projection * vec4(vertex.xy + translation, 0.0, 1.0);
 }
\ No newline at end of file
@@ -2,10 +2,27 @@
 in vec2 TexCoords;
 in vec4 Colour;
 in float DistanceFactor;
+flat in int TextureSlot;
 
 out vec4 FragColor;
 
-uniform sampler2D image;
+uniform sampler2D images[8];
+
+vec4 SampleImage(vec2 uv)
+{
+    // sampler arrays can't be indexed with a varying in GLSL 330, so pick the sampler with a switch
+    switch(TextureSlot)
+    {
+        case 1: return texture(images[1], uv);
+        case 2: return texture(images[2], uv);
+        case 3: return texture(images[3], uv);
+        case 4: return texture(images[4], uv);
+        case 5: return texture(images[5], uv);
+        case 6: return texture(images[6], uv);
+        case 7: return texture(images[7], uv);
+        default: return texture(images[0], uv);
+    }
+}
 
 float median(float r, float g, float b) {
     return max(min(r, g), min(max(r, g), b));
@@ -13,7 +30,7 @@ float median(float r, float g, float b) {
 
 void main()
 {    
-    vec3 sample = texture(image, TexCoords).rgb;
+    vec3 sample = SampleImage(TexCoords).rgb;
     float sigDist = DistanceFactor*(median(sample.r, sample.g, sample.b) - 0.5);
     float opacity = clamp(sigDist + 0.5, 0.0, 1.0);
     opacity *= Colour.a;
@@ -2,20 +2,26 @@
 layout (location = 0) in vec3 vertex; 
 layout (location = 1) in vec2 tex_coords;
 layout (location = 2) in vec4 colour;
+layout (location = 3) in uint packed_indices;
+layout (location = 4) in float depth;
 
 layout (std140) uniform Matrices
 {
     mat4 projection;
 };
 
+uniform vec2 translation;
+
 out vec2 TexCoords;
 out vec4 Colour;
 out float DistanceFactor;
+flat out int TextureSlot;
 
 void main()
 {
     TexCoords = tex_coords;
     Colour = colour;
-    DistanceFactor = vertex.z;
-    gl_Position = projection * vec4(vertex.xy, 0.0, 1.0);
+    DistanceFactor = depth;
+    TextureSlot = int(packed_indices & 0xffu);
+    gl_Position = projection * vec4(vertex.xy + translation, 0.0, 1.0);
 }
\ No newline at end of file
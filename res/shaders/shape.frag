@@ -0,0 +1,30 @@
+#version 330 core
+in vec2 Local;
+flat in vec2 HalfSize;
+flat in float CornerRadius;
+flat in float Thickness;
+in vec4 Colour;
+
+out vec4 FragColor;
+
+// circles and capsules are just boxes with fully rounded corners
+float RoundedBoxDistance(vec2 p, vec2 half_size, float radius)
+{
+    vec2 q = abs(p) - half_size + radius;
+    return length(max(q, 0.0)) + min(max(q.x, q.y), 0.0) - radius;
+}
+
+void main()
+{
+    float distance = RoundedBoxDistance(Local, HalfSize, CornerRadius);
+
+    // outlines keep a band of the given thickness just inside the edge
+    if(Thickness > 0.0)
+    {
+        distance = abs(distance + Thickness * 0.5) - Thickness * 0.5;
+    }
+
+    float coverage = clamp(0.5 - distance / max(fwidth(distance), 0.0001), 0.0, 1.0);
+    float alpha = Colour.a * coverage;
+    FragColor = vec4(Colour.rgb * alpha, alpha);
+}
\ No newline at end of file
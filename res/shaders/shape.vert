@@ -0,0 +1,36 @@
+#version 330 core
+layout (location = 0) in vec2 centre;
+layout (location = 1) in vec2 half_size;
+layout (location = 2) in float corner_radius;
+layout (location = 3) in float thickness;
+layout (location = 4) in float angle;
+layout (location = 5) in vec4 colour;
+
+layout (std140) uniform Matrices
+{
+    mat4 projection;
+};
+
+out vec2 Local;
+flat out vec2 HalfSize;
+flat out float CornerRadius;
+flat out float Thickness;
+out vec4 Colour;
+
+void main()
+{
+    // drawn as a triangle strip, grown by a pixel on each side so the anti aliased edge doesn't get cut off
+    vec2 corner = vec2(float(gl_VertexID & 1), float(gl_VertexID >> 1)) * 2.0 - 1.0;
+    vec2 local = corner * (half_size + 1.0);
+
+    float c = cos(angle);
+    float s = sin(angle);
+    vec2 world = centre + vec2(local.x * c - local.y * s, local.x * s + local.y * c);
+
+    Local = local;
+    HalfSize = half_size;
+    CornerRadius = corner_radius;
+    Thickness = thickness;
+    Colour = colour;
+    gl_Position = projection * vec4(world, 0.0, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,30 @@
+#version 330 core
+layout (location = 0) in vec3 vertex;
+layout (location = 1) in vec2 tex_coords;
+layout (location = 2) in vec4 colour;
+layout (location = 3) in uint packed_indices;
+
+layout (std140) uniform Matrices
+{
+    mat4 projection;
+};
+
+uniform vec2 translation;
+
+out vec2 Local;
+flat out vec2 HalfSize;
+flat out float CornerRadius;
+flat out float Thickness;
+out vec4 Colour;
+
+void main()
+{
+    // shape.vert for a quad built on the cpu. the uvs are the offset from the centre and every corner is a pixel further
+    // out than the shape, z is the corner radius and the thickness is in 1/256ths of a pixel above the texture slot
+    Local = tex_coords;
+    HalfSize = abs(tex_coords) - 1.0;
+    CornerRadius = vertex.z;
+    Thickness = float(packed_indices >> 8) / 256.0;
+    Colour = colour;
+    gl_Position = projection * vec4(vertex.xy + translation, 0.0, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,37 @@
+#version 330 core
+layout (location = 0) in vec3 position;
+layout (location = 1) in vec2 size;
+layout (location = 2) in vec2 origin;
+layout (location = 3) in float angle;
+layout (location = 4) in vec4 tex_rect;
+layout (location = 5) in vec4 colour;
+layout (location = 6) in float texture_slot;
+layout (location = 7) in float texture_layer;
+
+layout (std140) uniform Matrices
+{
+    mat4 projection;
+};
+
+out vec2 TexCoords;
+out vec4 Colour;
+flat out int TextureSlot;
+flat out int TextureLayer;
+
+void main()
+{
+    // drawn as a triangle strip: top left, top right, bottom left, bottom right
+    vec2 corner = vec2(float(gl_VertexID & 1), float(gl_VertexID >> 1));
+
+    // same as RenderSprite, offset by the origin then rotate around the position
+    vec2 local = corner * size - origin;
+    float c = cos(angle);
+    float s = sin(angle);
+    vec2 world = position.xy + vec2(local.x * c - local.y * s, local.x * s + local.y * c);
+
+    TexCoords = tex_rect.xy + corner * tex_rect.zw;
+    Colour = colour;
+    TextureSlot = int(texture_slot);
+    TextureLayer = int(texture_layer);
+    gl_Position = projection * vec4(world, 0.0, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,554 @@
+#include <map>
+#include <iostream>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <unordered_map>
+#include "graphics.h"
+#include "capture.h"
+#include "atlas.h"
+#include "stb_image.h"
+
+using namespace Honeybear;
+
+namespace
+{
+    const char* LAYER_NAMES[3] = { "diffuse", "specular", "normal" };
+
+    struct PackRect
+    {
+        uint32_t x;
+        uint32_t y;
+        uint32_t w;
+        uint32_t h;
+    };
+
+    // a rect of source pixels and where it ended up
+    struct AtlasEntry
+    {
+        // rgba pixels for each SpriteSheetLayer, null when the source doesn't have that layer
+        const uint8_t* layers[3];
+        uint32_t source_width;
+        PackRect source;
+
+        // already turned by an earlier atlas, the pixels are copied as they are
+        bool was_rotated;
+        bool can_rotate;
+
+        uint32_t page;
+        // includes the extrusion and padding
+        PackRect placed;
+        bool rotated;
+    };
+
+    struct MaxRectsBin
+    {
+        std::vector<PackRect> free_rects;
+    };
+
+    struct GlyphPlacement
+    {
+        Graphics::MSDF_CharData* char_data;
+        uint32_t entry;
+        float source_x;
+        float source_y;
+    };
+
+    bool Overlaps(const PackRect& a, const PackRect& b)
+    {
+        return a.x < b.x + b.w && b.x < a.x + a.w && a.y < b.y + b.h && b.y < a.y + a.h;
+    }
+
+    bool Contains(const PackRect& outer, const PackRect& inner)
+    {
+        return inner.x >= outer.x && inner.y >= outer.y && inner.x + inner.w <= outer.x + outer.w && inner.y + inner.h <= outer.y + outer.h;
+    }
+
+    // best short side fit, the free rect that leaves the least on its shorter side wins
+    bool FindPosition(const MaxRectsBin& bin, const uint32_t w, const uint32_t h, const bool allow_rotation, PackRect* result, bool* rotated)
+    {
+        uint32_t best_short_side = UINT32_MAX;
+        uint32_t best_long_side = UINT32_MAX;
+
+        for(const PackRect& free_rect : bin.free_rects)
+        {
+            for(int turn = 0; turn < (allow_rotation ? 2 : 1); ++turn)
+            {
+                uint32_t rect_w = turn ? h : w;
+                uint32_t rect_h = turn ? w : h;
+                if(rect_w > free_rect.w || rect_h > free_rect.h) continue;
+
+                uint32_t leftover_w = free_rect.w - rect_w;
+                uint32_t leftover_h = free_rect.h - rect_h;
+                uint32_t short_side = std::min(leftover_w, leftover_h);
+                uint32_t long_side = std::max(leftover_w, leftover_h);
+
+                if(short_side < best_short_side || (short_side == best_short_side && long_side < best_long_side))
+                {
+                    best_short_side = short_side;
+                    best_long_side = long_side;
+                    *result = { free_rect.x, free_rect.y, rect_w, rect_h };
+                    *rotated = turn == 1;
+                }
+            }
+        }
+
+        return best_short_side != UINT32_MAX;
+    }
+
+    void PlaceRect(MaxRectsBin& bin, const PackRect& placed)
+    {
+        // every free rect the new one overlaps is split into the (up to four) maximal rects left around it
+        std::vector<PackRect> free_rects;
+        free_rects.reserve(bin.free_rects.size() + 4);
+
+        for(const PackRect& free_rect : bin.free_rects)
+        {
+            if(!Overlaps(free_rect, placed))
+            {
+                free_rects.push_back(free_rect);
+                continue;
+            }
+
+            uint32_t free_right = free_rect.x + free_rect.w;
+            uint32_t free_bottom = free_rect.y + free_rect.h;
+            uint32_t placed_right = placed.x + placed.w;
+            uint32_t placed_bottom = placed.y + placed.h;
+
+            if(placed.x > free_rect.x) free_rects.push_back({ free_rect.x, free_rect.y, placed.x - free_rect.x, free_rect.h });
+            if(placed_right < free_right) free_rects.push_back({ placed_right, free_rect.y, free_right - placed_right, free_rect.h });
+            if(placed.y > free_rect.y) free_rects.push_back({ free_rect.x, free_rect.y, free_rect.w, placed.y - free_rect.y });
+            if(placed_bottom < free_bottom) free_rects.push_back({ free_rect.x, placed_bottom, free_rect.w, free_bottom - placed_bottom });
+        }
+
+        // then any free rect inside another one is dropped, of two identical ones the first goes
+        std::vector<bool> removed(free_rects.size(), false);
+        for(size_t i = 0; i < free_rects.size(); ++i)
+        {
+            for(size_t j = 0; j < free_rects.size(); ++j)
+            {
+                if(i == j || removed[j]) continue;
+                if(Contains(free_rects[j], free_rects[i]))
+                {
+                    removed[i] = true;
+                    break;
+                }
+            }
+        }
+
+        bin.free_rects.clear();
+        for(size_t i = 0; i < free_rects.size(); ++i)
+        {
+            if(!removed[i]) bin.free_rects.push_back(free_rects[i]);
+        }
+    }
+
+    bool InsertGroup(MaxRectsBin& bin, std::vector<AtlasEntry>& entries, const std::vector<uint32_t>& group, const TextureAtlas* atlas)
+    {
+        for(uint32_t entry_index : group)
+        {
+            AtlasEntry& entry = entries[entry_index];
+            uint32_t border = atlas->extrude * 2 + atlas->padding;
+
+            bool rotated = false;
+            if(!FindPosition(bin, entry.source.w + border, entry.source.h + border, atlas->allow_rotation && entry.can_rotate, &entry.placed, &rotated))
+            {
+                return false;
+            }
+
+            entry.rotated = rotated;
+            PlaceRect(bin, entry.placed);
+        }
+
+        return true;
+    }
+
+    // a group always goes on one page, a font's glyphs have to share its texture
+    bool PackGroup(std::vector<MaxRectsBin>& bins, std::vector<AtlasEntry>& entries, const std::vector<uint32_t>& group, const TextureAtlas* atlas)
+    {
+        for(uint32_t page = 0; page <= bins.size(); ++page)
+        {
+            MaxRectsBin bin;
+            if(page < bins.size())
+            {
+                bin = bins[page];
+            }
+            else
+            {
+                bin.free_rects.push_back({ 0, 0, atlas->page_size, atlas->page_size });
+            }
+
+            if(!InsertGroup(bin, entries, group, atlas)) continue;
+
+            if(page < bins.size()) bins[page] = bin;
+            else bins.push_back(bin);
+
+            for(uint32_t entry_index : group)
+            {
+                entries[entry_index].page = page;
+            }
+            return true;
+        }
+
+        return false;
+    }
+
+    uint32_t GetContentWidth(const AtlasEntry& entry)
+    {
+        return entry.rotated ? entry.source.h : entry.source.w;
+    }
+
+    uint32_t GetContentHeight(const AtlasEntry& entry)
+    {
+        return entry.rotated ? entry.source.w : entry.source.h;
+    }
+
+    void BlitEntry(const AtlasEntry& entry, const uint32_t layer, const int extrude, uint8_t* page, const uint32_t page_width)
+    {
+        const uint8_t* source = entry.layers[layer];
+        int content_w = GetContentWidth(entry);
+        int content_h = GetContentHeight(entry);
+
+        for(int y = -extrude; y < content_h + extrude; ++y)
+        {
+            for(int x = -extrude; x < content_w + extrude; ++x)
+            {
+                // the extruded border repeats the nearest edge pixel
+                uint32_t u = std::min(std::max(x, 0), content_w - 1);
+                uint32_t v = std::min(std::max(y, 0), content_h - 1);
+
+                // turned clockwise, so the source's left column is the top row
+                uint32_t source_x = entry.rotated ? entry.source.x + v : entry.source.x + u;
+                uint32_t source_y = entry.rotated ? entry.source.y + (entry.source.h - 1 - u) : entry.source.y + v;
+
+                uint32_t page_x = entry.placed.x + extrude + x;
+                uint32_t page_y = entry.placed.y + extrude + y;
+                std::memcpy(page + (page_y * page_width + page_x) * 4, source + (source_y * entry.source_width + source_x) * 4, 4);
+            }
+        }
+    }
+
+    // sprite sheets only keep their pixels on the gpu, so read them back once per texture
+    const uint8_t* ReadTexturePixels(const Texture* texture, std::unordered_map<GLuint, std::vector<uint8_t>>& read_back)
+    {
+        std::vector<uint8_t>& pixels = read_back[texture->ID];
+        if(pixels.empty())
+        {
+            pixels.resize(texture->width * texture->height * 4);
+            Graphics::BindScratchTexture(GL_TEXTURE_2D, texture->ID);
+            glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+            glActiveTexture(GL_TEXTURE0);
+        }
+        return pixels.data();
+    }
+
+    // the same rect of the same texture is only packed once however many sprites or glyphs use it
+    uint32_t AddEntry(std::vector<AtlasEntry>& entries, std::map<std::pair<const uint8_t*, uint64_t>, uint32_t>& entry_indices, const AtlasEntry& entry)
+    {
+        uint64_t rect_key = (uint64_t)entry.source.x | ((uint64_t)entry.source.y << 16) | ((uint64_t)entry.source.w << 32) | ((uint64_t)entry.source.h << 48);
+        auto key = std::make_pair(entry.layers[0], rect_key);
+
+        auto it = entry_indices.find(key);
+        if(it != entry_indices.end()) return it->second;
+
+        uint32_t index = entries.size();
+        entries.push_back(entry);
+        entry_indices[key] = index;
+        return index;
+    }
+}
+
+void TextureAtlases::AddSpriteSheet(TextureAtlas* atlas, const std::string& sprite_sheet_name)
+{
+    atlas->sprite_sheets.push_back(sprite_sheet_name);
+}
+
+void TextureAtlases::AddImage(TextureAtlas* atlas, const std::string& image_file_name, const uint32_t sprite_id)
+{
+    atlas->images.push_back(image_file_name);
+    atlas->image_sprite_ids.push_back(sprite_id);
+}
+
+void TextureAtlases::AddFont(TextureAtlas* atlas, const std::string& font_id)
+{
+    atlas->fonts.push_back(font_id);
+}
+
+bool TextureAtlases::BuildAtlas(TextureAtlas* atlas)
+{
+    Capture::Scope capture_scope(true);
+    if(capture_scope.recording)
+    {
+        Capture::Record(CAPTURE_BUILD_ATLAS, atlas->name, atlas->page_size, atlas->padding, atlas->extrude, atlas->allow_rotation, atlas->filter_type,
+            CaptureArray<std::string>{ atlas->sprite_sheets.data(), (uint32_t)atlas->sprite_sheets.size() },
+            CaptureArray<std::string>{ atlas->images.data(), (uint32_t)atlas->images.size() },
+            CaptureArray<uint32_t>{ atlas->image_sprite_ids.data(), (uint32_t)atlas->image_sprite_ids.size() },
+            CaptureArray<std::string>{ atlas->fonts.data(), (uint32_t)atlas->fonts.size() });
+    }
+
+    std::vector<AtlasEntry> entries;
+    std::map<std::pair<const uint8_t*, uint64_t>, uint32_t> entry_indices;
+    std::unordered_map<GLuint, std::vector<uint8_t>> read_back;
+    std::vector<unsigned char*> loaded_images;
+
+    std::vector<std::pair<uint32_t, uint32_t>> sprite_entries;
+    std::vector<std::pair<size_t, uint32_t>> image_entries;
+    std::vector<std::pair<Graphics::MSDF_Font*, std::vector<GlyphPlacement>>> font_glyphs;
+
+    for(const std::string& sprite_sheet_name : atlas->sprite_sheets)
+    {
+        auto sheet_it = Graphics::sprite_sheets.find(sprite_sheet_name);
+        if(sheet_it == Graphics::sprite_sheets.end() || sheet_it->second->diffuse == nullptr)
+        {
+            std::cout << "ERROR::ATLAS: Sprite sheet not found: " << sprite_sheet_name << std::endl;
+            continue;
+        }
+
+        SpriteSheet* sprite_sheet = sheet_it->second;
+        Texture* layer_textures[3] = { sprite_sheet->diffuse, sprite_sheet->specular, sprite_sheet->normal };
+        uint32_t width = sprite_sheet->diffuse->width;
+        uint32_t height = sprite_sheet->diffuse->height;
+
+        AtlasEntry entry = {};
+        entry.source_width = width;
+        for(int layer = 0; layer < 3; ++layer)
+        {
+            if(layer_textures[layer] == nullptr) continue;
+            if(layer_textures[layer]->width != width || layer_textures[layer]->height != height)
+            {
+                std::cout << "ERROR::ATLAS: The " << LAYER_NAMES[layer] << " texture of " << sprite_sheet_name << " isn't the same size as its diffuse, leaving it out" << std::endl;
+                continue;
+            }
+            entry.layers[layer] = ReadTexturePixels(layer_textures[layer], read_back);
+        }
+
+        // sorted so the same sheets always pack the same way
+        std::vector<uint32_t> sprite_ids;
+        for(auto it = Graphics::sprites.begin(); it != Graphics::sprites.end(); ++it)
+        {
+            if(it->second.sprite_sheet == sprite_sheet) sprite_ids.push_back(it->first);
+        }
+        std::sort(sprite_ids.begin(), sprite_ids.end());
+
+        for(uint32_t sprite_id : sprite_ids)
+        {
+            const Sprite& sprite = Graphics::sprites[sprite_id];
+            entry.source.x = (uint32_t)std::lround(sprite.texture_x * width);
+            entry.source.y = (uint32_t)std::lround(sprite.texture_y * height);
+            entry.source.w = (uint32_t)std::lround(sprite.texture_w * width);
+            entry.source.h = (uint32_t)std::lround(sprite.texture_h * height);
+            entry.was_rotated = sprite.rotated;
+            entry.can_rotate = !sprite.rotated;
+
+            if(entry.source.w == 0 || entry.source.h == 0) continue;
+            sprite_entries.push_back(std::make_pair(sprite_id, AddEntry(entries, entry_indices, entry)));
+        }
+    }
+
+    for(size_t i = 0; i < atlas->images.size(); ++i)
+    {
+        int width, height, channels;
+        unsigned char* data = stbi_load(atlas->images[i].c_str(), &width, &height, &channels, 4);
+        if(!data)
+        {
+            std::cout << "ERROR::ATLAS: Failed to load image " << atlas->images[i] << ": " << stbi_failure_reason() << std::endl;
+            continue;
+        }
+        loaded_images.push_back(data);
+
+        AtlasEntry entry = {};
+        entry.layers[0] = data;
+        entry.source_width = width;
+        entry.source = { 0, 0, (uint32_t)width, (uint32_t)height };
+        entry.can_rotate = true;
+
+        image_entries.push_back(std::make_pair(i, AddEntry(entries, entry_indices, entry)));
+    }
+
+    for(const std::string& font_id : atlas->fonts)
+    {
+        auto font_it = Graphics::msdf_fonts.find(font_id);
+        if(font_it == Graphics::msdf_fonts.end() || font_it->second.texture == nullptr)
+        {
+            std::cout << "ERROR::ATLAS: Font not found: " << font_id << std::endl;
+            continue;
+        }
+
+        Graphics::MSDF_Font* font = &font_it->second;
+        font_glyphs.push_back(std::make_pair(font, std::vector<GlyphPlacement>()));
+
+        AtlasEntry entry = {};
+        entry.layers[0] = ReadTexturePixels(font->texture, read_back);
+        entry.source_width = font->texture->width;
+
+        for(auto it = font->data.begin(); it != font->data.end(); ++it)
+        {
+            Graphics::Bounds& bounds = it->second.atlas_bounds;
+            if(bounds.right <= bounds.left || bounds.bottom <= bounds.top) continue;
+
+            // the bounds are on half pixels, the whole pixels they cover are packed
+            float left = std::max(0.0f, std::floor(bounds.left));
+            float top = std::max(0.0f, std::floor(bounds.top));
+            float right = std::min((float)font->texture->width, std::ceil(bounds.right));
+            float bottom = std::min((float)font->texture->height, std::ceil(bounds.bottom));
+            entry.source = { (uint32_t)left, (uint32_t)top, (uint32_t)(right - left), (uint32_t)(bottom - top) };
+
+            GlyphPlacement glyph = { &it->second, AddEntry(entries, entry_indices, entry), left, top };
+            font_glyphs.back().second.push_back(glyph);
+        }
+    }
+
+    // fonts go first while the pages are emptiest, then everything else biggest first
+    std::vector<std::vector<uint32_t>> groups;
+    std::vector<bool> grouped(entries.size(), false);
+    for(auto& font : font_glyphs)
+    {
+        std::vector<uint32_t> group;
+        for(const GlyphPlacement& glyph : font.second)
+        {
+            if(grouped[glyph.entry]) continue;
+            grouped[glyph.entry] = true;
+            group.push_back(glyph.entry);
+        }
+        if(!group.empty()) groups.push_back(group);
+    }
+
+    std::vector<uint32_t> order;
+    for(uint32_t i = 0; i < entries.size(); ++i)
+    {
+        order.push_back(i);
+    }
+
+    auto bigger = [&entries](const uint32_t a, const uint32_t b)
+    {
+        uint32_t a_long = std::max(entries[a].source.w, entries[a].source.h);
+        uint32_t b_long = std::max(entries[b].source.w, entries[b].source.h);
+        if(a_long != b_long) return a_long > b_long;
+        return std::min(entries[a].source.w, entries[a].source.h) > std::min(entries[b].source.w, entries[b].source.h);
+    };
+    std::stable_sort(order.begin(), order.end(), bigger);
+
+    for(std::vector<uint32_t>& group : groups)
+    {
+        std::stable_sort(group.begin(), group.end(), bigger);
+    }
+    for(uint32_t entry_index : order)
+    {
+        if(!grouped[entry_index]) groups.push_back(std::vector<uint32_t>(1, entry_index));
+    }
+
+    std::vector<MaxRectsBin> bins;
+    bool packed_everything = true;
+    for(size_t i = 0; i < groups.size(); ++i)
+    {
+        if(PackGroup(bins, entries, groups[i], atlas)) continue;
+
+        std::cout << "ERROR::ATLAS: " << (groups[i].size() > 1 ? "A font's glyphs don't" : "A sprite doesn't") << " fit on a " << atlas->page_size << " page of " << atlas->name << std::endl;
+        for(uint32_t entry_index : groups[i])
+        {
+            entries[entry_index].page = INVALID_HANDLE;
+        }
+        packed_everything = false;
+    }
+
+    // each page is trimmed to what was packed on it, the padding after the last rect isn't needed
+    std::vector<uint32_t> page_widths(bins.size(), 1);
+    std::vector<uint32_t> page_heights(bins.size(), 1);
+    std::vector<bool> page_layers(bins.size() * 3, false);
+    for(const AtlasEntry& entry : entries)
+    {
+        if(entry.page == INVALID_HANDLE) continue;
+        page_widths[entry.page] = std::max(page_widths[entry.page], entry.placed.x + GetContentWidth(entry) + atlas->extrude * 2);
+        page_heights[entry.page] = std::max(page_heights[entry.page], entry.placed.y + GetContentHeight(entry) + atlas->extrude * 2);
+        for(int layer = 0; layer < 3; ++layer)
+        {
+            if(entry.layers[layer]) page_layers[entry.page * 3 + layer] = true;
+        }
+    }
+
+    atlas->pages.clear();
+    std::vector<uint8_t> pixels;
+    for(uint32_t page = 0; page < bins.size(); ++page)
+    {
+        std::string page_name = atlas->name + "_" + std::to_string(page);
+        SpriteSheet*& sprite_sheet = Graphics::sprite_sheets[page_name];
+        if(sprite_sheet == nullptr) sprite_sheet = new SpriteSheet();
+
+        Texture** layer_textures[3] = { &sprite_sheet->diffuse, &sprite_sheet->specular, &sprite_sheet->normal };
+        for(int layer = 0; layer < 3; ++layer)
+        {
+            *layer_textures[layer] = nullptr;
+            if(!page_layers[page * 3 + layer]) continue;
+
+            // rects without this layer are left transparent
+            pixels.assign(page_widths[page] * page_heights[page] * 4, 0);
+            for(const AtlasEntry& entry : entries)
+            {
+                if(entry.page != page || entry.layers[layer] == nullptr) continue;
+                BlitEntry(entry, layer, atlas->extrude, pixels.data(), page_widths[page]);
+            }
+
+            *layer_textures[layer] = Graphics::CreateTexture(page_name + "_" + LAYER_NAMES[layer], pixels.data(), page_widths[page], page_heights[page], atlas->filter_type);
+        }
+
+        atlas->pages.push_back(sprite_sheet);
+    }
+
+    // image sprites are only made once the image has a place on a page, so one that didn't fit never has no sheet
+    for(auto& image_entry : image_entries)
+    {
+        const AtlasEntry& entry = entries[image_entry.second];
+        if(entry.page == INVALID_HANDLE) continue;
+
+        uint32_t sprite_id = atlas->image_sprite_ids[image_entry.first];
+        Sprite& sprite = Graphics::sprites[sprite_id];
+        sprite.id = sprite_id;
+        sprite.name = atlas->images[image_entry.first];
+        sprite.width = entry.source.w;
+        sprite.height = entry.source.h;
+        sprite_entries.push_back(std::make_pair(sprite_id, image_entry.second));
+    }
+
+    for(auto& sprite_entry : sprite_entries)
+    {
+        const AtlasEntry& entry = entries[sprite_entry.second];
+        if(entry.page == INVALID_HANDLE) continue;
+
+        float page_width = page_widths[entry.page];
+        float page_height = page_heights[entry.page];
+
+        Sprite& sprite = Graphics::sprites[sprite_entry.first];
+        sprite.sprite_sheet = atlas->pages[entry.page];
+        sprite.texture_x = (entry.placed.x + atlas->extrude) / page_width;
+        sprite.texture_y = (entry.placed.y + atlas->extrude) / page_height;
+        sprite.texture_w = GetContentWidth(entry) / page_width;
+        sprite.texture_h = GetContentHeight(entry) / page_height;
+        sprite.rotated = entry.rotated || entry.was_rotated;
+    }
+
+    // glyph bounds stay in pixels, they just move to where the glyph went on the page
+    for(auto& font : font_glyphs)
+    {
+        if(font.second.empty() || entries[font.second[0].entry].page == INVALID_HANDLE) continue;
+
+        for(const GlyphPlacement& glyph : font.second)
+        {
+            const AtlasEntry& entry = entries[glyph.entry];
+            float offset_x = entry.placed.x + atlas->extrude - glyph.source_x;
+            float offset_y = entry.placed.y + atlas->extrude - glyph.source_y;
+            glyph.char_data->atlas_bounds.left += offset_x;
+            glyph.char_data->atlas_bounds.right += offset_x;
+            glyph.char_data->atlas_bounds.top += offset_y;
+            glyph.char_data->atlas_bounds.bottom += offset_y;
+        }
+
+        font.first->texture = atlas->pages[entries[font.second[0].entry].page]->diffuse;
+    }
+
+    for(unsigned char* data : loaded_images)
+    {
+        stbi_image_free(data);
+    }
+
+    return packed_everything;
+}
\ No newline at end of file
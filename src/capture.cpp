@@ -0,0 +1,1024 @@
+#include <thread>
+#include <fstream>
+#include <iostream>
+#include <cstring>
+#include <unordered_map>
+#include "engine.h"
+#include "graphics.h"
+#include "capture.h"
+#include "atlas.h"
+
+using namespace Honeybear;
+
+std::atomic<bool> Capture::capturing(false);
+
+namespace
+{
+    const char CAPTURE_FILE_MAGIC[4] = { 'H', 'B', 'C', 'P' };
+    const uint32_t CAPTURE_FILE_VERSION = 1;
+
+    // a string index with this bit set is followed by the string itself, the first time it's used in a stream
+    const uint32_t STRING_DEFINITION_BIT = 0x80000000;
+    const uint32_t NULL_STRING = 0x7fffffff;
+
+    struct CaptureStream
+    {
+        std::vector<uint8_t> data;
+        std::unordered_map<std::string, uint32_t> strings;
+    };
+
+    CaptureStream setup_stream;
+    CaptureStream frame_stream;
+    thread_local CaptureStream* active_stream = nullptr;
+    thread_local int scope_depth = 0;
+
+    bool replaying = false;
+    std::thread::id capture_thread;
+    std::string capture_file_name;
+    uint32_t frames_remaining = 0;
+    std::vector<CaptureFrame> captured_frames;
+
+    void WriteBytes(const void* bytes, const size_t size)
+    {
+        std::vector<uint8_t>& data = active_stream->data;
+        size_t offset = data.size();
+        data.resize(offset + size);
+        std::memcpy(data.data() + offset, bytes, size);
+    }
+
+    struct CaptureReader
+    {
+        const uint8_t* data;
+        size_t size;
+        size_t offset;
+        std::vector<std::string>* strings;
+    };
+
+    template<typename T>
+    T Read(CaptureReader& reader)
+    {
+        T value;
+        std::memcpy(&value, reader.data + reader.offset, sizeof(T));
+        reader.offset += sizeof(T);
+        return value;
+    }
+
+    Vec2 ReadVec2(CaptureReader& reader)
+    {
+        float x = Read<float>(reader);
+        float y = Read<float>(reader);
+        return Vec2(x, y);
+    }
+
+    Vec3 ReadVec3(CaptureReader& reader)
+    {
+        float x = Read<float>(reader);
+        float y = Read<float>(reader);
+        float z = Read<float>(reader);
+        return Vec3(x, y, z);
+    }
+
+    Vec4 ReadVec4(CaptureReader& reader)
+    {
+        float x = Read<float>(reader);
+        float y = Read<float>(reader);
+        float z = Read<float>(reader);
+        float w = Read<float>(reader);
+        return Vec4(x, y, z, w);
+    }
+
+    const std::string* ReadString(CaptureReader& reader)
+    {
+        uint32_t index = Read<uint32_t>(reader);
+        if(index == NULL_STRING) return nullptr;
+
+        if(index & STRING_DEFINITION_BIT)
+        {
+            index &= ~STRING_DEFINITION_BIT;
+            uint32_t length = Read<uint32_t>(reader);
+            if(reader.strings->size() <= index) reader.strings->resize(index + 1);
+            (*reader.strings)[index].assign((const char*)reader.data + reader.offset, length);
+            reader.offset += length;
+        }
+
+        return &(*reader.strings)[index];
+    }
+
+    const char* ReadCString(CaptureReader& reader)
+    {
+        const std::string* value = ReadString(reader);
+        return value ? value->c_str() : nullptr;
+    }
+
+    // the points are only needed for the call they're read for
+    const std::vector<Vec2>& ReadPoints(CaptureReader& reader)
+    {
+        thread_local std::vector<Vec2> points;
+        points.resize(Read<uint32_t>(reader));
+        for(size_t i = 0; i < points.size(); ++i)
+        {
+            points[i] = ReadVec2(reader);
+        }
+        return points;
+    }
+
+    template<typename T>
+    const std::vector<T>& ReadValues(CaptureReader& reader, T (*read_value)(CaptureReader&))
+    {
+        thread_local std::vector<T> values;
+        values.resize(Read<uint32_t>(reader));
+        for(size_t i = 0; i < values.size(); ++i)
+        {
+            values[i] = read_value(reader);
+        }
+        return values;
+    }
+
+    float ReadFloat(CaptureReader& reader)
+    {
+        return Read<float>(reader);
+    }
+
+    int ReadInt(CaptureReader& reader)
+    {
+        return Read<int32_t>(reader);
+    }
+
+    uint32_t ReadUint(CaptureReader& reader)
+    {
+        return Read<uint32_t>(reader);
+    }
+
+    std::string ReadStringValue(CaptureReader& reader)
+    {
+        const std::string* value = ReadString(reader);
+        return value ? *value : std::string();
+    }
+
+    const Sprite& ReadSprite(CaptureReader& reader)
+    {
+        return *Graphics::GetSprite(Read<uint32_t>(reader));
+    }
+
+    void ReplayStream(const uint8_t* data, const size_t size, std::vector<std::string>& strings)
+    {
+        CaptureReader reader = { data, size, 0, &strings };
+
+        while(reader.offset < reader.size)
+        {
+            CaptureOp op = (CaptureOp)Read<uint8_t>(reader);
+            switch(op)
+            {
+                case CAPTURE_LOAD_TEXTURE:
+                {
+                    const std::string* name = ReadString(reader);
+                    Graphics::FilterType filter_type = (Graphics::FilterType)Read<uint32_t>(reader);
+                    Graphics::LoadTexture(*name, filter_type);
+                    break;
+                }
+                case CAPTURE_LOAD_SPRITES_FILE:
+                {
+                    const std::string* name = ReadString(reader);
+                    Graphics::FilterType filter_type = (Graphics::FilterType)Read<uint32_t>(reader);
+                    Graphics::LoadSpritesFile(*name, filter_type);
+                    break;
+                }
+                case CAPTURE_LOAD_SPRITE_SHEET:
+                {
+                    const std::string* name = ReadString(reader);
+                    const char* diffuse = ReadCString(reader);
+                    const char* specular = ReadCString(reader);
+                    const char* normal = ReadCString(reader);
+                    Graphics::FilterType filter_type = (Graphics::FilterType)Read<uint32_t>(reader);
+                    Graphics::LoadSpriteSheet(*name, diffuse, specular, normal, filter_type);
+                    break;
+                }
+                case CAPTURE_CREATE_SPRITE:
+                {
+                    uint32_t sprite_id = Read<uint32_t>(reader);
+                    const std::string* sprite_sheet_name = ReadString(reader);
+                    int x = Read<int32_t>(reader);
+                    int y = Read<int32_t>(reader);
+                    int w = Read<int32_t>(reader);
+                    int h = Read<int32_t>(reader);
+                    Graphics::CreateSprite(sprite_id, Graphics::sprite_sheets[*sprite_sheet_name], x, y, w, h);
+                    break;
+                }
+                case CAPTURE_LOAD_SHADER:
+                {
+                    const std::string* shader_id = ReadString(reader);
+                    const char* vertex_file_name = ReadCString(reader);
+                    const char* fragment_file_name = ReadCString(reader);
+                    Graphics::LoadShader(*shader_id, vertex_file_name, fragment_file_name);
+                    break;
+                }
+                case CAPTURE_CREATE_SHADER_PROGRAM:
+                {
+                    const std::string* shader_id = ReadString(reader);
+                    const char* vertex_code = ReadCString(reader);
+                    const char* fragment_code = ReadCString(reader);
+                    Graphics::CreateShaderProgram(*shader_id, vertex_code, fragment_code);
+                    break;
+                }
+                case CAPTURE_LOAD_MSDF_FONT:
+                {
+                    const std::string* font_id = ReadString(reader);
+                    const std::string* atlas_file_name = ReadString(reader);
+                    const std::string* data_file_name = ReadString(reader);
+                    Graphics::LoadMSDFFont(*font_id, *atlas_file_name, *data_file_name);
+                    break;
+                }
+                case CAPTURE_ADD_FRAME_BUFFER:
+                {
+                    uint32_t width = Read<uint32_t>(reader);
+                    uint32_t height = Read<uint32_t>(reader);
+                    Graphics::AddFrameBuffer(width, height);
+                    break;
+                }
+                case CAPTURE_ADD_MULTISAMPLED_FRAME_BUFFER:
+                {
+                    uint32_t width = Read<uint32_t>(reader);
+                    uint32_t height = Read<uint32_t>(reader);
+                    uint32_t samples = Read<uint32_t>(reader);
+                    Graphics::AddMultiSampledFrameBuffer(width, height, samples);
+                    break;
+                }
+                case CAPTURE_ENABLE_BUFFER_AUTO_SCALING:
+                {
+                    Graphics::EnableBufferAutoScaling(Read<uint32_t>(reader));
+                    break;
+                }
+                case CAPTURE_DISABLE_BUFFER_AUTO_SCALING:
+                {
+                    Graphics::DisableBufferAutoScaling(Read<uint32_t>(reader));
+                    break;
+                }
+                case CAPTURE_ATTACH_DEPTH_BUFFER:
+                {
+                    Graphics::AttachDepthBuffer(Read<uint32_t>(reader));
+                    break;
+                }
+                case CAPTURE_UPDATE_FRAME_BUFFER_SIZE:
+                {
+                    uint32_t frame_buffer_index = Read<uint32_t>(reader);
+                    uint32_t width = Read<uint32_t>(reader);
+                    uint32_t height = Read<uint32_t>(reader);
+                    Graphics::UpdateFrameBufferSize(frame_buffer_index, width, height);
+                    break;
+                }
+                case CAPTURE_SET_CLEAR_COLOUR:
+                {
+                    Graphics::SetClearColour(ReadVec4(reader));
+                    break;
+                }
+                case CAPTURE_SET_FRAME_BUFFER_CLEAR_COLOUR:
+                {
+                    uint32_t frame_buffer_index = Read<uint32_t>(reader);
+                    Graphics::SetClearColour(frame_buffer_index, ReadVec4(reader));
+                    break;
+                }
+                case CAPTURE_ACTIVATE_SHADER:
+                {
+                    Graphics::ActivateShader(*ReadString(reader));
+                    break;
+                }
+                case CAPTURE_SET_SHADER_PROJECTION:
+                {
+                    const std::string* shader_id = ReadString(reader);
+                    float left = Read<float>(reader);
+                    float right = Read<float>(reader);
+                    float bottom = Read<float>(reader);
+                    float top = Read<float>(reader);
+                    float z_near = Read<float>(reader);
+                    float z_far = Read<float>(reader);
+                    Graphics::SetShaderProjection(*shader_id, left, right, bottom, top, z_near, z_far);
+                    break;
+                }
+                case CAPTURE_SET_SHADER_FLOAT:
+                {
+                    const std::string* shader_id = ReadString(reader);
+                    const std::string* uniform_name = ReadString(reader);
+                    Graphics::SetShaderFloat(*shader_id, *uniform_name, Read<float>(reader));
+                    break;
+                }
+                case CAPTURE_SET_SHADER_INT:
+                {
+                    const std::string* shader_id = ReadString(reader);
+                    const std::string* uniform_name = ReadString(reader);
+                    Graphics::SetShaderInt(*shader_id, *uniform_name, Read<int32_t>(reader));
+                    break;
+                }
+                case CAPTURE_SET_SHADER_VEC2:
+                {
+                    const std::string* shader_id = ReadString(reader);
+                    const std::string* uniform_name = ReadString(reader);
+                    Graphics::SetShaderVec2(*shader_id, *uniform_name, ReadVec2(reader));
+                    break;
+                }
+                case CAPTURE_SET_SHADER_VEC3:
+                {
+                    const std::string* shader_id = ReadString(reader);
+                    const std::string* uniform_name = ReadString(reader);
+                    Graphics::SetShaderVec3(*shader_id, *uniform_name, ReadVec3(reader));
+                    break;
+                }
+                case CAPTURE_SET_SHADER_VEC4:
+                {
+                    const std::string* shader_id = ReadString(reader);
+                    const std::string* uniform_name = ReadString(reader);
+                    Graphics::SetShaderVec4(*shader_id, *uniform_name, ReadVec4(reader));
+                    break;
+                }
+                case CAPTURE_SET_SHADER_FLOAT_ARRAY:
+                {
+                    const std::string* shader_id = ReadString(reader);
+                    const std::string* uniform_name = ReadString(reader);
+                    const std::vector<float>& values = ReadValues(reader, ReadFloat);
+                    Graphics::SetShaderFloatArray(*shader_id, *uniform_name, values.data(), values.size());
+                    break;
+                }
+                case CAPTURE_SET_SHADER_INT_ARRAY:
+                {
+                    const std::string* shader_id = ReadString(reader);
+                    const std::string* uniform_name = ReadString(reader);
+                    const std::vector<int>& values = ReadValues(reader, ReadInt);
+                    Graphics::SetShaderIntArray(*shader_id, *uniform_name, values.data(), values.size());
+                    break;
+                }
+                case CAPTURE_SET_SHADER_VEC2_ARRAY:
+                {
+                    const std::string* shader_id = ReadString(reader);
+                    const std::string* uniform_name = ReadString(reader);
+                    const std::vector<Vec2>& values = ReadValues(reader, ReadVec2);
+                    Graphics::SetShaderVec2Array(*shader_id, *uniform_name, values.data(), values.size());
+                    break;
+                }
+                case CAPTURE_SET_SHADER_VEC3_ARRAY:
+                {
+                    const std::string* shader_id = ReadString(reader);
+                    const std::string* uniform_name = ReadString(reader);
+                    const std::vector<Vec3>& values = ReadValues(reader, ReadVec3);
+                    Graphics::SetShaderVec3Array(*shader_id, *uniform_name, values.data(), values.size());
+                    break;
+                }
+                case CAPTURE_SET_SHADER_VEC4_ARRAY:
+                {
+                    const std::string* shader_id = ReadString(reader);
+                    const std::string* uniform_name = ReadString(reader);
+                    const std::vector<Vec4>& values = ReadValues(reader, ReadVec4);
+                    Graphics::SetShaderVec4Array(*shader_id, *uniform_name, values.data(), values.size());
+                    break;
+                }
+                case CAPTURE_SET_SHADER_TEXTURE:
+                {
+                    const std::string* shader_id = ReadString(reader);
+                    const std::string* uniform_name = ReadString(reader);
+                    const std::string* texture_name = ReadString(reader);
+                    uint8_t texture_unit = Read<uint8_t>(reader);
+                    Texture* texture = Graphics::GetTexture(Graphics::GetTextureHandle(*texture_name));
+                    Graphics::SetShaderTexture(*shader_id, *uniform_name, texture ? texture->ID : 0, texture_unit);
+                    break;
+                }
+                case CAPTURE_SET_SHADER_FRAMEBUFFER_TEXTURE:
+                {
+                    const std::string* shader_id = ReadString(reader);
+                    const std::string* uniform_name = ReadString(reader);
+                    uint32_t frame_buffer_index = Read<uint32_t>(reader);
+                    uint8_t texture_unit = Read<uint8_t>(reader);
+                    Graphics::SetShaderFramebufferTexture(*shader_id, *uniform_name, frame_buffer_index, texture_unit);
+                    break;
+                }
+                case CAPTURE_RENDER_SPRITE:
+                case CAPTURE_RENDER_SPRITE_INSTANCED:
+                {
+                    const Sprite& sprite = ReadSprite(reader);
+                    Vec3 position = ReadVec3(reader);
+                    Vec2 size = ReadVec2(reader);
+                    float angle_degrees = Read<float>(reader);
+                    Vec2 origin = ReadVec2(reader);
+                    uint32_t frame_buffer_index = Read<uint32_t>(reader);
+                    SpriteSheetLayer sprite_sheet_layer = (SpriteSheetLayer)Read<uint32_t>(reader);
+                    Vec4 colour = ReadVec4(reader);
+                    if(op == CAPTURE_RENDER_SPRITE) Graphics::RenderSprite(sprite, position, size, angle_degrees, origin, frame_buffer_index, sprite_sheet_layer, colour);
+                    else Graphics::RenderSpriteInstanced(sprite, position, size, angle_degrees, origin, frame_buffer_index, sprite_sheet_layer, colour);
+                    break;
+                }
+                case CAPTURE_RENDER_SPRITES:
+                {
+                    uint32_t frame_buffer_index = Read<uint32_t>(reader);
+                    thread_local std::vector<Graphics::SpriteDraw> sprite_draws;
+                    sprite_draws.resize(Read<uint32_t>(reader));
+                    for(size_t i = 0; i < sprite_draws.size(); ++i)
+                    {
+                        Graphics::SpriteDraw& sprite_draw = sprite_draws[i];
+                        sprite_draw.sprite = &ReadSprite(reader);
+                        sprite_draw.position = ReadVec3(reader);
+                        sprite_draw.size = ReadVec2(reader);
+                        sprite_draw.origin = ReadVec2(reader);
+                        sprite_draw.angle_degrees = Read<float>(reader);
+                        sprite_draw.colour = ReadVec4(reader);
+                        sprite_draw.sprite_sheet_layer = (SpriteSheetLayer)Read<uint32_t>(reader);
+                    }
+                    Graphics::RenderSprites(sprite_draws.data(), sprite_draws.size(), frame_buffer_index);
+                    break;
+                }
+                case CAPTURE_DRAW_LINE:
+                {
+                    Vec2 start = ReadVec2(reader);
+                    Vec2 end = ReadVec2(reader);
+                    uint32_t frame_buffer_index = Read<uint32_t>(reader);
+                    Graphics::DrawLine(start, end, frame_buffer_index, ReadVec4(reader));
+                    break;
+                }
+                case CAPTURE_DRAW_RECT:
+                case CAPTURE_FILL_RECT:
+                {
+                    float x = Read<float>(reader);
+                    float y = Read<float>(reader);
+                    float z = op == CAPTURE_FILL_RECT ? Read<float>(reader) : 0.0f;
+                    float w = Read<float>(reader);
+                    float h = Read<float>(reader);
+                    uint32_t frame_buffer_index = Read<uint32_t>(reader);
+                    Vec4 colour = ReadVec4(reader);
+                    if(op == CAPTURE_FILL_RECT) Graphics::FillRect(x, y, z, w, h, frame_buffer_index, colour);
+                    else Graphics::DrawRect(x, y, w, h, frame_buffer_index, colour);
+                    break;
+                }
+                case CAPTURE_DRAW_CIRCLE:
+                case CAPTURE_FILL_CIRCLE:
+                case CAPTURE_FILL_SMOOTH_CIRCLE:
+                {
+                    Vec2 pos = ReadVec2(reader);
+                    float radius = Read<float>(reader);
+                    uint32_t frame_buffer_index = Read<uint32_t>(reader);
+                    Vec4 colour = ReadVec4(reader);
+                    if(op == CAPTURE_DRAW_CIRCLE) Graphics::DrawCircle(pos, radius, frame_buffer_index, colour);
+                    else if(op == CAPTURE_FILL_CIRCLE) Graphics::FillCircle(pos, radius, frame_buffer_index, colour);
+                    else Graphics::FillSmoothCircle(pos, radius, frame_buffer_index, colour);
+                    break;
+                }
+                case CAPTURE_DRAW_ARC:
+                case CAPTURE_FILL_PIE:
+                {
+                    Vec2 pos = ReadVec2(reader);
+                    float radius = Read<float>(reader);
+                    float start_degrees = Read<float>(reader);
+                    float end_degrees = Read<float>(reader);
+                    uint32_t frame_buffer_index = Read<uint32_t>(reader);
+                    Vec4 colour = ReadVec4(reader);
+                    if(op == CAPTURE_DRAW_ARC) Graphics::DrawArc(pos, radius, start_degrees, end_degrees, frame_buffer_index, colour);
+                    else Graphics::FillPie(pos, radius, start_degrees, end_degrees, frame_buffer_index, colour);
+                    break;
+                }
+                case CAPTURE_DRAW_POLY:
+                case CAPTURE_FILL_CONVEX_POLY:
+                {
+                    const std::vector<Vec2>& points = ReadPoints(reader);
+                    uint32_t frame_buffer_index = Read<uint32_t>(reader);
+                    Vec4 colour = ReadVec4(reader);
+                    if(op == CAPTURE_DRAW_POLY) Graphics::DrawPoly(points, frame_buffer_index, colour);
+                    else Graphics::FillConvexPoly(points, frame_buffer_index, colour);
+                    break;
+                }
+                case CAPTURE_DRAW_LINE_STRIP:
+                {
+                    const std::vector<Vec2>& points = ReadPoints(reader);
+                    bool closed = Read<uint8_t>(reader);
+                    uint32_t frame_buffer_index = Read<uint32_t>(reader);
+                    Graphics::DrawLineStrip(points.data(), points.size(), closed, frame_buffer_index, ReadVec4(reader));
+                    break;
+                }
+                case CAPTURE_DRAW_POLYLINE:
+                {
+                    const std::vector<Vec2>& points = ReadPoints(reader);
+                    float width = Read<float>(reader);
+                    Graphics::LineJoin join = (Graphics::LineJoin)Read<uint32_t>(reader);
+                    Graphics::LineCap cap = (Graphics::LineCap)Read<uint32_t>(reader);
+                    bool closed = Read<uint8_t>(reader);
+                    uint32_t frame_buffer_index = Read<uint32_t>(reader);
+                    Graphics::DrawPolyline(points, width, join, cap, closed, frame_buffer_index, ReadVec4(reader));
+                    break;
+                }
+                case CAPTURE_DRAW_SMOOTH_CIRCLE:
+                {
+                    Vec2 pos = ReadVec2(reader);
+                    float radius = Read<float>(reader);
+                    float thickness = Read<float>(reader);
+                    uint32_t frame_buffer_index = Read<uint32_t>(reader);
+                    Graphics::DrawSmoothCircle(pos, radius, thickness, frame_buffer_index, ReadVec4(reader));
+                    break;
+                }
+                case CAPTURE_FILL_ROUNDED_RECT:
+                case CAPTURE_DRAW_ROUNDED_RECT:
+                {
+                    float x = Read<float>(reader);
+                    float y = Read<float>(reader);
+                    float w = Read<float>(reader);
+                    float h = Read<float>(reader);
+                    float corner_radius = Read<float>(reader);
+                    float thickness = op == CAPTURE_DRAW_ROUNDED_RECT ? Read<float>(reader) : 0.0f;
+                    uint32_t frame_buffer_index = Read<uint32_t>(reader);
+                    Vec4 colour = ReadVec4(reader);
+                    if(op == CAPTURE_FILL_ROUNDED_RECT) Graphics::FillRoundedRect(x, y, w, h, corner_radius, frame_buffer_index, colour);
+                    else Graphics::DrawRoundedRect(x, y, w, h, corner_radius, thickness, frame_buffer_index, colour);
+                    break;
+                }
+                case CAPTURE_DRAW_THICK_LINE:
+                {
+                    Vec2 start = ReadVec2(reader);
+                    Vec2 end = ReadVec2(reader);
+                    float thickness = Read<float>(reader);
+                    uint32_t frame_buffer_index = Read<uint32_t>(reader);
+                    Graphics::DrawThickLine(start, end, thickness, frame_buffer_index, ReadVec4(reader));
+                    break;
+                }
+                case CAPTURE_FILL_TRIANGLE:
+                {
+                    Vec2 a = ReadVec2(reader);
+                    Vec2 b = ReadVec2(reader);
+                    Vec2 c = ReadVec2(reader);
+                    uint32_t frame_buffer_index = Read<uint32_t>(reader);
+                    Graphics::FillTriangle(a, b, c, frame_buffer_index, ReadVec4(reader));
+                    break;
+                }
+                case CAPTURE_RESOLVE_FRAME_BUFFER:
+                {
+                    Graphics::ResolveMultiSampledFrameBuffer(Read<uint32_t>(reader));
+                    break;
+                }
+                case CAPTURE_RENDER_FRAME_BUFFER:
+                {
+                    uint32_t frame_buffer_index = Read<uint32_t>(reader);
+                    Graphics::RenderFrameBuffer(frame_buffer_index, ReadVec2(reader));
+                    break;
+                }
+                case CAPTURE_RENDER_FRAME_BUFFER_REGION:
+                {
+                    uint32_t frame_buffer_index = Read<uint32_t>(reader);
+                    float x = Read<float>(reader);
+                    float y = Read<float>(reader);
+                    float w = Read<float>(reader);
+                    float h = Read<float>(reader);
+                    Graphics::RenderFrameBuffer(frame_buffer_index, x, y, w, h);
+                    break;
+                }
+                case CAPTURE_RENDER_FRAME_BUFFER_TO_FRAME_BUFFER:
+                {
+                    uint32_t source_frame_buffer_index = Read<uint32_t>(reader);
+                    uint32_t dest_frame_buffer_index = Read<uint32_t>(reader);
+                    Graphics::RenderFrameBufferToFrameBuffer(source_frame_buffer_index, dest_frame_buffer_index);
+                    break;
+                }
+                case CAPTURE_RENDER_FRAME_BUFFER_TO_QUAD:
+                {
+                    uint32_t source_frame_buffer_index = Read<uint32_t>(reader);
+                    float x = Read<float>(reader);
+                    float y = Read<float>(reader);
+                    float w = Read<float>(reader);
+                    float h = Read<float>(reader);
+                    uint32_t dest_frame_buffer_index = Read<uint32_t>(reader);
+                    Graphics::RenderFrameBufferToQuad(source_frame_buffer_index, x, y, w, h, dest_frame_buffer_index, ReadVec4(reader));
+                    break;
+                }
+                case CAPTURE_BIND_FRAME_BUFFER:
+                {
+                    Graphics::BindFrameBuffer(Read<uint32_t>(reader));
+                    break;
+                }
+                case CAPTURE_ENABLE_BLENDING:
+                {
+                    Graphics::EnableBlending();
+                    break;
+                }
+                case CAPTURE_DISABLE_BLENDING:
+                {
+                    Graphics::DisableBlending();
+                    break;
+                }
+                case CAPTURE_SET_BLEND_FUNCTION:
+                {
+                    GLenum source_factor = Read<uint32_t>(reader);
+                    GLenum dest_factor = Read<uint32_t>(reader);
+                    Graphics::SetBlendFunction(source_factor, dest_factor);
+                    break;
+                }
+                case CAPTURE_SET_BLEND_FUNCTION_SEPERATE:
+                {
+                    GLenum source_factor_rgb = Read<uint32_t>(reader);
+                    GLenum dest_factor_rgb = Read<uint32_t>(reader);
+                    GLenum source_factor_alpha = Read<uint32_t>(reader);
+                    GLenum dest_factor_alpha = Read<uint32_t>(reader);
+                    Graphics::SetBlendFunctionSeperate(source_factor_rgb, dest_factor_rgb, source_factor_alpha, dest_factor_alpha);
+                    break;
+                }
+                case CAPTURE_ENABLE_DEPTH_TESTING:
+                {
+                    Graphics::EnableDepthTesting();
+                    break;
+                }
+                case CAPTURE_DISABLE_DEPTH_TESTING:
+                {
+                    Graphics::DisableDepthTesting();
+                    break;
+                }
+                case CAPTURE_ENABLE_SCISSOR_TESTING:
+                {
+                    Graphics::EnableScissorTesting();
+                    break;
+                }
+                case CAPTURE_DISABLE_SCISSOR_TESTING:
+                {
+                    Graphics::DisableScissorTesting();
+                    break;
+                }
+                case CAPTURE_SET_SCISSOR_REGION:
+                {
+                    int x = Read<int32_t>(reader);
+                    int y = Read<int32_t>(reader);
+                    int width = Read<int32_t>(reader);
+                    int height = Read<int32_t>(reader);
+                    Graphics::SetScissorRegion(x, y, width, height);
+                    break;
+                }
+                case CAPTURE_SET_FRAME_BUFFER_SCISSOR_REGION:
+                {
+                    uint32_t frame_buffer_index = Read<uint32_t>(reader);
+                    int x = Read<int32_t>(reader);
+                    int y = Read<int32_t>(reader);
+                    int width = Read<int32_t>(reader);
+                    int height = Read<int32_t>(reader);
+                    Graphics::SetScissorRegion(frame_buffer_index, x, y, width, height);
+                    break;
+                }
+                case CAPTURE_ENABLE_DEFERRED_BATCHING:
+                {
+                    Graphics::EnableDeferredBatching();
+                    break;
+                }
+                case CAPTURE_DISABLE_DEFERRED_BATCHING:
+                {
+                    Graphics::DisableDeferredBatching();
+                    break;
+                }
+                case CAPTURE_SET_DRAW_LAYER:
+                {
+                    Graphics::SetDrawLayer(Read<uint8_t>(reader));
+                    break;
+                }
+                case CAPTURE_SET_DRAW_LAYER_SORTED_BY_STATE:
+                {
+                    uint8_t layer = Read<uint8_t>(reader);
+                    bool sorted_by_state = Read<uint8_t>(reader);
+                    Graphics::SetDrawLayerSortedByState(layer, sorted_by_state);
+                    break;
+                }
+                case CAPTURE_RENDER_TEXT:
+                {
+                    const std::string* text = ReadString(reader);
+                    Vec2 position = ReadVec2(reader);
+                    const std::string* font_id = ReadString(reader);
+                    float size = Read<float>(reader);
+                    uint32_t frame_buffer_index = Read<uint32_t>(reader);
+                    Graphics::RenderText(*text, position, *font_id, size, frame_buffer_index, ReadVec4(reader));
+                    break;
+                }
+                case CAPTURE_CREATE_MATERIAL:
+                case CAPTURE_SET_MATERIAL:
+                {
+                    uint32_t material_index = op == CAPTURE_SET_MATERIAL ? Read<uint32_t>(reader) : 0;
+                    const std::vector<Vec4>& values = ReadValues(reader, ReadVec4);
+                    Graphics::Material material;
+                    for(size_t i = 0; i < values.size() && i < MATERIAL_VEC4_COUNT; ++i)
+                    {
+                        material.params[i] = values[i];
+                    }
+                    if(op == CAPTURE_CREATE_MATERIAL) Graphics::CreateMaterial(material);
+                    else Graphics::SetMaterial(material_index, material);
+                    break;
+                }
+                case CAPTURE_DELETE_MATERIAL:
+                {
+                    Graphics::DeleteMaterial(Read<uint32_t>(reader));
+                    break;
+                }
+                case CAPTURE_RENDER_SPRITE_MATERIAL:
+                {
+                    const Sprite& sprite = ReadSprite(reader);
+                    Vec3 position = ReadVec3(reader);
+                    Vec2 size = ReadVec2(reader);
+                    float angle_degrees = Read<float>(reader);
+                    Vec2 origin = ReadVec2(reader);
+                    uint32_t frame_buffer_index = Read<uint32_t>(reader);
+                    SpriteSheetLayer sprite_sheet_layer = (SpriteSheetLayer)Read<uint32_t>(reader);
+                    uint32_t material_index = Read<uint32_t>(reader);
+                    Vec4 colour = ReadVec4(reader);
+                    Graphics::RenderSprite(sprite, position, size, angle_degrees, origin, frame_buffer_index, sprite_sheet_layer, material_index, colour);
+                    break;
+                }
+                case CAPTURE_BUILD_ATLAS:
+                {
+                    TextureAtlas atlas;
+                    atlas.name = *ReadString(reader);
+                    atlas.page_size = Read<uint32_t>(reader);
+                    atlas.padding = Read<uint32_t>(reader);
+                    atlas.extrude = Read<uint32_t>(reader);
+                    atlas.allow_rotation = Read<uint8_t>(reader);
+                    atlas.filter_type = (Graphics::FilterType)Read<uint32_t>(reader);
+                    // ReadValues reuses its vector, so these are copied out one at a time
+                    atlas.sprite_sheets = ReadValues(reader, ReadStringValue);
+                    atlas.images = ReadValues(reader, ReadStringValue);
+                    atlas.image_sprite_ids = ReadValues(reader, ReadUint);
+                    atlas.fonts = ReadValues(reader, ReadStringValue);
+                    TextureAtlases::BuildAtlas(&atlas);
+                    break;
+                }
+                case CAPTURE_CREATE_SPRITE_SHEET_ARRAY:
+                {
+                    const std::string* name = ReadString(reader);
+                    std::vector<std::string> sprite_sheet_names = ReadValues(reader, ReadStringValue);
+                    Graphics::FilterType filter_type = (Graphics::FilterType)Read<uint32_t>(reader);
+                    Graphics::CreateSpriteSheetArray(*name, sprite_sheet_names, filter_type);
+                    break;
+                }
+                default:
+                {
+                    std::cout << "ERROR::CAPTURE: Unknown op " << (int)op << ", stopping replay of this stream" << std::endl;
+                    return;
+                }
+            }
+        }
+    }
+}
+
+Capture::Scope::Scope(const bool setup)
+{
+    if(!setup && !capturing) return;
+
+    entered = true;
+    if(scope_depth++ > 0) return;
+
+    if(setup)
+    {
+        recording = !replaying;
+        active_stream = &setup_stream;
+    }
+    else
+    {
+        // whatever is drawn into a static batch is baked, not drawn this frame
+        recording = std::this_thread::get_id() == capture_thread && !Graphics::draw_queue.static_batch_recording;
+        active_stream = &frame_stream;
+    }
+}
+
+Capture::Scope::~Scope()
+{
+    if(entered) scope_depth--;
+}
+
+void Capture::WriteValue(const uint8_t value)
+{
+    WriteBytes(&value, sizeof(value));
+}
+
+void Capture::WriteValue(const int value)
+{
+    int32_t v = value;
+    WriteBytes(&v, sizeof(v));
+}
+
+void Capture::WriteValue(const uint32_t value)
+{
+    WriteBytes(&value, sizeof(value));
+}
+
+void Capture::WriteValue(const float value)
+{
+    WriteBytes(&value, sizeof(value));
+}
+
+void Capture::WriteValue(const bool value)
+{
+    WriteValue((uint8_t)(value ? 1 : 0));
+}
+
+void Capture::WriteValue(const Vec2& value)
+{
+    WriteValue(value.x);
+    WriteValue(value.y);
+}
+
+void Capture::WriteValue(const Vec3& value)
+{
+    WriteValue(value.x);
+    WriteValue(value.y);
+    WriteValue(value.z);
+}
+
+void Capture::WriteValue(const Vec4& value)
+{
+    WriteValue(value.x);
+    WriteValue(value.y);
+    WriteValue(value.z);
+    WriteValue(value.w);
+}
+
+void Capture::WriteValue(const std::string& value)
+{
+    auto it = active_stream->strings.find(value);
+    if(it != active_stream->strings.end())
+    {
+        WriteValue(it->second);
+        return;
+    }
+
+    uint32_t index = active_stream->strings.size();
+    active_stream->strings[value] = index;
+    WriteValue(index | STRING_DEFINITION_BIT);
+    WriteValue((uint32_t)value.size());
+    WriteBytes(value.data(), value.size());
+}
+
+void Capture::WriteValue(const char* value)
+{
+    if(!value)
+    {
+        WriteValue(NULL_STRING);
+        return;
+    }
+
+    WriteValue(std::string(value));
+}
+
+void Capture::WriteValue(const Graphics::SpriteDraw& value)
+{
+    WriteValue(value.sprite->id);
+    WriteValue(value.position);
+    WriteValue(value.size);
+    WriteValue(value.origin);
+    WriteValue(value.angle_degrees);
+    WriteValue(value.colour);
+    WriteValue(value.sprite_sheet_layer);
+}
+
+std::string Capture::GetTextureName(const uint32_t texture_id)
+{
+    // textures are keyed by file name, this is only looked up while capturing
+    for(auto it = Graphics::textures.begin(); it != Graphics::textures.end(); ++it)
+    {
+        if(it->second.ID == texture_id) return it->first;
+    }
+
+    return "";
+}
+
+std::string Capture::GetSpriteSheetName(const SpriteSheet* sprite_sheet)
+{
+    for(auto it = Graphics::sprite_sheets.begin(); it != Graphics::sprite_sheets.end(); ++it)
+    {
+        if(it->second == sprite_sheet) return it->first;
+    }
+
+    return "";
+}
+
+void Capture::BeginCapture(const std::string& file_name, const uint32_t frame_count)
+{
+    if(capturing || frame_count == 0) return;
+
+    capture_file_name = file_name;
+    frames_remaining = frame_count;
+    capture_thread = std::this_thread::get_id();
+    captured_frames.clear();
+    frame_stream = CaptureStream();
+
+    capturing = true;
+}
+
+void Capture::EndCapture()
+{
+    if(!capturing) return;
+
+    capturing = false;
+
+    // a partly drawn frame is still worth keeping
+    if(!frame_stream.data.empty())
+    {
+        captured_frames.push_back({ Honeybear::game_scale, frame_stream.data });
+        frame_stream.data.clear();
+    }
+
+    SaveCapture(capture_file_name);
+}
+
+void Capture::EndFrame()
+{
+    if(!capturing || std::this_thread::get_id() != capture_thread) return;
+
+    // the game scale is the one the frame was drawn with
+    captured_frames.push_back({ Honeybear::game_scale, std::vector<uint8_t>() });
+    captured_frames.back().data.swap(frame_stream.data);
+
+    if(--frames_remaining == 0)
+    {
+        EndCapture();
+    }
+}
+
+bool Capture::SaveCapture(const std::string& file_name)
+{
+    std::ofstream file(file_name, std::ios::binary);
+    if(!file.is_open())
+    {
+        std::cout << "ERROR::CAPTURE: Failed to open capture file for writing: " << file_name << std::endl;
+        return false;
+    }
+
+    int window_width, window_height;
+    glfwGetWindowSize(Graphics::window, &window_width, &window_height);
+
+    uint32_t header[3] = { CAPTURE_FILE_VERSION, (uint32_t)window_width, (uint32_t)window_height };
+    file.write(CAPTURE_FILE_MAGIC, sizeof(CAPTURE_FILE_MAGIC));
+    file.write((const char*)header, sizeof(header));
+
+    uint32_t setup_size = setup_stream.data.size();
+    file.write((const char*)&setup_size, sizeof(setup_size));
+    file.write((const char*)setup_stream.data.data(), setup_size);
+
+    uint32_t frame_count = captured_frames.size();
+    file.write((const char*)&frame_count, sizeof(frame_count));
+    for(size_t i = 0; i < captured_frames.size(); ++i)
+    {
+        uint32_t frame_size = captured_frames[i].data.size();
+        file.write((const char*)&captured_frames[i].game_scale, sizeof(float));
+        file.write((const char*)&frame_size, sizeof(frame_size));
+        file.write((const char*)captured_frames[i].data.data(), frame_size);
+    }
+
+    return file.good();
+}
+
+bool Capture::LoadCapture(const std::string& file_name, CaptureFile& capture)
+{
+    std::ifstream file(file_name, std::ios::binary);
+    if(!file.is_open())
+    {
+        std::cout << "ERROR::CAPTURE: Failed to open capture file: " << file_name << std::endl;
+        return false;
+    }
+
+    char magic[4];
+    uint32_t header[3];
+    file.read(magic, sizeof(magic));
+    file.read((char*)header, sizeof(header));
+    if(!file || std::memcmp(magic, CAPTURE_FILE_MAGIC, sizeof(magic)) != 0 || header[0] != CAPTURE_FILE_VERSION)
+    {
+        std::cout << "ERROR::CAPTURE: Not a capture file (or the wrong version): " << file_name << std::endl;
+        return false;
+    }
+
+    capture.window_width = header[1];
+    capture.window_height = header[2];
+
+    uint32_t setup_size = 0;
+    file.read((char*)&setup_size, sizeof(setup_size));
+    capture.setup.resize(setup_size);
+    file.read((char*)capture.setup.data(), setup_size);
+
+    uint32_t frame_count = 0;
+    file.read((char*)&frame_count, sizeof(frame_count));
+    capture.frames.resize(frame_count);
+    for(uint32_t i = 0; i < frame_count && file; ++i)
+    {
+        uint32_t frame_size = 0;
+        file.read((char*)&capture.frames[i].game_scale, sizeof(float));
+        file.read((char*)&frame_size, sizeof(frame_size));
+        capture.frames[i].data.resize(frame_size);
+        file.read((char*)capture.frames[i].data.data(), frame_size);
+    }
+
+    capture.setup_strings.clear();
+    capture.frame_strings.clear();
+
+    if(!file)
+    {
+        std::cout << "ERROR::CAPTURE: Capture file is truncated: " << file_name << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+void Capture::ReplaySetup(CaptureFile& capture)
+{
+    replaying = true;
+    ReplayStream(capture.setup.data(), capture.setup.size(), capture.setup_strings);
+    replaying = false;
+}
+
+void Capture::ReplayFrame(CaptureFile& capture, const uint32_t frame_index)
+{
+    // strings are defined the first time they're used, so frame 0 has to be replayed before the others
+    CaptureFrame& frame = capture.frames[frame_index];
+    Honeybear::game_scale = frame.game_scale;
+    ReplayStream(frame.data.data(), frame.data.size(), capture.frame_strings);
+}
\ No newline at end of file
@@ -1,10 +1,14 @@
 #include <thread>
+#include <mutex>
+#include <condition_variable>
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <algorithm>
 #include "engine.h"
 #include "graphics.h"
 #include "input.h"
+#include "profiler.h"
+#include "capture.h"
 
 using namespace Honeybear;
 
@@ -29,6 +33,56 @@ namespace
 
     float fps_records[FPS_RECORD_COUNT];
     size_t fps_record_index = 0;
+
+    // frames are recorded into one draw list while the render thread submits the other
+    bool render_thread_enabled = false;
+    bool render_thread_stopping = false;
+    std::thread render_thread;
+    std::mutex render_mutex;
+    std::condition_variable render_condition;
+    Graphics::DrawList frame_draw_lists[2];
+    size_t recording_draw_list_index = 0;
+    Graphics::DrawList* submitted_draw_list = nullptr;
+    int submitted_window_width = 0;
+    int submitted_window_height = 0;
+
+    void RenderThreadMain(Graphics::Batch gl_batch, ShaderHandle shader)
+    {
+        // the batch and shader state are thread local, so take over the ones that were set up with the context
+        glfwMakeContextCurrent(Graphics::window);
+        Graphics::batch = gl_batch;
+        Graphics::activated_shader = shader;
+
+        while(true)
+        {
+            Graphics::DrawList* draw_list;
+            {
+                std::unique_lock<std::mutex> lock(render_mutex);
+                render_condition.wait(lock, []() { return submitted_draw_list != nullptr || render_thread_stopping; });
+                if(!submitted_draw_list) break;
+                draw_list = submitted_draw_list;
+
+                // the window size can only be read on the main thread, so it comes with the frame
+                Graphics::frame_window_width = submitted_window_width;
+                Graphics::frame_window_height = submitted_window_height;
+            }
+
+            Profiler::BeginGPUFrame();
+            Graphics::Clear();
+            Graphics::ClearFrameBuffers();
+            Graphics::SubmitDrawList(*draw_list);
+            Graphics::SwapBuffers();
+
+            // the list is free to record into again
+            {
+                std::lock_guard<std::mutex> lock(render_mutex);
+                submitted_draw_list = nullptr;
+            }
+            render_condition.notify_all();
+        }
+
+        glfwMakeContextCurrent(nullptr);
+    }
 }
 
 void Engine::Init(int window_width, int window_height, const std::string& window_title)
@@ -93,6 +147,8 @@ void Engine::Run()
         // -----------------------------
     }
 
+    StopRenderThread();
+    Graphics::SaveShaderCache();
     glfwTerminate();
 }
 
@@ -104,14 +160,73 @@ double Engine::Ticks()
 
 void Engine::Render()
 {
+    if(render_thread_enabled)
+    {
+        Graphics::DrawList* draw_list = &frame_draw_lists[recording_draw_list_index];
+
+        Graphics::BeginDrawList(draw_list);
+        draw_func();
+        Graphics::EndDrawList();
+        Capture::EndFrame();
+
+        // only one frame is ever queued, so wait for the render thread to finish the last one before handing this one over
+        {
+            std::unique_lock<std::mutex> lock(render_mutex);
+            render_condition.wait(lock, []() { return submitted_draw_list == nullptr; });
+            submitted_draw_list = draw_list;
+            submitted_window_width = Graphics::frame_window_width;
+            submitted_window_height = Graphics::frame_window_height;
+        }
+        render_condition.notify_all();
+
+        recording_draw_list_index = (recording_draw_list_index + 1) % 2;
+        return;
+    }
+
+    Profiler::BeginGPUFrame();
     Graphics::Clear();
     Graphics::ClearFrameBuffers();
 
     draw_func();
+    Capture::EndFrame();
 
     Graphics::SwapBuffers();
 }
 
+void Engine::EnableRenderThread()
+{
+    if(render_thread_enabled) return;
+
+    // draw anything already batched while this thread still has the context
+    Graphics::CheckAndStartNewBatch();
+    // pending programs are linked on this context, they can't be finished once the render thread owns it
+    Graphics::FinishShaderPrograms();
+    glfwMakeContextCurrent(nullptr);
+
+    render_thread_stopping = false;
+    render_thread = std::thread(RenderThreadMain, Graphics::batch, Graphics::activated_shader);
+    render_thread_enabled = true;
+
+    // this thread only records from now on, an empty batch has no gpu buffers to touch
+    Graphics::batch = Graphics::Batch();
+}
+
+void Engine::StopRenderThread()
+{
+    if(!render_thread_enabled) return;
+
+    // the render thread finishes whatever frame it was given before stopping
+    {
+        std::lock_guard<std::mutex> lock(render_mutex);
+        render_thread_stopping = true;
+    }
+    render_condition.notify_all();
+    render_thread.join();
+
+    render_thread_enabled = false;
+    glfwMakeContextCurrent(Graphics::window);
+}
+
 void Engine::Quit()
 {
     // todo: other stuff here
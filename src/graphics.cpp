@@ -1,10 +1,20 @@
 #include <map>
+#include <cstring>
+#include <algorithm>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <mutex>
 
 #include "graphics.h"
 #include "engine.h"
+#include "profiler.h"
+#include "capture.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define HONEYBEAR_SSE
+    #include <emmintrin.h>
+#endif
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
@@ -14,23 +24,41 @@
 
 using namespace Honeybear;
 
-std::unordered_map<std::string, uint32_t> Graphics::shaders;
+std::vector<Graphics::ShaderProgram> Graphics::shader_programs;
+std::unordered_map<std::string, uint32_t> Graphics::shader_indices;
 std::unordered_map<std::string, Texture> Graphics::textures;
+std::vector<Texture*> Graphics::texture_handles;
 std::map<uint8_t, uint32_t> Graphics::bound_textures;
 std::unordered_map<std::string, SpriteSheet*> Graphics::sprite_sheets;
+std::unordered_map<std::string, TextureArray> Graphics::texture_arrays;
 std::unordered_map<uint32_t, Sprite> Graphics::sprites;
 std::unordered_map<std::string, Graphics::MSDF_Font> Graphics::msdf_fonts;
+std::vector<Graphics::MSDF_Font*> Graphics::font_handles;
 std::vector<Graphics::FrameBuffer> Graphics::frame_buffers;
 uint32_t Graphics::current_frame_buffer_index;
-std::string Graphics::activated_shader_id;
+thread_local ShaderHandle Graphics::activated_shader;
+ShaderHandle Graphics::default_shader;
+ShaderHandle Graphics::msdf_font_shader;
+ShaderHandle Graphics::sprite_instanced_shader;
+ShaderHandle Graphics::shape_shader;
+ShaderHandle Graphics::shape_quad_shader;
 GLFWwindow* Graphics::window;
-Graphics::Batch Graphics::batch;
+thread_local int Graphics::frame_window_width = 0;
+thread_local int Graphics::frame_window_height = 0;
+thread_local Graphics::Batch Graphics::batch;
+thread_local Graphics::DrawQueue Graphics::draw_queue;
+std::vector<Graphics::StaticBatch> Graphics::static_batches;
 Graphics::ScreenRenderData Graphics::screen_render_data;
 Graphics::UniformBlocks Graphics::uniform_blocks;
+Graphics::MaterialBuffer Graphics::material_buffer;
 
 GLuint current_fbo = 0;
 Vec4 clear_colour(0.0f, 0.0f, 0.0f, 1.0f);
 
+GLint gl_major_version = 0;
+GLint gl_minor_version = 0;
+GLint max_texture_image_units = 16;
+
 std::map<uint8_t, GLenum> texture_units = 
 {
     { 0,  GL_TEXTURE0  },
@@ -43,26 +71,163 @@ std::map<uint8_t, GLenum> texture_units =
     { 7,  GL_TEXTURE7  },
     { 8,  GL_TEXTURE8  },
     { 9,  GL_TEXTURE9  },
-    { 10, GL_TEXTURE10 }
+    { 10, GL_TEXTURE10 },
+    { 11, GL_TEXTURE11 },
+    { 12, GL_TEXTURE12 },
+    { 13, GL_TEXTURE13 },
+    { 14, GL_TEXTURE14 },
+    { 15, GL_TEXTURE15 }
 };
 
 // todo: batching does more than just quads now, so rethink the following
 const int max_quad_count = 10000;
 const int max_vertex_count = max_quad_count * 4;
 const int max_index_count = max_quad_count * 6;
+const int region_vertex_count = max_vertex_count * BATCH_REGION_BATCHES;
+const int region_index_count = max_index_count * BATCH_REGION_BATCHES;
+
+namespace
+{
+    struct ShaderCacheEntry
+    {
+        GLenum format;
+        std::vector<uint8_t> binary;
+    };
+
+    const char SHADER_CACHE_MAGIC[4] = { 'H', 'B', 'S', 'C' };
+    const uint32_t SHADER_CACHE_VERSION = 1;
+
+    // glProgramBinary is 4.1, so there's no cache on mac
+    bool program_binaries_supported = false;
+    uint64_t driver_hash = 0;
+    std::unordered_map<uint64_t, ShaderCacheEntry> shader_cache;
+
+    // set when a program adds a binary, the file is written once by SaveShaderCache instead of per program
+    bool shader_cache_dirty = false;
+
+    std::mutex pending_context_calls_mutex;
+    std::vector<std::function<void()>> pending_context_calls;
+
+    typedef void (APIENTRY *MaxShaderCompilerThreadsFunction)(GLuint count);
+
+    // fnv-1a, it only has to tell sources apart. the terminator is hashed too so "ab" + "c" and "a" + "bc" differ
+    uint64_t HashString(const char* value, uint64_t hash = 14695981039346656037ull)
+    {
+        if(value == nullptr) value = "";
+        do
+        {
+            hash ^= (uint8_t)*value;
+            hash *= 1099511628211ull;
+        }
+        while(*value++ != '\0');
+        return hash;
+    }
+
+    void WriteShaderCache()
+    {
+        std::ofstream file(SHADER_CACHE_FILE_NAME, std::ios::binary | std::ios::trunc);
+        if(!file.is_open())
+        {
+            std::cout << "ERROR::SHADER_CACHE: Couldn't write " << SHADER_CACHE_FILE_NAME << std::endl;
+            return;
+        }
+
+        file.write(SHADER_CACHE_MAGIC, sizeof(SHADER_CACHE_MAGIC));
+        file.write((const char*)&SHADER_CACHE_VERSION, sizeof(SHADER_CACHE_VERSION));
+        for(auto it = shader_cache.begin(); it != shader_cache.end(); ++it)
+        {
+            uint32_t format = it->second.format;
+            uint32_t length = it->second.binary.size();
+            file.write((const char*)&it->first, sizeof(it->first));
+            file.write((const char*)&driver_hash, sizeof(driver_hash));
+            file.write((const char*)&format, sizeof(format));
+            file.write((const char*)&length, sizeof(length));
+            file.write((const char*)it->second.binary.data(), length);
+        }
+    }
+
+    void LoadShaderCache()
+    {
+        std::ifstream file(SHADER_CACHE_FILE_NAME, std::ios::binary);
+        if(!file.is_open()) return;
+
+        char magic[4];
+        uint32_t version = 0;
+        file.read(magic, sizeof(magic));
+        file.read((char*)&version, sizeof(version));
+        if(!file || std::memcmp(magic, SHADER_CACHE_MAGIC, sizeof(magic)) != 0 || version != SHADER_CACHE_VERSION) return;
+
+        while(true)
+        {
+            uint64_t key;
+            uint64_t entry_driver_hash;
+            uint32_t format;
+            uint32_t length;
+            file.read((char*)&key, sizeof(key));
+            file.read((char*)&entry_driver_hash, sizeof(entry_driver_hash));
+            file.read((char*)&format, sizeof(format));
+            file.read((char*)&length, sizeof(length));
+            if(!file) break;
+
+            ShaderCacheEntry entry;
+            entry.format = format;
+            entry.binary.resize(length);
+            file.read((char*)entry.binary.data(), length);
+            if(!file) break;
+
+            // programs from another driver would never load, they're dropped the next time the cache is saved
+            if(entry_driver_hash == driver_hash)
+            {
+                shader_cache[key] = std::move(entry);
+            }
+        }
+    }
 
-const char* default_vert_shader = "#version 330 core\nlayout (location = 0) in vec3 vertex;\nlayout (location = 1) in vec2 tex_coords;\nlayout (location = 2) in vec4 colour;\nlayout (std140) uniform Matrices\n{\nmat4 projection;\n};\nout vec2 TexCoords;\nout vec4 Colour;\nvoid main()\n{\nTexCoords = tex_coords;\nColour = colour;\ngl_Position = projection * vec4(vertex.xy, 0.0, 1.0);\n}";
-const char* default_frag_shader = "#version 330 core\nin vec2 TexCoords;\nin vec4 Colour;\nout vec4 FragColor;\nuniform sampler2D image;\nvoid main()\n{\nFragColor = texture(image, TexCoords) * vec4(Colour.rgb * Colour.a, Colour.a);\n}";
-const char* msdf_font_vert_shader = "#version 330 core\nlayout (location = 0) in vec3 vertex;\nlayout (location = 1) in vec2 tex_coords;\nlayout (location = 2) in vec4 colour;\nlayout (std140) uniform Matrices\n{\nmat4 projection;\n};\nout vec2 TexCoords;\nout vec4 Colour;\nout float DistanceFactor;\nvoid main()\n{\nTexCoords = tex_coords;\nColour = colour;\nDistanceFactor = vertex.z;\ngl_Position = projection * vec4(vertex.xy, 0.0, 1.0);\n}";
-const char* msdf_font_frag_shader = "#version 330 core\nin vec2 TexCoords;\nin vec4 Colour;\nin float DistanceFactor;\nout vec4 FragColor;\nuniform sampler2D image;\nfloat median(float r, float g, float b) {\nreturn max(min(r, g), min(max(r, g), b));\n}\nvoid main()\n{\nvec3 sample = texture(image, TexCoords).rgb;\nfloat sigDist = DistanceFactor*(median(sample.r, sample.g, sample.b) - 0.5);\nfloat opacity = clamp(sigDist + 0.5, 0.0, 1.0);\nopacity *= Colour.a;\nFragColor = vec4(Colour.rgb * opacity, opacity);\n}";
+    // how many 4 byte words one value of a uniform of this type takes up in the cache
+    uint32_t GetUniformComponents(const GLenum type)
+    {
+        switch(type)
+        {
+            case GL_FLOAT_VEC2: case GL_INT_VEC2: case GL_UNSIGNED_INT_VEC2: case GL_BOOL_VEC2:
+                return 2;
+            case GL_FLOAT_VEC3: case GL_INT_VEC3: case GL_UNSIGNED_INT_VEC3: case GL_BOOL_VEC3:
+                return 3;
+            case GL_FLOAT_VEC4: case GL_INT_VEC4: case GL_UNSIGNED_INT_VEC4: case GL_BOOL_VEC4: case GL_FLOAT_MAT2:
+                return 4;
+            case GL_FLOAT_MAT2x3: case GL_FLOAT_MAT3x2:
+                return 6;
+            case GL_FLOAT_MAT2x4: case GL_FLOAT_MAT4x2:
+                return 8;
+            case GL_FLOAT_MAT3:
+                return 9;
+            case GL_FLOAT_MAT3x4: case GL_FLOAT_MAT4x3:
+                return 12;
+            case GL_FLOAT_MAT4:
+                return 16;
+            default:
+                // scalars and samplers
+                return 1;
+        }
+    }
+}
 
-void Graphics::Init(uint32_t window_width, uint32_t window_height, const std::string& window_title)
+const char* default_vert_shader = "#version 330 core\nlayout (location = 0) in vec3 vertex;\nlayout (location = 1) in vec2 tex_coords;\nlayout (location = 2) in vec4 colour;\nlayout (location = 3) in uint packed_indices;\nlayout (std140) uniform Matrices\n{\nmat4 projection;\n};\nuniform vec2 translation;\nout vec2 TexCoords;\nout vec4 Colour;\nflat out int TextureSlot;\nflat out int MaterialIndex;\nflat out int TextureLayer;\nvoid main()\n{\nTexCoords = tex_coords;\nColour = colour;\nTextureSlot = int(packed_indices & 0xffu);\nTextureLayer = int((packed_indices >> 8) & 0xffu);\nMaterialIndex = int(packed_indices >> 16);\ngl_Position = projection * vec4(vertex.xy + translation, 0.0, 1.0);\n}";
+const char* default_frag_shader = "#version 330 core\nin vec2 TexCoords;\nin vec4 Colour;\nflat in int TextureSlot;\nflat in int TextureLayer;\nout vec4 FragColor;\nuniform sampler2D images[8];\nuniform sampler2DArray sprite_sheets;\nvec4 SampleImage(vec2 uv)\n{\nswitch(TextureSlot)\n{\ncase 1: return texture(images[1], uv);\ncase 2: return texture(images[2], uv);\ncase 3: return texture(images[3], uv);\ncase 4: return texture(images[4], uv);\ncase 5: return texture(images[5], uv);\ncase 6: return texture(images[6], uv);\ncase 7: return texture(images[7], uv);\ncase 8: return texture(sprite_sheets, vec3(uv, TextureLayer));\ndefault: return texture(images[0], uv);\n}\n}\nvoid main()\n{\nFragColor = SampleImage(TexCoords) * vec4(Colour.rgb * Colour.a, Colour.a);\n}";
+const char* msdf_font_vert_shader = "#version 330 core\nlayout (location = 0) in vec3 vertex;\nlayout (location = 1) in vec2 tex_coords;\nlayout (location = 2) in vec4 colour;\nlayout (location = 3) in uint packed_indices;\nlayout (location = 4) in float depth;\nlayout (std140) uniform Matrices\n{\nmat4 projection;\n};\nuniform vec2 translation;\nout vec2 TexCoords;\nout vec4 Colour;\nout float DistanceFactor;\nflat out int TextureSlot;\nvoid main()\n{\nTexCoords = tex_coords;\nColour = colour;\nDistanceFactor = depth;\nTextureSlot = int(packed_indices & 0xffu);\ngl_Position = projection * vec4(vertex.xy + translation, 0.0, 1.0);\n}";
+const char* msdf_font_frag_shader = "#version 330 core\nin vec2 TexCoords;\nin vec4 Colour;\nin float DistanceFactor;\nflat in int TextureSlot;\nout vec4 FragColor;\nuniform sampler2D images[8];\nvec4 SampleImage(vec2 uv)\n{\nswitch(TextureSlot)\n{\ncase 1: return texture(images[1], uv);\ncase 2: return texture(images[2], uv);\ncase 3: return texture(images[3], uv);\ncase 4: return texture(images[4], uv);\ncase 5: return texture(images[5], uv);\ncase 6: return texture(images[6], uv);\ncase 7: return texture(images[7], uv);\ndefault: return texture(images[0], uv);\n}\n}\nfloat median(float r, float g, float b) {\nreturn max(min(r, g), min(max(r, g), b));\n}\nvoid main()\n{\nvec3 sample = SampleImage(TexCoords).rgb;\nfloat sigDist = DistanceFactor*(median(sample.r, sample.g, sample.b) - 0.5);\nfloat opacity = clamp(sigDist + 0.5, 0.0, 1.0);\nopacity *= Colour.a;\nFragColor = vec4(Colour.rgb * opacity, opacity);\n}";
+const char* sprite_frag_shader = "#version 330 core\nin vec2 TexCoords;\nin vec4 Colour;\nflat in int TextureSlot;\nflat in int TextureLayer;\nout vec4 FragColor;\nuniform sampler2D images[8];\nuniform sampler2DArray sprite_sheets;\nvec4 SampleImage(vec2 uv)\n{\nswitch(TextureSlot)\n{\ncase 1: return texture(images[1], uv);\ncase 2: return texture(images[2], uv);\ncase 3: return texture(images[3], uv);\ncase 4: return texture(images[4], uv);\ncase 5: return texture(images[5], uv);\ncase 6: return texture(images[6], uv);\ncase 7: return texture(images[7], uv);\ncase 8: return texture(sprite_sheets, vec3(uv, TextureLayer));\ndefault: return texture(images[0], uv);\n}\n}\nvoid main()\n{\nvec4 sample = SampleImage(TexCoords);\nFragColor = vec4(sample.rgb * sample.a, sample.a) * vec4(Colour.rgb * Colour.a, Colour.a);\n}";
+const char* sprite_instanced_vert_shader = "#version 330 core\nlayout (location = 0) in vec3 position;\nlayout (location = 1) in vec2 size;\nlayout (location = 2) in vec2 origin;\nlayout (location = 3) in float angle;\nlayout (location = 4) in vec4 tex_rect;\nlayout (location = 5) in vec4 colour;\nlayout (location = 6) in float texture_slot;\nlayout (location = 7) in float texture_layer;\nlayout (std140) uniform Matrices\n{\nmat4 projection;\n};\nout vec2 TexCoords;\nout vec4 Colour;\nflat out int TextureSlot;\nflat out int TextureLayer;\nvoid main()\n{\nvec2 corner = vec2(float(gl_VertexID & 1), float(gl_VertexID >> 1));\nvec2 local = corner * size - origin;\nfloat c = cos(angle);\nfloat s = sin(angle);\nvec2 world = position.xy + vec2(local.x * c - local.y * s, local.x * s + local.y * c);\nTexCoords = tex_rect.xy + corner * tex_rect.zw;\nColour = colour;\nTextureSlot = int(texture_slot);\nTextureLayer = int(texture_layer);\ngl_Position = projection * vec4(world, 0.0, 1.0);\n}";
+const char* shape_vert_shader = "#version 330 core\nlayout (location = 0) in vec2 centre;\nlayout (location = 1) in vec2 half_size;\nlayout (location = 2) in float corner_radius;\nlayout (location = 3) in float thickness;\nlayout (location = 4) in float angle;\nlayout (location = 5) in vec4 colour;\nlayout (std140) uniform Matrices\n{\nmat4 projection;\n};\nout vec2 Local;\nflat out vec2 HalfSize;\nflat out float CornerRadius;\nflat out float Thickness;\nout vec4 Colour;\nvoid main()\n{\nvec2 corner = vec2(float(gl_VertexID & 1), float(gl_VertexID >> 1)) * 2.0 - 1.0;\nvec2 local = corner * (half_size + 1.0);\nfloat c = cos(angle);\nfloat s = sin(angle);\nvec2 world = centre + vec2(local.x * c - local.y * s, local.x * s + local.y * c);\nLocal = local;\nHalfSize = half_size;\nCornerRadius = corner_radius;\nThickness = thickness;\nColour = colour;\ngl_Position = projection * vec4(world, 0.0, 1.0);\n}";
+const char* shape_quad_vert_shader = "#version 330 core\nlayout (location = 0) in vec3 vertex;\nlayout (location = 1) in vec2 tex_coords;\nlayout (location = 2) in vec4 colour;\nlayout (location = 3) in uint packed_indices;\nlayout (std140) uniform Matrices\n{\nmat4 projection;\n};\nuniform vec2 translation;\nout vec2 Local;\nflat out vec2 HalfSize;\nflat out float CornerRadius;\nflat out float Thickness;\nout vec4 Colour;\nvoid main()\n{\nLocal = tex_coords;\nHalfSize = abs(tex_coords) - 1.0;\nCornerRadius = vertex.z;\nThickness = float(packed_indices >> 8) / 256.0;\nColour = colour;\ngl_Position = projection * vec4(vertex.xy + translation, 0.0, 1.0);\n}";
+const char* shape_frag_shader = "#version 330 core\nin vec2 Local;\nflat in vec2 HalfSize;\nflat in float CornerRadius;\nflat in float Thickness;\nin vec4 Colour;\nout vec4 FragColor;\nfloat RoundedBoxDistance(vec2 p, vec2 half_size, float radius)\n{\nvec2 q = abs(p) - half_size + radius;\nreturn length(max(q, 0.0)) + min(max(q.x, q.y), 0.0) - radius;\n}\nvoid main()\n{\nfloat distance = RoundedBoxDistance(Local, HalfSize, CornerRadius);\nif(Thickness > 0.0)\n{\ndistance = abs(distance + Thickness * 0.5) - Thickness * 0.5;\n}\nfloat coverage = clamp(0.5 - distance / max(fwidth(distance), 0.0001), 0.0, 1.0);\nfloat alpha = Colour.a * coverage;\nFragColor = vec4(Colour.rgb * alpha, alpha);\n}";
+
+void Graphics::Init(uint32_t window_width, uint32_t window_height, const std::string& window_title, const bool hidden)
 {
     // init glfw
     glfwInit();
 
     // platform specific window hints
-    #ifdef _WIN32
+    #if defined(_WIN32) || defined(__linux__)
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 4);
     #elif __APPLE__
@@ -75,14 +240,16 @@ void Graphics::Init(uint32_t window_width, uint32_t window_height, const std::st
     // common window hints
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
+    // a hidden window still gets a full context, for replaying captures and benchmarks without anything popping up
+    if(hidden)
+    {
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    }
+
     // create a new window
     window = glfwCreateWindow(window_width, window_height, window_title.c_str(), NULL, NULL);
     glfwSetWindowAttrib(window, GLFW_RESIZABLE, 0);
 
-    // center the window
-    const GLFWvidmode* mode = glfwGetVideoMode(glfwGetPrimaryMonitor());
-    glfwSetWindowPos(window, mode->width / 2 - window_width / 2, mode->height / 2 - window_height / 2);
-
     if(window == NULL)
     {
         std::cout << "Failed to create GLFW window" << std::endl;
@@ -90,6 +257,13 @@ void Graphics::Init(uint32_t window_width, uint32_t window_height, const std::st
         return;
     }
 
+    // center the window
+    if(!hidden)
+    {
+        const GLFWvidmode* mode = glfwGetVideoMode(glfwGetPrimaryMonitor());
+        glfwSetWindowPos(window, mode->width / 2 - window_width / 2, mode->height / 2 - window_height / 2);
+    }
+
     glfwMakeContextCurrent(window);
 
     if(!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
@@ -98,6 +272,12 @@ void Graphics::Init(uint32_t window_width, uint32_t window_height, const std::st
         return;
     }
 
+    glGetIntegerv(GL_MAJOR_VERSION, &gl_major_version);
+    glGetIntegerv(GL_MINOR_VERSION, &gl_minor_version);
+    glGetIntegerv(GL_MAX_TEXTURE_IMAGE_UNITS, &max_texture_image_units);
+
+    InitShaderCompiler();
+
     glViewport(0, 0, window_width, window_height);
 
     // enable default blending function
@@ -107,25 +287,36 @@ void Graphics::Init(uint32_t window_width, uint32_t window_height, const std::st
     // vsync
     glfwSwapInterval(0);
 
+    UpdateFrameWindowSize();
     InitScreenRenderData();
     InitBatchRenderer();
 
+    // the default shaders are created by Init on replay too, so they stay out of the setup log
+    Capture::Scope capture_scope(true);
+
     // create the default shader programs
-    CreateShaderProgram("default",   default_vert_shader, default_frag_shader);
+    default_shader =          CreateShaderProgram("default",   default_vert_shader, default_frag_shader);
     //LoadShader("default", "res/shaders/default.vert", "res/shaders/default.frag");
-    CreateShaderProgram("msdf_font", msdf_font_vert_shader, msdf_font_frag_shader);
+    msdf_font_shader =        CreateShaderProgram("msdf_font", msdf_font_vert_shader, msdf_font_frag_shader);
     //LoadShader("msdf_font", "res/shaders/msdf_font.vert", "res/shaders/msdf_font.frag");
+    sprite_instanced_shader = CreateShaderProgram("sprite_instanced", sprite_instanced_vert_shader, sprite_frag_shader);
+    //LoadShader("sprite_instanced", "res/shaders/sprite_instanced.vert", "res/shaders/sprite.frag");
+    shape_shader =            CreateShaderProgram("shape", shape_vert_shader, shape_frag_shader);
+    //LoadShader("shape", "res/shaders/shape.vert", "res/shaders/shape.frag");
+    shape_quad_shader =       CreateShaderProgram("shape_quad", shape_quad_vert_shader, shape_frag_shader);
+    //LoadShader("shape_quad", "res/shaders/shape_quad.vert", "res/shaders/shape.frag");
 
     InitUniformBlocks();
+    InitMaterialBuffer();
 
     // activate the default shader
-    ActivateShader("default");
+    ActivateShader(default_shader);
 }
 
 void Graphics::InitScreenRenderData()
 {
-    int window_width, window_height;
-    glfwGetWindowSize(window, &window_width, &window_height);
+    int window_width = frame_window_width;
+    int window_height = frame_window_height;
 
     screen_render_data.width = window_width;
     screen_render_data.height = window_height;
@@ -178,6 +369,10 @@ void Graphics::InitScreenRenderData()
     glEnableVertexAttribArray(2);
     glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const void*)offsetof(Vertex, colour));
 
+    // the screen and frame buffer quads leave the packed indices off, so they read the current value, which has to be a
+    // uint since that's what the shaders read. it's context state rather than part of a VAO, so setting it once covers them all
+    glVertexAttribI4ui(3, 0, 0, 0, 0);
+
     uint32_t indices[] = {
         0, 1, 3,
         1, 2, 3
@@ -193,8 +388,8 @@ void Graphics::InitScreenRenderData()
 
 void Graphics::UpdateScreenRenderData()
 {
-    int window_width, window_height;
-    glfwGetWindowSize(window, &window_width, &window_height);
+    int window_width = frame_window_width;
+    int window_height = frame_window_height;
 
     screen_render_data.width = window_width;
     screen_render_data.height = window_height;
@@ -234,8 +429,8 @@ void Graphics::UpdateScreenRenderData()
 
 void Graphics::UpdateScreenRenderData(const uint32_t frame_buffer_index, const float x, const float y, const float w, const float h)
 {
-    int window_width, window_height;
-    glfwGetWindowSize(window, &window_width, &window_height);
+    int window_width = frame_window_width;
+    int window_height = frame_window_height;
 
     screen_render_data.width = window_width;
     screen_render_data.height = window_height;
@@ -279,35 +474,175 @@ void Graphics::UpdateScreenRenderData(const uint32_t frame_buffer_index, const f
 
 void Graphics::InitBatchRenderer()
 {
+    // persistent mapping needs glBufferStorage (GL 4.4), otherwise fall back to orphaning the buffers every flush
+    bool supports_buffer_storage = gl_major_version > 4 || (gl_major_version == 4 && gl_minor_version >= 4);
+    batch.streaming_mode = supports_buffer_storage ? PERSISTENT_MAPPED : ORPHANING;
+
     // set up batch
-    batch.buffer = new Vertex[max_vertex_count];
-    batch.index_buffer = new uint32_t[max_index_count];
     batch.current_index_offset = 0;
     batch.index_count = 0;
+    batch.current_region = 0;
+    batch.region_vertex_cursor = 0;
+    batch.region_index_cursor = 0;
 
     glGenVertexArrays(1, &batch.VAO);
     glBindVertexArray(batch.VAO);
 
     glGenBuffers(1, &batch.VBO);
     glBindBuffer(GL_ARRAY_BUFFER, batch.VBO);
-    glBufferData(GL_ARRAY_BUFFER, max_vertex_count * sizeof(Vertex), nullptr, GL_STREAM_DRAW);
+
+    // set up index element buffer
+    glGenBuffers(1, &batch.IB);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, batch.IB);
+
+    if(batch.streaming_mode == PERSISTENT_MAPPED)
+    {
+        // one big buffer split into a fenced region per frame in flight
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        GLsizeiptr vertex_buffer_size = BATCH_FRAMES_IN_FLIGHT * region_vertex_count * sizeof(BatchVertex);
+        GLsizeiptr index_buffer_size = BATCH_FRAMES_IN_FLIGHT * region_index_count * sizeof(uint32_t);
+
+        glBufferStorage(GL_ARRAY_BUFFER, vertex_buffer_size, nullptr, flags);
+        batch.mapped_buffer = (BatchVertex*)glMapBufferRange(GL_ARRAY_BUFFER, 0, vertex_buffer_size, flags);
+
+        glBufferStorage(GL_ELEMENT_ARRAY_BUFFER, index_buffer_size, nullptr, flags);
+        batch.mapped_index_buffer = (uint32_t*)glMapBufferRange(GL_ELEMENT_ARRAY_BUFFER, 0, index_buffer_size, flags);
+
+        // the write position in the current region is pointed at in BeginBatch
+        batch.buffer = batch.mapped_buffer;
+        batch.index_buffer = batch.mapped_index_buffer;
+    }
+    else
+    {
+        batch.staging_buffer = new BatchVertex[max_vertex_count];
+        batch.staging_index_buffer = new uint32_t[max_index_count];
+        batch.buffer = batch.staging_buffer;
+        batch.index_buffer = batch.staging_index_buffer;
+
+        glBufferData(GL_ARRAY_BUFFER, max_vertex_count * sizeof(BatchVertex), nullptr, GL_STREAM_DRAW);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, max_index_count * sizeof(uint32_t), nullptr, GL_STREAM_DRAW);
+    }
+
+    SetBatchVertexAttributes();
+
+    // every quad uses the same 0-1-3 / 1-2-3 pattern, so quad only batches can all share one prebuilt 16 bit index buffer
+    static_assert(max_vertex_count <= 65536, "quad indices are 16 bit");
+    std::vector<uint16_t> quad_indices(max_index_count);
+    for(int i = 0; i < max_quad_count; ++i)
+    {
+        uint16_t offset = i * 4;
+        quad_indices[i * 6 + 0] = offset + 0;
+        quad_indices[i * 6 + 1] = offset + 1;
+        quad_indices[i * 6 + 2] = offset + 3;
+        quad_indices[i * 6 + 3] = offset + 1;
+        quad_indices[i * 6 + 4] = offset + 2;
+        quad_indices[i * 6 + 5] = offset + 3;
+    }
+
+    glGenVertexArrays(1, &batch.quad_VAO);
+    glBindVertexArray(batch.quad_VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, batch.VBO);
+    SetBatchVertexAttributes();
+
+    glGenBuffers(1, &batch.quad_IB);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, batch.quad_IB);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, max_index_count * sizeof(uint16_t), quad_indices.data(), GL_STATIC_DRAW);
+
+    batch.texture_slot_count = 0;
+    batch.max_texture_slots = 1;
+    batch.current_texture_slot = 0;
+
+    // set up the instanced sprite buffer, every attribute advances once per instance and the quad corners come from gl_VertexID
+    batch.instance_buffer = new SpriteInstance[max_quad_count];
+    batch.instance_count = 0;
+
+    glGenVertexArrays(1, &batch.instance_VAO);
+    glBindVertexArray(batch.instance_VAO);
+
+    glGenBuffers(1, &batch.instance_VBO);
+    glBindBuffer(GL_ARRAY_BUFFER, batch.instance_VBO);
+    glBufferData(GL_ARRAY_BUFFER, max_quad_count * sizeof(SpriteInstance), nullptr, GL_STREAM_DRAW);
 
     // position
     glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const void*)offsetof(Vertex, position));
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(SpriteInstance), (const void*)offsetof(SpriteInstance, position));
+    glVertexAttribDivisor(0, 1);
 
-    // tex coords
+    // size
     glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const void*)offsetof(Vertex, tex_coords));
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(SpriteInstance), (const void*)offsetof(SpriteInstance, size));
+    glVertexAttribDivisor(1, 1);
+
+    // origin
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(SpriteInstance), (const void*)offsetof(SpriteInstance, origin));
+    glVertexAttribDivisor(2, 1);
+
+    // angle
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, sizeof(SpriteInstance), (const void*)offsetof(SpriteInstance, angle_radians));
+    glVertexAttribDivisor(3, 1);
+
+    // tex rect
+    glEnableVertexAttribArray(4);
+    glVertexAttribPointer(4, 4, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(SpriteInstance), (const void*)offsetof(SpriteInstance, tex_rect));
+    glVertexAttribDivisor(4, 1);
 
     // colour
+    glEnableVertexAttribArray(5);
+    glVertexAttribPointer(5, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(SpriteInstance), (const void*)offsetof(SpriteInstance, colour));
+    glVertexAttribDivisor(5, 1);
+
+    // texture slot
+    glEnableVertexAttribArray(6);
+    glVertexAttribPointer(6, 1, GL_FLOAT, GL_FALSE, sizeof(SpriteInstance), (const void*)offsetof(SpriteInstance, texture_slot));
+    glVertexAttribDivisor(6, 1);
+
+    // texture layer
+    glEnableVertexAttribArray(7);
+    glVertexAttribPointer(7, 1, GL_FLOAT, GL_FALSE, sizeof(SpriteInstance), (const void*)offsetof(SpriteInstance, texture_layer));
+    glVertexAttribDivisor(7, 1);
+
+    // set up the sdf shape buffer, like the instanced sprites each shape is one instance of a 4 vertex strip
+    batch.shape_buffer = new ShapeInstance[max_quad_count];
+    batch.shape_count = 0;
+
+    glGenVertexArrays(1, &batch.shape_VAO);
+    glBindVertexArray(batch.shape_VAO);
+
+    glGenBuffers(1, &batch.shape_VBO);
+    glBindBuffer(GL_ARRAY_BUFFER, batch.shape_VBO);
+    glBufferData(GL_ARRAY_BUFFER, max_quad_count * sizeof(ShapeInstance), nullptr, GL_STREAM_DRAW);
+
+    // centre
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(ShapeInstance), (const void*)offsetof(ShapeInstance, centre));
+    glVertexAttribDivisor(0, 1);
+
+    // half size
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(ShapeInstance), (const void*)offsetof(ShapeInstance, half_size));
+    glVertexAttribDivisor(1, 1);
+
+    // corner radius
     glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const void*)offsetof(Vertex, colour));
+    glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, sizeof(ShapeInstance), (const void*)offsetof(ShapeInstance, corner_radius));
+    glVertexAttribDivisor(2, 1);
 
-    // set up index element buffer
-    glGenBuffers(1, &batch.IB);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, batch.IB);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, max_index_count * sizeof(uint32_t), nullptr, GL_STREAM_DRAW);
+    // thickness
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, sizeof(ShapeInstance), (const void*)offsetof(ShapeInstance, thickness));
+    glVertexAttribDivisor(3, 1);
+
+    // angle
+    glEnableVertexAttribArray(4);
+    glVertexAttribPointer(4, 1, GL_FLOAT, GL_FALSE, sizeof(ShapeInstance), (const void*)offsetof(ShapeInstance, angle_radians));
+    glVertexAttribDivisor(4, 1);
+
+    // colour
+    glEnableVertexAttribArray(5);
+    glVertexAttribPointer(5, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(ShapeInstance), (const void*)offsetof(ShapeInstance, colour));
+    glVertexAttribDivisor(5, 1);
 
     // set up the dummy shape texture (it's just a 1x1 pixel white image)
     glGenTextures(1, &batch.shape_texture);
@@ -327,8 +662,55 @@ void Graphics::InitBatchRenderer()
     BeginBatch();
 }
 
+void Graphics::SetBatchVertexAttributes()
+{
+    // expects the batch VBO and the VAO being set up to be bound
+    #ifdef HONEYBEAR_PACKED_VERTICES
+    static_assert(sizeof(PackedVertex) == 24, "the packed vertex layout changed, update its comment in graphics.h");
+
+    // position
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(BatchVertex), (const void*)offsetof(BatchVertex, position));
+
+    // tex coords
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 2, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(BatchVertex), (const void*)offsetof(BatchVertex, tex_coords));
+
+    // colour
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(BatchVertex), (const void*)offsetof(BatchVertex, colour));
+
+    // z / distance factor
+    glEnableVertexAttribArray(4);
+    glVertexAttribPointer(4, 1, GL_HALF_FLOAT, GL_FALSE, sizeof(BatchVertex), (const void*)offsetof(BatchVertex, z));
+    #else
+    // position
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(BatchVertex), (const void*)offsetof(BatchVertex, position));
+
+    // tex coords
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(BatchVertex), (const void*)offsetof(BatchVertex, tex_coords));
+
+    // colour
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(BatchVertex), (const void*)offsetof(BatchVertex, colour));
+
+    // z / distance factor, the same float as position.z so the shaders don't care which layout is in use
+    glEnableVertexAttribArray(4);
+    glVertexAttribPointer(4, 1, GL_FLOAT, GL_FALSE, sizeof(BatchVertex), (const void*)(offsetof(BatchVertex, position) + offsetof(Vec3, z)));
+    #endif
+
+    // texture slot, texture layer and material index, read as a uint by the shaders in either layout
+    static_assert(MAX_TEXTURE_ARRAY_LAYERS <= 0xff && MAX_MATERIALS <= 0x10000, "the texture layer or material index no longer fits in the packed vertex indices");
+    glEnableVertexAttribArray(3);
+    glVertexAttribIPointer(3, 1, GL_UNSIGNED_INT, sizeof(BatchVertex), (const void*)offsetof(BatchVertex, packed_indices));
+}
+
 void Graphics::SetClearColour(const Vec4& colour)
 {
+    Capture::Scope capture_scope(true);
+    if(capture_scope.recording) Capture::Record(CAPTURE_SET_CLEAR_COLOUR, colour);
     clear_colour = colour;
     // pre-multiply alpha
     clear_colour.x *= colour.w;
@@ -338,6 +720,8 @@ void Graphics::SetClearColour(const Vec4& colour)
 
 void Graphics::SetClearColour(const uint32_t frame_buffer_index, const Vec4& colour)
 {
+    Capture::Scope capture_scope(true);
+    if(capture_scope.recording) Capture::Record(CAPTURE_SET_FRAME_BUFFER_CLEAR_COLOUR, frame_buffer_index, colour);
     FrameBuffer* frame_buffer = &frame_buffers[frame_buffer_index];
     frame_buffer->clear_colour = colour;
     // pre-multiply alpha
@@ -348,12 +732,14 @@ void Graphics::SetClearColour(const uint32_t frame_buffer_index, const Vec4& col
 
 void Graphics::Clear()
 {
+    if(RecordDrawListCall([=]() { Clear(); })) return;
     glClearColor(clear_colour.x, clear_colour.y, clear_colour.z, clear_colour.w);
     glClear(GL_COLOR_BUFFER_BIT);
 }
 
 void Graphics::ClearFrameBuffers()
 {
+    if(RecordDrawListCall([=]() { ClearFrameBuffers(); })) return;
     for(size_t i = 0; i < frame_buffers.size(); ++i)
     {
         FrameBuffer* frame_buffer = &frame_buffers[i];
@@ -375,11 +761,20 @@ void Graphics::ClearFrameBuffers()
 
 void Graphics::SwapBuffers()
 {
+    // the queued calls replayed from here were already captured when they were made
+    Capture::Scope capture_scope;
+    // anything still sitting in the deferred queue belongs to this frame
+    FlushDrawQueue();
+    EndBatchFrame();
+    Profiler::EndGPUFrame();
+    Profiler::EndBatchBreakFrame();
     glfwSwapBuffers(window);
 }
 
-void Graphics::LoadShader(const std::string& shader_id, const char* vertex_file_name, const char* fragment_file_name)
+ShaderHandle Graphics::LoadShader(const std::string& shader_id, const char* vertex_file_name, const char* fragment_file_name)
 {
+    Capture::Scope capture_scope(true);
+    if(capture_scope.recording) Capture::Record(CAPTURE_LOAD_SHADER, shader_id, vertex_file_name, fragment_file_name);
     std::string vertex_code_str;
     std::string fragment_code_str;
     const char* vertex_code;
@@ -421,211 +816,824 @@ void Graphics::LoadShader(const std::string& shader_id, const char* vertex_file_
         fragment_code = fragment_code_str.c_str();
     }
 
-    CreateShaderProgram(shader_id, vertex_code, fragment_code);
+    return CreateShaderProgram(shader_id, vertex_code, fragment_code);
 }
 
-void Graphics::CreateShaderProgram(const std::string& shader_id, const char* vertex_code, const char* fragment_code)
+ShaderHandle Graphics::CreateShaderProgram(const std::string& shader_id, const char* vertex_code, const char* fragment_code)
 {
-    int success;
-    char infoLog[512];
+    Capture::Scope capture_scope(true);
+    if(capture_scope.recording) Capture::Record(CAPTURE_CREATE_SHADER_PROGRAM, shader_id, vertex_code, fragment_code);
 
-    // vertex shader compile and check
-    GLuint vertex_shader_id = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertex_shader_id, 1, &vertex_code, NULL);
-    glCompileShader(vertex_shader_id);
-
-    glGetShaderiv(vertex_shader_id, GL_COMPILE_STATUS, &success);
-    if(!success)
+    // a shader created again under the same id keeps its index, so handles to it stay valid
+    ShaderHandle shader;
+    auto it = shader_indices.find(shader_id);
+    if(it == shader_indices.end())
+    {
+        shader.index = shader_programs.size();
+        shader_indices[shader_id] = shader.index;
+        shader_programs.push_back(ShaderProgram());
+        shader_programs[shader.index].shader_id = shader_id;
+    }
+    else
     {
-        glGetShaderInfoLog(vertex_shader_id, 512, NULL, infoLog);
-        std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
+        shader.index = it->second;
     }
 
-    // fragment shader compile and check
-    GLuint fragment_shader_id = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragment_shader_id, 1, &fragment_code, NULL);
-    glCompileShader(fragment_shader_id);
+    ShaderProgram& program = shader_programs[shader.index];
 
-    glGetShaderiv(fragment_shader_id, GL_COMPILE_STATUS, &success);
-    if(!success)
+    // replaced before it was ever used, so its results aren't needed
+    if(program.pending)
     {
-        glGetShaderInfoLog(fragment_shader_id, 512, NULL, infoLog);
-        std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
+        glDeleteShader(program.vertex_shader);
+        glDeleteShader(program.fragment_shader);
     }
 
-    // shader program link and check
     GLuint program_id = glCreateProgram();
-    glAttachShader(program_id, vertex_shader_id);
-    glAttachShader(program_id, fragment_shader_id);
-    glLinkProgram(program_id);
+    program.program = program_id;
+    program.pending = true;
+    program.vertex_shader = 0;
+    program.fragment_shader = 0;
+    program.cache_key = HashString(fragment_code, HashString(vertex_code, driver_hash));
+
+    // a warm start loads the linked program from the cache and compiles nothing
+    if(program_binaries_supported)
+    {
+        auto cached = shader_cache.find(program.cache_key);
+        if(cached != shader_cache.end())
+        {
+            const ShaderCacheEntry& entry = cached->second;
+            glProgramBinary(program_id, entry.format, entry.binary.data(), entry.binary.size());
+
+            GLint success;
+            glGetProgramiv(program_id, GL_LINK_STATUS, &success);
+            if(success) return shader;
+
+            // the driver can turn a binary down even with the same version string, so compile it after all
+            shader_cache.erase(cached);
+        }
+    }
+
+    // the compile and link are only started here and checked by FinishShaderProgram when the shader is first used,
+    // so every shader created before then compiles at the same time (on the driver's threads if it has them)
+    program.vertex_shader = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(program.vertex_shader, 1, &vertex_code, NULL);
+    glCompileShader(program.vertex_shader);
 
-    glGetProgramiv(program_id, GL_LINK_STATUS, &success);
-    if(!success)
+    program.fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(program.fragment_shader, 1, &fragment_code, NULL);
+    glCompileShader(program.fragment_shader);
+
+    glAttachShader(program_id, program.vertex_shader);
+    glAttachShader(program_id, program.fragment_shader);
+    if(program_binaries_supported)
     {
-        glGetProgramInfoLog(program_id, 512, NULL, infoLog);
-        std::cout << "ERROR::SHADER_PROGRAM::LINK_FAILED\n" << infoLog << std::endl;
+        glProgramParameteri(program_id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
     }
+    glLinkProgram(program_id);
+
+    return shader;
+}
+
+void Graphics::FinishShaderProgram(ShaderProgram& program)
+{
+    program.pending = false;
+    GLuint program_id = program.program;
+
+    // compiled from source rather than loaded from the cache
+    if(program.vertex_shader != 0)
+    {
+        int success;
+        char infoLog[512];
+
+        // these wait for the compile and link to finish
+        glGetShaderiv(program.vertex_shader, GL_COMPILE_STATUS, &success);
+        if(!success)
+        {
+            glGetShaderInfoLog(program.vertex_shader, 512, NULL, infoLog);
+            std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED (" << program.shader_id << ")\n" << infoLog << std::endl;
+        }
+
+        glGetShaderiv(program.fragment_shader, GL_COMPILE_STATUS, &success);
+        if(!success)
+        {
+            glGetShaderInfoLog(program.fragment_shader, 512, NULL, infoLog);
+            std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED (" << program.shader_id << ")\n" << infoLog << std::endl;
+        }
+
+        glGetProgramiv(program_id, GL_LINK_STATUS, &success);
+        if(!success)
+        {
+            glGetProgramInfoLog(program_id, 512, NULL, infoLog);
+            std::cout << "ERROR::SHADER_PROGRAM::LINK_FAILED (" << program.shader_id << ")\n" << infoLog << std::endl;
+        }
+        else if(program_binaries_supported)
+        {
+            GLint length = 0;
+            glGetProgramiv(program_id, GL_PROGRAM_BINARY_LENGTH, &length);
+            if(length > 0)
+            {
+                ShaderCacheEntry& entry = shader_cache[program.cache_key];
+                entry.binary.resize(length);
+                glGetProgramBinary(program_id, length, NULL, &entry.format, entry.binary.data());
+                shader_cache_dirty = true;
+            }
+        }
 
-    glDeleteShader(vertex_shader_id);
-    glDeleteShader(fragment_shader_id);
+        glDeleteShader(program.vertex_shader);
+        glDeleteShader(program.fragment_shader);
+        program.vertex_shader = 0;
+        program.fragment_shader = 0;
+    }
 
-    shaders[shader_id] = program_id;
+    LoadShaderUniforms(program);
 
     // bind Matrices uniform block to this shader
     GLuint uniform_block_index = glGetUniformBlockIndex(program_id, "Matrices");
     glUniformBlockBinding(program_id, uniform_block_index, 0);
-}
 
-void Graphics::InitUniformBlocks()
-{
-    glGenBuffers(1, &uniform_blocks.matrices);
-    glBindBuffer(GL_UNIFORM_BUFFER, uniform_blocks.matrices);
-    glBufferData(GL_UNIFORM_BUFFER, sizeof(float) * 16, NULL, GL_STATIC_DRAW);
-    glBindBuffer(GL_UNIFORM_BUFFER, 0);
-    glBindBufferRange(GL_UNIFORM_BUFFER, 0, uniform_blocks.matrices, 0, sizeof(float) * 16);
+    // the program that's bound could be one that's still pending, that's fine to go back to
+    GLuint bound_program = activated_shader.index == INVALID_HANDLE ? 0 : shader_programs[activated_shader.index].program;
+
+    // shaders that sample from "images[]" can take a texture per batch slot, everything else only gets unit 0
+    uint8_t texture_slots = 1;
+    GLint images_location = glGetUniformLocation(program_id, "images");
+    if(images_location != -1)
+    {
+        texture_slots = std::min(BATCH_MAX_TEXTURE_SLOTS, (int)max_texture_image_units);
+
+        GLint units[BATCH_MAX_TEXTURE_SLOTS];
+        for(int i = 0; i < BATCH_MAX_TEXTURE_SLOTS; ++i)
+        {
+            units[i] = i;
+        }
+
+        glUseProgram(program_id);
+        glUniform1iv(images_location, texture_slots, units);
+        glUseProgram(bound_program);
+    }
+    program.texture_slots = texture_slots;
+
+    // shaders that read materials always find them on the same unit
+    GLint materials_location = glGetUniformLocation(program_id, "materials");
+    if(materials_location != -1)
+    {
+        glUseProgram(program_id);
+        glUniform1i(materials_location, MATERIAL_TEXTURE_UNIT);
+        glUseProgram(bound_program);
+    }
+
+    // same for sprite sheet arrays, left on unit 0 it would clash with images[0]
+    GLint sprite_sheets_location = glGetUniformLocation(program_id, "sprite_sheets");
+    if(sprite_sheets_location != -1)
+    {
+        glUseProgram(program_id);
+        glUniform1i(sprite_sheets_location, TEXTURE_ARRAY_UNIT);
+        glUseProgram(bound_program);
+    }
 }
 
-void Graphics::ActivateShader(const std::string& shader_id)
+void Graphics::FinishShaderPrograms()
 {
-    if(shader_id == activated_shader_id)
+    for(size_t i = 0; i < shader_programs.size(); ++i)
     {
-        return;
+        if(shader_programs[i].pending) FinishShaderProgram(shader_programs[i]);
     }
+    SaveShaderCache();
+}
 
-    CheckAndStartNewBatch();
-
-    glUseProgram(shaders[shader_id]);
-    activated_shader_id = shader_id;
+void Graphics::SaveShaderCache()
+{
+    if(!shader_cache_dirty) return;
+    WriteShaderCache();
+    shader_cache_dirty = false;
 }
 
-void Graphics::DeactivateShader()
+Graphics::ShaderProgram& Graphics::GetShaderProgram(const ShaderHandle shader)
 {
-    // when we deactivate a shader, activate the default one
-    ActivateShader("default");
+    ShaderProgram& program = shader_programs[shader.index];
+    if(program.pending) FinishShaderProgram(program);
+    return program;
 }
 
-void Graphics::CheckAndStartNewBatch()
+void Graphics::InitShaderCompiler()
 {
-    if(batch.index_count > 0)
+    // the driver is part of every cache key, a binary from any other driver (or version of it) won't load
+    driver_hash = HashString((const char*)glGetString(GL_VENDOR));
+    driver_hash = HashString((const char*)glGetString(GL_RENDERER), driver_hash);
+    driver_hash = HashString((const char*)glGetString(GL_VERSION), driver_hash);
+
+    GLint binary_format_count = 0;
+    bool supports_program_binaries = gl_major_version > 4 || (gl_major_version == 4 && gl_minor_version >= 1);
+    if(supports_program_binaries) glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &binary_format_count);
+    program_binaries_supported = binary_format_count > 0;
+    if(program_binaries_supported) LoadShaderCache();
+
+    // let the driver compile on as many threads as it likes, the function is looked up by hand as it's an extension
+    GLint extension_count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &extension_count);
+    for(GLint i = 0; i < extension_count; ++i)
     {
-        EndBatch();
-        FlushBatch();
-        BeginBatch();
+        const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+        if(std::strcmp(extension, "GL_KHR_parallel_shader_compile") == 0)
+        {
+            MaxShaderCompilerThreadsFunction max_shader_compiler_threads = (MaxShaderCompilerThreadsFunction)glfwGetProcAddress("glMaxShaderCompilerThreadsKHR");
+            if(max_shader_compiler_threads) max_shader_compiler_threads(0xffffffff);
+            break;
+        }
     }
 }
 
-void Graphics::SetShaderProjection(const std::string& shader_id, const float left, const float right, const float bottom, const float top, const float z_near, const float z_far)
+ShaderHandle Graphics::GetShaderHandle(const std::string& shader_id)
 {
-    //CheckAndStartNewBatch();
-
-    GLfloat matrix[] = {
-        1.0f, 0.0f, 0.0f, 0.0f,
-        0.0f, 1.0f, 0.0f, 0.0f,
-        0.0f, 0.0f, 1.0f, 0.0f,
-        0.0f, 0.0f, 0.0f, 1.0f,
-    };
-
-    matrix[0] = 2.0f / (right - left);
-    matrix[5] = 2.0f / (top - bottom);
-    matrix[10] = - 2.0f / (z_far - z_near);
-    matrix[12] = - (right + left) / (right - left);
-    matrix[13] = - (top + bottom) / (top - bottom);
-    matrix[14] = - (z_far + z_near) / (z_far - z_near);
+    ShaderHandle shader;
+    auto it = shader_indices.find(shader_id);
+    if(it != shader_indices.end()) shader.index = it->second;
+    return shader;
+}
 
-    // uint32_t program_ID = shaders[shader_id];
-    // glUniformMatrix4fv(glGetUniformLocation(program_ID, "projection"), 1, GL_FALSE, matrix);
+void Graphics::InitUniformBlocks()
+{
+    glGenBuffers(1, &uniform_blocks.matrices);
     glBindBuffer(GL_UNIFORM_BUFFER, uniform_blocks.matrices);
-    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(float) * 16, matrix);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(float) * 16, NULL, GL_STATIC_DRAW);
     glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferRange(GL_UNIFORM_BUFFER, 0, uniform_blocks.matrices, 0, sizeof(float) * 16);
 }
 
-void Graphics::SetShaderFloat(const std::string& shader_id, const std::string& uniform_name, const float value)
+void Graphics::InitMaterialBuffer()
 {
-    CheckAndStartNewBatch();
-    uint32_t program_ID = shaders[shader_id];
-    glUniform1f(glGetUniformLocation(program_ID, uniform_name.c_str()), value);
+    // a buffer texture rather than a uniform block so there's room for a lot more materials, it works on 3.3 too
+    glGenBuffers(1, &material_buffer.TBO);
+    glBindBuffer(GL_TEXTURE_BUFFER, material_buffer.TBO);
+    glBufferData(GL_TEXTURE_BUFFER, sizeof(Material) * MAX_MATERIALS, NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    glGenTextures(1, &material_buffer.texture);
+    glActiveTexture(texture_units[MATERIAL_TEXTURE_UNIT]);
+    glBindTexture(GL_TEXTURE_BUFFER, material_buffer.texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, material_buffer.TBO);
+    glActiveTexture(GL_TEXTURE0);
+
+    // the zero material
+    material_buffer.materials.assign(1, Material());
+    material_buffer.free_materials.clear();
+    material_buffer.dirty_first = 0;
+    material_buffer.dirty_end = 1;
 }
 
-void Graphics::SetShaderInt(const std::string& shader_id, const std::string& uniform_name, const int value)
+uint32_t Graphics::CreateMaterial(const Material& material)
 {
-    CheckAndStartNewBatch();
-    uint32_t program_ID = shaders[shader_id];
-    glUniform1i(glGetUniformLocation(program_ID, uniform_name.c_str()), value);
+    Capture::Scope capture_scope(true);
+    if(capture_scope.recording) Capture::Record(CAPTURE_CREATE_MATERIAL, CaptureArray<Vec4>{ material.params, MATERIAL_VEC4_COUNT });
+
+    uint32_t material_index;
+    if(!material_buffer.free_materials.empty())
+    {
+        material_index = material_buffer.free_materials.back();
+        material_buffer.free_materials.pop_back();
+    }
+    else
+    {
+        if(material_buffer.materials.size() == MAX_MATERIALS)
+        {
+            std::cout << "ERROR::MATERIAL: Out of materials, MAX_MATERIALS is " << MAX_MATERIALS << std::endl;
+            return 0;
+        }
+        material_index = material_buffer.materials.size();
+        material_buffer.materials.push_back(Material());
+    }
+
+    SetMaterial(material_index, material);
+    return material_index;
 }
 
-void Graphics::SetShaderVec2(const std::string& shader_id, const std::string& uniform_name, const Vec2& value)
+void Graphics::SetMaterial(const uint32_t material_index, const Material& material)
 {
-    CheckAndStartNewBatch();
-    uint32_t program_ID = shaders[shader_id];
-    glUniform2f(glGetUniformLocation(program_ID, uniform_name.c_str()), value.x, value.y);
+    Capture::Scope capture_scope;
+    if(capture_scope.recording) Capture::Record(CAPTURE_SET_MATERIAL, material_index, CaptureArray<Vec4>{ material.params, MATERIAL_VEC4_COUNT });
+    if(RecordDrawListCall([=]() { SetMaterial(material_index, material); })) return;
+
+    // the zero material never changes
+    if(material_index == 0 || material_index >= material_buffer.materials.size()) return;
+
+    // no flush, the batch only holds the index
+    material_buffer.materials[material_index] = material;
+    if(material_buffer.dirty_first == material_buffer.dirty_end)
+    {
+        material_buffer.dirty_first = material_index;
+        material_buffer.dirty_end = material_index + 1;
+    }
+    else
+    {
+        material_buffer.dirty_first = std::min(material_buffer.dirty_first, material_index);
+        material_buffer.dirty_end = std::max(material_buffer.dirty_end, material_index + 1);
+    }
 }
 
-void Graphics::SetShaderVec3(const std::string& shader_id, const std::string& uniform_name, const Vec3& value)
+void Graphics::DeleteMaterial(const uint32_t material_index)
 {
-    CheckAndStartNewBatch();
-    uint32_t program_ID = shaders[shader_id];
-    glUniform3f(glGetUniformLocation(program_ID, uniform_name.c_str()), value.x, value.y, value.z);
+    Capture::Scope capture_scope(true);
+    if(capture_scope.recording) Capture::Record(CAPTURE_DELETE_MATERIAL, material_index);
+    if(material_index == 0 || material_index >= material_buffer.materials.size()) return;
+
+    // the slot keeps its values until it's reused, anything still batched with it draws the same
+    material_buffer.free_materials.push_back(material_index);
 }
 
-void Graphics::SetShaderVec4(const std::string& shader_id, const std::string& uniform_name, const Vec4& value)
+void Graphics::UploadMaterials()
 {
-    CheckAndStartNewBatch();
-    uint32_t program_ID = shaders[shader_id];
-    glUniform4f(glGetUniformLocation(program_ID, uniform_name.c_str()), value.x, value.y, value.z, value.w);
+    if(material_buffer.dirty_first == material_buffer.dirty_end) return;
+
+    uint32_t first = material_buffer.dirty_first;
+    uint32_t count = material_buffer.dirty_end - first;
+    glBindBuffer(GL_TEXTURE_BUFFER, material_buffer.TBO);
+    glBufferSubData(GL_TEXTURE_BUFFER, sizeof(Material) * first, sizeof(Material) * count, material_buffer.materials.data() + first);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    material_buffer.dirty_first = 0;
+    material_buffer.dirty_end = 0;
 }
 
-void Graphics::SetShaderFloatArray(const std::string& shader_id, const std::string& uniform_name, const float* values, const size_t n)
+void Graphics::ActivateShader(const std::string& shader_id)
 {
-    CheckAndStartNewBatch();
-    uint32_t program_ID = shaders[shader_id];
-    glUniform1fv(glGetUniformLocation(program_ID, uniform_name.c_str()), n, values);
+    Capture::Scope capture_scope;
+    if(capture_scope.recording) Capture::Record(CAPTURE_ACTIVATE_SHADER, shader_id);
+    ActivateShader(GetShaderHandle(shader_id));
+}
+
+void Graphics::ActivateShader(const ShaderHandle shader)
+{
+    if(shader.index == INVALID_HANDLE) return;
+
+    Capture::Scope capture_scope;
+    if(capture_scope.recording) Capture::Record(CAPTURE_ACTIVATE_SHADER, shader_programs[shader.index].shader_id);
+    if(shader.index == activated_shader.index)
+    {
+        return;
+    }
+
+    if(draw_queue.recording)
+    {
+        // the shader is stored with each recorded command and only actually used when the queue is flushed
+        std::vector<ShaderHandle>& shaders = draw_queue.shaders;
+        size_t shader_index = 0;
+        while(shader_index < shaders.size() && shaders[shader_index].index != shader.index)
+        {
+            shader_index++;
+        }
+        if(shader_index == shaders.size())
+        {
+            shaders.push_back(shader);
+        }
+        draw_queue.current_shader_index = (uint32_t)shader_index;
+        draw_queue.shader_dirty = true;
+        activated_shader = shader;
+        return;
+    }
+
+    CheckAndStartNewBatch(BATCH_BREAK_SHADER);
+
+    const ShaderProgram& program = GetShaderProgram(shader);
+    glUseProgram(program.program);
+    activated_shader = shader;
+    batch.max_texture_slots = program.texture_slots;
+}
+
+void Graphics::DeactivateShader()
+{
+    // when we deactivate a shader, activate the default one
+    ActivateShader(default_shader);
+}
+
+void Graphics::EnablePrimitiveRestart()
+{
+    // only on for line strips, the 16 bit quad indices go all the way up to 0xffff
+    #ifdef __APPLE__
+    // fixed index restart is 4.3, mac only has 3.3 so the (same) index is set by hand
+    glEnable(GL_PRIMITIVE_RESTART);
+    glPrimitiveRestartIndex(PRIMITIVE_RESTART_INDEX);
+    #else
+    glEnable(GL_PRIMITIVE_RESTART_FIXED_INDEX);
+    #endif
+}
+
+void Graphics::DisablePrimitiveRestart()
+{
+    #ifdef __APPLE__
+    glDisable(GL_PRIMITIVE_RESTART);
+    #else
+    glDisable(GL_PRIMITIVE_RESTART_FIXED_INDEX);
+    #endif
+}
+
+void Graphics::CheckAndStartNewBatch(const BatchBreakReason reason, const char* file, const int line)
+{
+    // when deferring, anything that needs the batch flushed needs every recorded command drawn first
+    if(draw_queue.recording)
+    {
+        FlushDrawQueue(reason, file, line);
+        return;
+    }
+
+    if(batch.index_count > 0 || batch.instance_count > 0 || batch.shape_count > 0)
+    {
+        if(Profiler::BatchBreakDiagnosticsEnabled())
+        {
+            Profiler::RecordBatchBreak(reason, file, line, batch.current_index_offset, batch.index_count, batch.instance_count + batch.shape_count);
+        }
+
+        EndBatch();
+        FlushBatch();
+        BeginBatch();
+    }
+
+    // the next batch starts with all of its texture slots free
+    batch.texture_slot_count = 0;
+    batch.texture_array = 0;
+}
+
+void Graphics::SetShaderProjection(const std::string& shader_id, const float left, const float right, const float bottom, const float top, const float z_near, const float z_far)
+{
+    Capture::Scope capture_scope;
+    if(capture_scope.recording) Capture::Record(CAPTURE_SET_SHADER_PROJECTION, shader_id, left, right, bottom, top, z_near, z_far);
+    SetShaderProjection(GetShaderHandle(shader_id), left, right, bottom, top, z_near, z_far);
+}
+
+void Graphics::SetShaderProjection(const ShaderHandle shader, const float left, const float right, const float bottom, const float top, const float z_near, const float z_far)
+{
+    Capture::Scope capture_scope;
+    if(capture_scope.recording)
+    {
+        // the projection lives in the Matrices block every shader shares, the shader is only kept for the replay
+        const char* shader_id = shader.index == INVALID_HANDLE ? "" : shader_programs[shader.index].shader_id.c_str();
+        Capture::Record(CAPTURE_SET_SHADER_PROJECTION, shader_id, left, right, bottom, top, z_near, z_far);
+    }
+    if(RecordDrawListCall([=]() { SetShaderProjection(shader, left, right, bottom, top, z_near, z_far); })) return;
+    //CheckAndStartNewBatch();
+
+    GLfloat matrix[] = {
+        1.0f, 0.0f, 0.0f, 0.0f,
+        0.0f, 1.0f, 0.0f, 0.0f,
+        0.0f, 0.0f, 1.0f, 0.0f,
+        0.0f, 0.0f, 0.0f, 1.0f,
+    };
+
+    matrix[0] = 2.0f / (right - left);
+    matrix[5] = 2.0f / (top - bottom);
+    matrix[10] = - 2.0f / (z_far - z_near);
+    matrix[12] = - (right + left) / (right - left);
+    matrix[13] = - (top + bottom) / (top - bottom);
+    matrix[14] = - (z_far + z_near) / (z_far - z_near);
+
+    // uint32_t program_ID = shader_programs[shader.index].program;
+    // glUniformMatrix4fv(glGetUniformLocation(program_ID, "projection"), 1, GL_FALSE, matrix);
+    glBindBuffer(GL_UNIFORM_BUFFER, uniform_blocks.matrices);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(float) * 16, matrix);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void Graphics::SetShaderFloat(const std::string& shader_id, const std::string& uniform_name, const float value)
+{
+    Capture::Scope capture_scope;
+    if(capture_scope.recording) Capture::Record(CAPTURE_SET_SHADER_FLOAT, shader_id, uniform_name, value);
+    if(RecordDrawListCall([=]() { SetShaderFloat(shader_id, uniform_name, value); })) return;
+    SetShaderFloat(GetUniformHandle(shader_id, uniform_name), value);
+}
+
+void Graphics::SetShaderInt(const std::string& shader_id, const std::string& uniform_name, const int value)
+{
+    Capture::Scope capture_scope;
+    if(capture_scope.recording) Capture::Record(CAPTURE_SET_SHADER_INT, shader_id, uniform_name, value);
+    if(RecordDrawListCall([=]() { SetShaderInt(shader_id, uniform_name, value); })) return;
+    SetShaderInt(GetUniformHandle(shader_id, uniform_name), value);
+}
+
+void Graphics::SetShaderVec2(const std::string& shader_id, const std::string& uniform_name, const Vec2& value)
+{
+    Capture::Scope capture_scope;
+    if(capture_scope.recording) Capture::Record(CAPTURE_SET_SHADER_VEC2, shader_id, uniform_name, value);
+    if(RecordDrawListCall([=]() { SetShaderVec2(shader_id, uniform_name, value); })) return;
+    SetShaderVec2(GetUniformHandle(shader_id, uniform_name), value);
+}
+
+void Graphics::SetShaderVec3(const std::string& shader_id, const std::string& uniform_name, const Vec3& value)
+{
+    Capture::Scope capture_scope;
+    if(capture_scope.recording) Capture::Record(CAPTURE_SET_SHADER_VEC3, shader_id, uniform_name, value);
+    if(RecordDrawListCall([=]() { SetShaderVec3(shader_id, uniform_name, value); })) return;
+    SetShaderVec3(GetUniformHandle(shader_id, uniform_name), value);
+}
+
+void Graphics::SetShaderVec4(const std::string& shader_id, const std::string& uniform_name, const Vec4& value)
+{
+    Capture::Scope capture_scope;
+    if(capture_scope.recording) Capture::Record(CAPTURE_SET_SHADER_VEC4, shader_id, uniform_name, value);
+    if(RecordDrawListCall([=]() { SetShaderVec4(shader_id, uniform_name, value); })) return;
+    SetShaderVec4(GetUniformHandle(shader_id, uniform_name), value);
 }
+
+void Graphics::SetShaderFloatArray(const std::string& shader_id, const std::string& uniform_name, const float* values, const size_t n)
+{
+    Capture::Scope capture_scope;
+    if(capture_scope.recording) Capture::Record(CAPTURE_SET_SHADER_FLOAT_ARRAY, shader_id, uniform_name, CaptureArray<float>{ values, (uint32_t)n });
+    if(RecordDrawListCall([=, values_copy = std::vector<float>(values, values + n)]() { SetShaderFloatArray(shader_id, uniform_name, values_copy.data(), n); })) return;
+    SetShaderFloatArray(GetUniformHandle(shader_id, uniform_name), values, n);
+}
+
 void Graphics::SetShaderIntArray(const std::string& shader_id, const std::string& uniform_name, const int* values, const size_t n)
 {
-    CheckAndStartNewBatch();
-    uint32_t program_ID = shaders[shader_id];
-    glUniform1iv(glGetUniformLocation(program_ID, uniform_name.c_str()), n, values);
+    Capture::Scope capture_scope;
+    if(capture_scope.recording) Capture::Record(CAPTURE_SET_SHADER_INT_ARRAY, shader_id, uniform_name, CaptureArray<int>{ values, (uint32_t)n });
+    if(RecordDrawListCall([=, values_copy = std::vector<int>(values, values + n)]() { SetShaderIntArray(shader_id, uniform_name, values_copy.data(), n); })) return;
+    SetShaderIntArray(GetUniformHandle(shader_id, uniform_name), values, n);
 }
 
 void Graphics::SetShaderVec2Array(const std::string& shader_id, const std::string& uniform_name, const Vec2* values, const size_t n)
 {
-    CheckAndStartNewBatch();
-    uint32_t program_ID = shaders[shader_id];
-    glUniform2fv(glGetUniformLocation(program_ID, uniform_name.c_str()), n, &(values->x));
+    Capture::Scope capture_scope;
+    if(capture_scope.recording) Capture::Record(CAPTURE_SET_SHADER_VEC2_ARRAY, shader_id, uniform_name, CaptureArray<Vec2>{ values, (uint32_t)n });
+    if(RecordDrawListCall([=, values_copy = std::vector<Vec2>(values, values + n)]() { SetShaderVec2Array(shader_id, uniform_name, values_copy.data(), n); })) return;
+    SetShaderVec2Array(GetUniformHandle(shader_id, uniform_name), values, n);
 }
 
 void Graphics::SetShaderVec3Array(const std::string& shader_id, const std::string& uniform_name, const Vec3* values, const size_t n)
 {
-    CheckAndStartNewBatch();
-    uint32_t program_ID = shaders[shader_id];
-    glUniform3fv(glGetUniformLocation(program_ID, uniform_name.c_str()), n, &(values->x));
+    Capture::Scope capture_scope;
+    if(capture_scope.recording) Capture::Record(CAPTURE_SET_SHADER_VEC3_ARRAY, shader_id, uniform_name, CaptureArray<Vec3>{ values, (uint32_t)n });
+    if(RecordDrawListCall([=, values_copy = std::vector<Vec3>(values, values + n)]() { SetShaderVec3Array(shader_id, uniform_name, values_copy.data(), n); })) return;
+    SetShaderVec3Array(GetUniformHandle(shader_id, uniform_name), values, n);
 }
 
 void Graphics::SetShaderVec4Array(const std::string& shader_id, const std::string& uniform_name, const Vec4* values, const size_t n)
 {
-    CheckAndStartNewBatch();
-    uint32_t program_ID = shaders[shader_id];
-    glUniform4fv(glGetUniformLocation(program_ID, uniform_name.c_str()), n, &(values->x));
+    Capture::Scope capture_scope;
+    if(capture_scope.recording) Capture::Record(CAPTURE_SET_SHADER_VEC4_ARRAY, shader_id, uniform_name, CaptureArray<Vec4>{ values, (uint32_t)n });
+    if(RecordDrawListCall([=, values_copy = std::vector<Vec4>(values, values + n)]() { SetShaderVec4Array(shader_id, uniform_name, values_copy.data(), n); })) return;
+    SetShaderVec4Array(GetUniformHandle(shader_id, uniform_name), values, n);
 }
 
 void Graphics::SetShaderTexture(const std::string& shader_id, const std::string& uniform_name, const GLuint texture_id, const uint8_t texture_unit)
 {
-    CheckAndStartNewBatch();
-    BindTexture(texture_id, texture_unit);
-    uint32_t program_ID = shaders[shader_id];
-    glUniform1i(glGetUniformLocation(program_ID, uniform_name.c_str()), texture_unit);
+    Capture::Scope capture_scope;
+    if(capture_scope.recording) Capture::Record(CAPTURE_SET_SHADER_TEXTURE, shader_id, uniform_name, Capture::GetTextureName(texture_id), texture_unit);
+    if(RecordDrawListCall([=]() { SetShaderTexture(shader_id, uniform_name, texture_id, texture_unit); })) return;
+    SetShaderTexture(GetUniformHandle(shader_id, uniform_name), texture_id, texture_unit);
 }
 
 void Graphics::SetShaderFramebufferTexture(const std::string& shader_id, const std::string& uniform_name, const uint32_t frame_buffer_index, const uint8_t texture_unit)
 {
-    CheckAndStartNewBatch();
+    Capture::Scope capture_scope;
+    if(capture_scope.recording) Capture::Record(CAPTURE_SET_SHADER_FRAMEBUFFER_TEXTURE, shader_id, uniform_name, frame_buffer_index, texture_unit);
+    if(RecordDrawListCall([=]() { SetShaderFramebufferTexture(shader_id, uniform_name, frame_buffer_index, texture_unit); })) return;
+    SetShaderFramebufferTexture(GetUniformHandle(shader_id, uniform_name), frame_buffer_index, texture_unit);
+}
+
+void Graphics::LoadShaderUniforms(ShaderProgram& program)
+{
+    GLuint program_id = program.program;
+
+    // uniforms from a previous version of the shader keep their index, they just don't exist until they're found again
+    for(size_t i = 0; i < program.uniforms.size(); ++i)
+    {
+        program.uniforms[i].location = -1;
+    }
+
+    GLint uniform_count = 0;
+    GLint max_name_length = 0;
+    glGetProgramiv(program_id, GL_ACTIVE_UNIFORMS, &uniform_count);
+    glGetProgramiv(program_id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_name_length);
+    std::vector<char> name_buffer(max_name_length + 1);
+
+    for(GLint i = 0; i < uniform_count; ++i)
+    {
+        GLsizei name_length = 0;
+        GLint size = 0;
+        GLenum type = GL_NONE;
+        glGetActiveUniform(program_id, i, name_buffer.size(), &name_length, &size, &type, name_buffer.data());
+
+        std::string name(name_buffer.data(), name_length);
+
+        // uniforms in a block (like Matrices) have no location, they're set through the block's buffer
+        GLint location = glGetUniformLocation(program_id, name.c_str());
+        if(location == -1) continue;
+
+        // arrays are listed as "name[0]" but set by their plain name
+        if(name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+        {
+            name.resize(name.size() - 3);
+        }
+
+        uint32_t uniform_index;
+        auto it = program.uniform_indices.find(name);
+        if(it == program.uniform_indices.end())
+        {
+            uniform_index = program.uniforms.size();
+            program.uniform_indices[name] = uniform_index;
+            program.uniforms.push_back(ShaderUniform());
+            program.uniforms[uniform_index].name = name;
+        }
+        else
+        {
+            uniform_index = it->second;
+        }
+
+        ShaderUniform& uniform = program.uniforms[uniform_index];
+        uniform.location = location;
+        uniform.type = type;
+        uniform.size = size;
+    }
+
+    // a new program's values are all unknown, and sizes can change between versions so the cache is laid out again
+    uint32_t cache_size = 0;
+    for(size_t i = 0; i < program.uniforms.size(); ++i)
+    {
+        ShaderUniform& uniform = program.uniforms[i];
+        uniform.cache_offset = cache_size;
+        uniform.cache_size = uniform.location == -1 ? 0 : GetUniformComponents(uniform.type) * uniform.size;
+        uniform.cached_words = 0;
+        cache_size += uniform.cache_size;
+    }
+    program.cache.assign(cache_size, 0);
+}
+
+Graphics::UniformHandle Graphics::GetUniformHandle(const std::string& shader_id, const std::string& uniform_name)
+{
+    UniformHandle handle;
+
+    auto program_it = shader_indices.find(shader_id);
+    if(program_it == shader_indices.end()) return handle;
+
+    // the uniforms aren't known until the program has linked
+    ShaderProgram& program = GetShaderProgram(ShaderHandle{ program_it->second });
+    auto uniform_it = program.uniform_indices.find(uniform_name);
+    if(uniform_it == program.uniform_indices.end()) return handle;
+
+    handle.program_index = program_it->second;
+    handle.uniform_index = uniform_it->second;
+    handle.type = program.uniforms[uniform_it->second].type;
+    return handle;
+}
+
+void Graphics::SetShaderUniform(const UniformHandle& uniform, const GLenum value_type, const void* values, const uint32_t count)
+{
+    if(uniform.program_index == INVALID_HANDLE || uniform.uniform_index == INVALID_HANDLE) return;
+
+    ShaderProgram& program = shader_programs[uniform.program_index];
+    uint32_t words = GetUniformComponents(value_type) * count;
+
+    Capture::Scope capture_scope;
+    if(capture_scope.recording)
+    {
+        // recorded as the by name array setters, a count of 1 replays the same as the single value ones
+        const std::string& shader_id = program.shader_id;
+        const std::string& uniform_name = program.uniforms[uniform.uniform_index].name;
+        switch(value_type)
+        {
+            case GL_FLOAT:      Capture::Record(CAPTURE_SET_SHADER_FLOAT_ARRAY, shader_id, uniform_name, CaptureArray<float>{ (const float*)values, count }); break;
+            case GL_FLOAT_VEC2: Capture::Record(CAPTURE_SET_SHADER_VEC2_ARRAY,  shader_id, uniform_name, CaptureArray<Vec2>{ (const Vec2*)values, count });   break;
+            case GL_FLOAT_VEC3: Capture::Record(CAPTURE_SET_SHADER_VEC3_ARRAY,  shader_id, uniform_name, CaptureArray<Vec3>{ (const Vec3*)values, count });   break;
+            case GL_FLOAT_VEC4: Capture::Record(CAPTURE_SET_SHADER_VEC4_ARRAY,  shader_id, uniform_name, CaptureArray<Vec4>{ (const Vec4*)values, count });   break;
+            case GL_INT:        Capture::Record(CAPTURE_SET_SHADER_INT_ARRAY,   shader_id, uniform_name, CaptureArray<int>{ (const int*)values, count });     break;
+        }
+    }
+    if(RecordDrawListCall([=, values_copy = std::vector<uint32_t>((const uint32_t*)values, (const uint32_t*)values + words)]() { SetShaderUniform(uniform, value_type, values_copy.data(), count); })) return;
+
+    // the shader could have been created again since the handle was made, and not be linked yet
+    if(program.pending) FinishShaderProgram(program);
+
+    ShaderUniform& shader_uniform = program.uniforms[uniform.uniform_index];
+    if(shader_uniform.location == -1) return;
+
+    // the same value again changes nothing, so there's no need to upload it or draw the batch first
+    const uint32_t* cached = program.cache.data() + shader_uniform.cache_offset;
+    bool cacheable = words <= shader_uniform.cache_size;
+    if(cacheable && words <= shader_uniform.cached_words && std::memcmp(cached, values, words * sizeof(uint32_t)) == 0) return;
+
+    CheckAndStartNewBatch(BATCH_BREAK_SHADER_UNIFORM);
+
+    #ifdef __APPLE__
+    // mac only has 3.3 so there's no glProgramUniform, the program is bound just for the upload
+    GLuint bound_program = activated_shader.index == INVALID_HANDLE ? 0 : shader_programs[activated_shader.index].program;
+    if(bound_program != program.program) glUseProgram(program.program);
+    switch(value_type)
+    {
+        case GL_FLOAT:      glUniform1fv(shader_uniform.location, count, (const GLfloat*)values); break;
+        case GL_FLOAT_VEC2: glUniform2fv(shader_uniform.location, count, (const GLfloat*)values); break;
+        case GL_FLOAT_VEC3: glUniform3fv(shader_uniform.location, count, (const GLfloat*)values); break;
+        case GL_FLOAT_VEC4: glUniform4fv(shader_uniform.location, count, (const GLfloat*)values); break;
+        case GL_INT:        glUniform1iv(shader_uniform.location, count, (const GLint*)values);   break;
+    }
+    if(bound_program != program.program) glUseProgram(bound_program);
+    #else
+    // the program doesn't have to be bound, before this the value went to whichever one was
+    switch(value_type)
+    {
+        case GL_FLOAT:      glProgramUniform1fv(program.program, shader_uniform.location, count, (const GLfloat*)values); break;
+        case GL_FLOAT_VEC2: glProgramUniform2fv(program.program, shader_uniform.location, count, (const GLfloat*)values); break;
+        case GL_FLOAT_VEC3: glProgramUniform3fv(program.program, shader_uniform.location, count, (const GLfloat*)values); break;
+        case GL_FLOAT_VEC4: glProgramUniform4fv(program.program, shader_uniform.location, count, (const GLfloat*)values); break;
+        case GL_INT:        glProgramUniform1iv(program.program, shader_uniform.location, count, (const GLint*)values);   break;
+    }
+    #endif
+
+    if(cacheable)
+    {
+        std::memcpy(program.cache.data() + shader_uniform.cache_offset, values, words * sizeof(uint32_t));
+        shader_uniform.cached_words = std::max(shader_uniform.cached_words, words);
+    }
+}
+
+void Graphics::SetShaderFloat(const UniformHandle& uniform, const float value)
+{
+    SetShaderUniform(uniform, GL_FLOAT, &value, 1);
+}
+
+void Graphics::SetShaderInt(const UniformHandle& uniform, const int value)
+{
+    SetShaderUniform(uniform, GL_INT, &value, 1);
+}
+
+void Graphics::SetShaderVec2(const UniformHandle& uniform, const Vec2& value)
+{
+    SetShaderUniform(uniform, GL_FLOAT_VEC2, &value.x, 1);
+}
+
+void Graphics::SetShaderVec3(const UniformHandle& uniform, const Vec3& value)
+{
+    SetShaderUniform(uniform, GL_FLOAT_VEC3, &value.x, 1);
+}
+
+void Graphics::SetShaderVec4(const UniformHandle& uniform, const Vec4& value)
+{
+    SetShaderUniform(uniform, GL_FLOAT_VEC4, &value.x, 1);
+}
+
+void Graphics::SetShaderFloatArray(const UniformHandle& uniform, const float* values, const size_t n)
+{
+    SetShaderUniform(uniform, GL_FLOAT, values, n);
+}
+
+void Graphics::SetShaderIntArray(const UniformHandle& uniform, const int* values, const size_t n)
+{
+    SetShaderUniform(uniform, GL_INT, values, n);
+}
+
+void Graphics::SetShaderVec2Array(const UniformHandle& uniform, const Vec2* values, const size_t n)
+{
+    SetShaderUniform(uniform, GL_FLOAT_VEC2, &(values->x), n);
+}
+
+void Graphics::SetShaderVec3Array(const UniformHandle& uniform, const Vec3* values, const size_t n)
+{
+    SetShaderUniform(uniform, GL_FLOAT_VEC3, &(values->x), n);
+}
+
+void Graphics::SetShaderVec4Array(const UniformHandle& uniform, const Vec4* values, const size_t n)
+{
+    SetShaderUniform(uniform, GL_FLOAT_VEC4, &(values->x), n);
+}
+
+void Graphics::SetShaderTexture(const UniformHandle& uniform, const GLuint texture_id, const uint8_t texture_unit)
+{
+    Capture::Scope capture_scope;
+    if(capture_scope.recording && uniform.program_index != INVALID_HANDLE)
+    {
+        const ShaderProgram& program = shader_programs[uniform.program_index];
+        Capture::Record(CAPTURE_SET_SHADER_TEXTURE, program.shader_id, program.uniforms[uniform.uniform_index].name, Capture::GetTextureName(texture_id), texture_unit);
+    }
+    if(RecordDrawListCall([=]() { SetShaderTexture(uniform, texture_id, texture_unit); })) return;
+
+    // only a different texture needs the batch drawn first, the sampler's unit is cached like any other uniform
+    if(bound_textures[texture_unit] != texture_id)
+    {
+        CheckAndStartNewBatch(BATCH_BREAK_SHADER_UNIFORM);
+        BindTexture(texture_id, texture_unit);
+    }
+
+    int unit = texture_unit;
+    SetShaderUniform(uniform, GL_INT, &unit, 1);
+}
+
+void Graphics::SetShaderFramebufferTexture(const UniformHandle& uniform, const uint32_t frame_buffer_index, const uint8_t texture_unit)
+{
+    Capture::Scope capture_scope;
+    if(capture_scope.recording && uniform.program_index != INVALID_HANDLE)
+    {
+        const ShaderProgram& program = shader_programs[uniform.program_index];
+        Capture::Record(CAPTURE_SET_SHADER_FRAMEBUFFER_TEXTURE, program.shader_id, program.uniforms[uniform.uniform_index].name, frame_buffer_index, texture_unit);
+    }
+    if(RecordDrawListCall([=]() { SetShaderFramebufferTexture(uniform, frame_buffer_index, texture_unit); })) return;
+
+    // whatever is batched has to be in the buffer before it's read from, even when it's the same texture as last time
+    CheckAndStartNewBatch(BATCH_BREAK_SHADER_UNIFORM);
     ResolveMultiSampledFrameBuffer(frame_buffer_index);
-    GLuint texture_id = GetFrameBufferTextureID(frame_buffer_index);
-    SetShaderTexture(shader_id, uniform_name, texture_id, texture_unit);
+    SetShaderTexture(uniform, GetFrameBufferTextureID(frame_buffer_index), texture_unit);
 }
 
 void Graphics::LoadSpritesFile(const std::string& file_name, const FilterType filter_type)
 {
+    Capture::Scope capture_scope(true);
+    if(capture_scope.recording) Capture::Record(CAPTURE_LOAD_SPRITES_FILE, file_name, filter_type);
     std::ifstream file(file_name);
 
     if(file.is_open())
@@ -676,6 +1684,8 @@ void Graphics::LoadSpritesFile(const std::string& file_name, const FilterType fi
 
 SpriteSheet* Graphics::LoadSpriteSheet(const std::string& sprite_sheet_name, const char* diffuse, const char* specular, const char* normal, const FilterType filter_type)
 {
+    Capture::Scope capture_scope(true);
+    if(capture_scope.recording) Capture::Record(CAPTURE_LOAD_SPRITE_SHEET, sprite_sheet_name, diffuse, specular, normal, filter_type);
     SpriteSheet* sprite_sheet;
 
     if(sprite_sheets.count(sprite_sheet_name) > 0)
@@ -700,6 +1710,8 @@ SpriteSheet* Graphics::LoadSpriteSheet(const std::string& sprite_sheet_name, con
 
 Texture* Graphics::LoadTexture(const std::string& texture_file_name, const FilterType filter_type)
 {
+    Capture::Scope capture_scope(true);
+    if(capture_scope.recording) Capture::Record(CAPTURE_LOAD_TEXTURE, texture_file_name, filter_type);
     int width, height, nrChannels;
     int desired_channels = 4; // 4 channels as we always want RGBA for the glTexImage2D function below
     unsigned char* data = stbi_load(texture_file_name.c_str(), &width, &height, &nrChannels, desired_channels);
@@ -710,16 +1722,33 @@ Texture* Graphics::LoadTexture(const std::string& texture_file_name, const Filte
         return nullptr;
     }
 
+    Texture* texture = CreateTexture(texture_file_name, data, width, height, filter_type);
+
+    stbi_image_free(data);
+
+    return texture;
+}
+
+Texture* Graphics::CreateTexture(const std::string& texture_name, const uint8_t* data, const uint32_t width, const uint32_t height, const FilterType filter_type)
+{
     GLuint filter = GL_LINEAR;
     if(filter_type == NEAREST) filter = GL_NEAREST;
 
     // if there is already a value for this id, then delete it
-    if(textures.count(texture_file_name) > 0)
+    if(textures.count(texture_name) > 0)
     {
-        glDeleteTextures(1, &textures[texture_file_name].ID);
+        CheckAndUnbindTexture(textures[texture_name].ID);
+        glDeleteTextures(1, &textures[texture_name].ID);
     }
 
-    Texture* texture = &textures[texture_file_name];
+    Texture* texture = &textures[texture_name];
+
+    // loading the same file again keeps its handle
+    if(texture->handle.index == INVALID_HANDLE)
+    {
+        texture->handle.index = texture_handles.size();
+        texture_handles.push_back(texture);
+    }
 
     texture->width = width;
     texture->height = height;
@@ -729,19 +1758,30 @@ Texture* Graphics::LoadTexture(const std::string& texture_file_name, const Filte
     texture->wrap_t = GL_CLAMP_TO_EDGE;
 
     glGenTextures(1, &texture->ID);
-    glBindTexture(GL_TEXTURE_2D, texture->ID);
+    BindScratchTexture(GL_TEXTURE_2D, texture->ID);
     glTexImage2D(GL_TEXTURE_2D, 0, texture->internal_format, width, height, 0, texture->image_format, GL_UNSIGNED_BYTE, data);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, texture->wrap_s);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, texture->wrap_t);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
-    glBindTexture(GL_TEXTURE_2D, 0);
-
-    stbi_image_free(data);
+    glActiveTexture(GL_TEXTURE0);
 
     return texture;
 }
 
+TextureHandle Graphics::GetTextureHandle(const std::string& texture_file_name)
+{
+    auto it = textures.find(texture_file_name);
+    if(it == textures.end()) return TextureHandle();
+    return it->second.handle;
+}
+
+Texture* Graphics::GetTexture(const TextureHandle texture)
+{
+    if(texture.index == INVALID_HANDLE) return nullptr;
+    return texture_handles[texture.index];
+}
+
 void Graphics::BindTexture(const GLuint texture_id, const uint8_t texture_unit)
 {
     if(bound_textures[texture_unit] != texture_id)
@@ -752,6 +1792,38 @@ void Graphics::BindTexture(const GLuint texture_id, const uint8_t texture_unit)
     }
 }
 
+void Graphics::BindTextureArray(const GLuint texture_id)
+{
+    // the unit only ever has arrays bound to it, so the same cache works
+    if(bound_textures[TEXTURE_ARRAY_UNIT] != texture_id)
+    {
+        glActiveTexture(texture_units[TEXTURE_ARRAY_UNIT]);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, texture_id);
+        glActiveTexture(GL_TEXTURE0);
+        bound_textures[TEXTURE_ARRAY_UNIT] = texture_id;
+    }
+}
+
+void Graphics::BindScratchTexture(const GLenum target, const GLuint texture_id)
+{
+    glActiveTexture(texture_units[TEXTURE_SCRATCH_UNIT]);
+    glBindTexture(target, texture_id);
+
+    // the cache only follows what's bound to GL_TEXTURE_2D
+    if(target == GL_TEXTURE_2D) bound_textures[TEXTURE_SCRATCH_UNIT] = texture_id;
+}
+
+bool Graphics::IsTextureArray(const GLuint texture_id)
+{
+    // only asked when a texture isn't already in one of the batch's slots, and there are only ever a few arrays
+    if(texture_id == 0) return false;
+    for(auto it = texture_arrays.begin(); it != texture_arrays.end(); ++it)
+    {
+        if(it->second.ID == texture_id) return true;
+    }
+    return false;
+}
+
 void Graphics::CheckAndUnbindTexture(const GLuint texture_id)
 {
     std::map<uint8_t, uint32_t>::iterator it = bound_textures.begin();
@@ -819,31 +1891,26 @@ void Graphics::RenderSprite(const Sprite& sprite, const Vec3& position, const ui
     RenderSprite(sprite, position, size, 0.0f, Vec2(0.0f), frame_buffer_index, sprite_sheet_layer, colour);
 }
 
+void Graphics::RenderSprite(const Sprite& sprite, const Vec3& position, const Vec2& size, const float angle_degrees, const Vec2& origin, const uint32_t frame_buffer_index, const SpriteSheetLayer sprite_sheet_layer, const uint32_t material_index, const Vec4& colour)
+{
+    Capture::Scope capture_scope;
+    if(capture_scope.recording) Capture::Record(CAPTURE_RENDER_SPRITE_MATERIAL, sprite.id, position, size, angle_degrees, origin, frame_buffer_index, sprite_sheet_layer, material_index, colour);
+
+    // only this sprite's vertices get the material
+    batch.current_material_index = material_index;
+    RenderSprite(sprite, position, size, angle_degrees, origin, frame_buffer_index, sprite_sheet_layer, colour);
+    batch.current_material_index = 0;
+}
+
 void Graphics::RenderSprite(const Sprite& sprite, const Vec3& position, const Vec2& size, const float angle_degrees, const Vec2& origin, const uint32_t frame_buffer_index, const SpriteSheetLayer sprite_sheet_layer, const Vec4& colour)
 {
+    Capture::Scope capture_scope;
+    if(capture_scope.recording) Capture::Record(CAPTURE_RENDER_SPRITE, sprite.id, position, size, angle_degrees, origin, frame_buffer_index, sprite_sheet_layer, colour);
     int indices_count = 6;
-    uint32_t texture_id = sprite.sprite_sheet->diffuse->ID;
-
-    switch(sprite_sheet_layer)
-    {
-        case DIFFUSE :
-        {
-            texture_id = sprite.sprite_sheet->diffuse->ID;
-            break;
-        }
-        case SPECULAR :
-        {
-            texture_id = sprite.sprite_sheet->specular->ID;
-            break;
-        }
-        case NORMAL :
-        {
-            texture_id = sprite.sprite_sheet->normal->ID;
-            break;
-        }
-    }
+    uint32_t texture_id = GetSpriteTextureID(sprite, sprite_sheet_layer);
 
-    DoBatchRenderSetUp(frame_buffer_index, texture_id, indices_count);
+    DoBatchRenderSetUp(frame_buffer_index, texture_id, indices_count, 4);
+    batch.current_texture_layer = GetSpriteTextureLayer(sprite, sprite_sheet_layer);
 
     Vec2 top_left(position.x - origin.x, position.y - origin.y);
     Vec2 top_right(position.x - origin.x + size.x, position.y - origin.y);
@@ -866,87 +1933,300 @@ void Graphics::RenderSprite(const Sprite& sprite, const Vec3& position, const Ve
     //float pixel_size = frame_buffers[frame_buffer_index].auto_scaling_value;
     float pixel_size = 1.0f;
     if(frame_buffers[frame_buffer_index].use_auto_scaling) pixel_size = Honeybear::game_scale;
+    BatchColour batch_colour = MakeBatchColour(colour);
+
+    float u[4];
+    float v[4];
+    GetSpriteTexCoords(sprite, u, v);
 
     // bottom right
-    batch.buffer_ptr->position.x = bottom_right.x * pixel_size;
-    batch.buffer_ptr->position.y = bottom_right.y * pixel_size;
-    batch.buffer_ptr->position.z = position.z * pixel_size;
-    batch.buffer_ptr->tex_coords.x = sprite.texture_x + sprite.texture_w;
-    batch.buffer_ptr->tex_coords.y = sprite.texture_y + sprite.texture_h;
-    batch.buffer_ptr->colour = colour;
-    batch.buffer_ptr++;
+    PushBatchVertex(bottom_right.x * pixel_size, bottom_right.y * pixel_size, position.z * pixel_size, u[0], v[0], batch_colour);
 
     // top right
-    batch.buffer_ptr->position.x = top_right.x * pixel_size;
-    batch.buffer_ptr->position.y = top_right.y * pixel_size;
-    batch.buffer_ptr->position.z = position.z * pixel_size;
-    batch.buffer_ptr->tex_coords.x = sprite.texture_x + sprite.texture_w;
-    batch.buffer_ptr->tex_coords.y = sprite.texture_y;
-    batch.buffer_ptr->colour = colour;
-    batch.buffer_ptr++;
+    PushBatchVertex(top_right.x * pixel_size, top_right.y * pixel_size, position.z * pixel_size, u[1], v[1], batch_colour);
 
     // top left
-    batch.buffer_ptr->position.x = top_left.x * pixel_size;
-    batch.buffer_ptr->position.y = top_left.y * pixel_size;
-    batch.buffer_ptr->position.z = position.z * pixel_size;
-    batch.buffer_ptr->tex_coords.x = sprite.texture_x;
-    batch.buffer_ptr->tex_coords.y = sprite.texture_y;
-    batch.buffer_ptr->colour = colour;
-    batch.buffer_ptr++;
+    PushBatchVertex(top_left.x * pixel_size, top_left.y * pixel_size, position.z * pixel_size, u[2], v[2], batch_colour);
 
     // bottom left
-    batch.buffer_ptr->position.x = bottom_left.x * pixel_size;
-    batch.buffer_ptr->position.y = bottom_left.y * pixel_size;
-    batch.buffer_ptr->position.z = position.z * pixel_size;
-    batch.buffer_ptr->tex_coords.x = sprite.texture_x;
-    batch.buffer_ptr->tex_coords.y = sprite.texture_y + sprite.texture_h;
-    batch.buffer_ptr->colour = colour;
-    batch.buffer_ptr++;
+    PushBatchVertex(bottom_left.x * pixel_size, bottom_left.y * pixel_size, position.z * pixel_size, u[3], v[3], batch_colour);
 
-    // first tri indices
-    batch.index_buffer[batch.index_count + 0] = 0 + batch.current_index_offset;
-    batch.index_buffer[batch.index_count + 1] = 1 + batch.current_index_offset;
-    batch.index_buffer[batch.index_count + 2] = 3 + batch.current_index_offset;
+    WriteQuadIndices();
+}
 
-    // second tri indices
-    batch.index_buffer[batch.index_count + 3] = 1 + batch.current_index_offset;
-    batch.index_buffer[batch.index_count + 4] = 2 + batch.current_index_offset;
-    batch.index_buffer[batch.index_count + 5] = 3 + batch.current_index_offset;
+void Graphics::RenderSpriteInstanced(const Sprite& sprite, const Vec2& position, const float angle_degrees, const Vec2& origin, const uint32_t frame_buffer_index, const Vec4& colour)
+{
+    Vec2 size(sprite.width, sprite.height);
+    RenderSpriteInstanced(sprite, Vec3(position.x, position.y, 0.0f), size, angle_degrees, origin, frame_buffer_index, DIFFUSE, colour);
+}
 
-    batch.current_index_offset += 4;
-    batch.index_count += indices_count;
+void Graphics::RenderSpriteInstanced(const Sprite& sprite, const Vec3& position, const Vec2& size, const float angle_degrees, const Vec2& origin, const uint32_t frame_buffer_index, const SpriteSheetLayer sprite_sheet_layer, const Vec4& colour)
+{
+    Capture::Scope capture_scope;
+    if(capture_scope.recording) Capture::Record(CAPTURE_RENDER_SPRITE_INSTANCED, sprite.id, position, size, angle_degrees, origin, frame_buffer_index, sprite_sheet_layer, colour);
+    // the deferred queue only records vertices, so build the quad on the cpu instead. the instance
+    // only has a texture rect, so sprites turned in an atlas go that way too
+    if(draw_queue.recording || sprite.rotated)
+    {
+        RenderSprite(sprite, position, size, angle_degrees, origin, frame_buffer_index, sprite_sheet_layer, colour);
+        return;
+    }
+
+    uint32_t texture_id = GetSpriteTextureID(sprite, sprite_sheet_layer);
+
+    DoBatchRenderSetUp(frame_buffer_index, texture_id, 0, 0, SPRITE_INSTANCES);
+
+    float pixel_size = 1.0f;
+    if(frame_buffers[frame_buffer_index].use_auto_scaling) pixel_size = Honeybear::game_scale;
+
+    // scaling everything before the rotation gives the same result as RenderSprite scaling after it
+    SpriteInstance* instance = batch.instance_buffer_ptr;
+    instance->position.x = position.x * pixel_size;
+    instance->position.y = position.y * pixel_size;
+    instance->position.z = position.z * pixel_size;
+    instance->size.x = size.x * pixel_size;
+    instance->size.y = size.y * pixel_size;
+    instance->origin.x = origin.x * pixel_size;
+    instance->origin.y = origin.y * pixel_size;
+    instance->angle_radians = DegreesToRadians(angle_degrees);
+    instance->tex_rect[0] = (uint16_t)(sprite.texture_x * 65535.0f + 0.5f);
+    instance->tex_rect[1] = (uint16_t)(sprite.texture_y * 65535.0f + 0.5f);
+    instance->tex_rect[2] = (uint16_t)(sprite.texture_w * 65535.0f + 0.5f);
+    instance->tex_rect[3] = (uint16_t)(sprite.texture_h * 65535.0f + 0.5f);
+    instance->colour = PackColour(colour);
+    instance->texture_slot = batch.current_texture_slot;
+    instance->texture_layer = (float)GetSpriteTextureLayer(sprite, sprite_sheet_layer);
+
+    batch.instance_buffer_ptr++;
+    batch.instance_count++;
+}
+
+void Graphics::GetSpriteTexCoords(const Sprite& sprite, float* u, float* v)
+{
+    // in the order the quads are written: bottom right, top right, top left, bottom left
+    float left = sprite.texture_x;
+    float top = sprite.texture_y;
+    float right = sprite.texture_x + sprite.texture_w;
+    float bottom = sprite.texture_y + sprite.texture_h;
+
+    if(sprite.rotated)
+    {
+        // turned clockwise, the sprite's top edge is down the right side of the texture rect
+        u[0] = left;  v[0] = bottom;
+        u[1] = right; v[1] = bottom;
+        u[2] = right; v[2] = top;
+        u[3] = left;  v[3] = top;
+        return;
+    }
+
+    u[0] = right; v[0] = bottom;
+    u[1] = right; v[1] = top;
+    u[2] = left;  v[2] = top;
+    u[3] = left;  v[3] = bottom;
+}
+
+GLuint Graphics::GetSpriteTextureID(const Sprite& sprite, const SpriteSheetLayer sprite_sheet_layer)
+{
+    // every layer of a sheet in a texture array is the same texture
+    if(sprite.sprite_sheet->texture_array) return sprite.sprite_sheet->texture_array->ID;
+    if(sprite_sheet_layer == SPECULAR) return sprite.sprite_sheet->specular->ID;
+    if(sprite_sheet_layer == NORMAL) return sprite.sprite_sheet->normal->ID;
+    return sprite.sprite_sheet->diffuse->ID;
+}
+
+uint32_t Graphics::GetSpriteTextureLayer(const Sprite& sprite, const SpriteSheetLayer sprite_sheet_layer)
+{
+    if(!sprite.sprite_sheet->texture_array) return 0;
+    return sprite.sprite_sheet->array_layer + (uint32_t)sprite_sheet_layer;
+}
+
+void Graphics::RenderSprites(const SpriteDraw* sprites, const size_t count, const uint32_t frame_buffer_index)
+{
+    Capture::Scope capture_scope;
+    if(capture_scope.recording) Capture::Record(CAPTURE_RENDER_SPRITES, frame_buffer_index, CaptureArray<SpriteDraw>{ sprites, (uint32_t)count });
+    float pixel_size = 1.0f;
+    if(frame_buffers[frame_buffer_index].use_auto_scaling) pixel_size = Honeybear::game_scale;
+
+    size_t i = 0;
+    while(i < count)
+    {
+        // a run of sprites using the same texture only needs setting up once
+        GLuint texture_id = GetSpriteTextureID(*sprites[i].sprite, sprites[i].sprite_sheet_layer);
+        size_t run_end = i + 1;
+        while(run_end < count && GetSpriteTextureID(*sprites[run_end].sprite, sprites[run_end].sprite_sheet_layer) == texture_id)
+        {
+            run_end++;
+        }
+
+        while(i < run_end)
+        {
+            // fill what's left of the batch, if nothing fits DoBatchRenderSetUp starts a new one
+            size_t space = max_quad_count;
+            if(!draw_queue.recording && batch.index_count < max_index_count && batch.current_index_offset < max_vertex_count)
+            {
+                space = std::min((max_index_count - batch.index_count) / 6, (max_vertex_count - batch.current_index_offset) / 4);
+                if(space == 0) space = max_quad_count;
+            }
+            size_t quad_count = std::min(run_end - i, space);
+
+            DoBatchRenderSetUp(frame_buffer_index, texture_id, quad_count * 6, quad_count * 4);
+            WriteSpriteQuads(sprites + i, quad_count, pixel_size);
+            i += quad_count;
+        }
+    }
+}
+
+void Graphics::WriteSpriteQuads(const SpriteDraw* sprites, const size_t count, const float pixel_size)
+{
+    for(size_t i = 0; i < count; i += 4)
+    {
+        const SpriteDraw* block = sprites + i;
+        size_t block_count = std::min(count - i, (size_t)4);
+
+        float cos_angles[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+        float sin_angles[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        for(size_t j = 0; j < block_count; ++j)
+        {
+            if(block[j].angle_degrees != 0.0f)
+            {
+                float angle_rad = DegreesToRadians(block[j].angle_degrees);
+                cos_angles[j] = std::cos(angle_rad);
+                sin_angles[j] = std::sin(angle_rad);
+            }
+        }
+
+        // [corner][sprite], corners in the same order RenderSprite writes them: bottom right, top right, top left, bottom left
+        float xs[4][4];
+        float ys[4][4];
+
+        #ifdef HONEYBEAR_SSE
+        if(block_count == 4)
+        {
+            // corner = position + rotate(local corner), all scaled by the pixel size, for four sprites at once
+            __m128 scale = _mm_set1_ps(pixel_size);
+            __m128 cos_angle = _mm_loadu_ps(cos_angles);
+            __m128 sin_angle = _mm_loadu_ps(sin_angles);
+            __m128 position_x = _mm_set_ps(block[3].position.x, block[2].position.x, block[1].position.x, block[0].position.x);
+            __m128 position_y = _mm_set_ps(block[3].position.y, block[2].position.y, block[1].position.y, block[0].position.y);
+            __m128 left = _mm_set_ps(-block[3].origin.x, -block[2].origin.x, -block[1].origin.x, -block[0].origin.x);
+            __m128 top = _mm_set_ps(-block[3].origin.y, -block[2].origin.y, -block[1].origin.y, -block[0].origin.y);
+            __m128 right = _mm_add_ps(left, _mm_set_ps(block[3].size.x, block[2].size.x, block[1].size.x, block[0].size.x));
+            __m128 bottom = _mm_add_ps(top, _mm_set_ps(block[3].size.y, block[2].size.y, block[1].size.y, block[0].size.y));
+
+            __m128 corner_x[4] = { right, right, left, left };
+            __m128 corner_y[4] = { bottom, top, top, bottom };
+            for(size_t c = 0; c < 4; ++c)
+            {
+                __m128 x = _mm_sub_ps(_mm_mul_ps(corner_x[c], cos_angle), _mm_mul_ps(corner_y[c], sin_angle));
+                __m128 y = _mm_add_ps(_mm_mul_ps(corner_x[c], sin_angle), _mm_mul_ps(corner_y[c], cos_angle));
+                _mm_storeu_ps(xs[c], _mm_mul_ps(_mm_add_ps(position_x, x), scale));
+                _mm_storeu_ps(ys[c], _mm_mul_ps(_mm_add_ps(position_y, y), scale));
+            }
+        }
+        else
+        #endif
+        {
+            for(size_t j = 0; j < block_count; ++j)
+            {
+                float left = -block[j].origin.x;
+                float top = -block[j].origin.y;
+                float right = left + block[j].size.x;
+                float bottom = top + block[j].size.y;
+
+                float corner_x[4] = { right, right, left, left };
+                float corner_y[4] = { bottom, top, top, bottom };
+                for(size_t c = 0; c < 4; ++c)
+                {
+                    xs[c][j] = (block[j].position.x + corner_x[c] * cos_angles[j] - corner_y[c] * sin_angles[j]) * pixel_size;
+                    ys[c][j] = (block[j].position.y + corner_x[c] * sin_angles[j] + corner_y[c] * cos_angles[j]) * pixel_size;
+                }
+            }
+        }
+
+        for(size_t j = 0; j < block_count; ++j)
+        {
+            const Sprite& sprite = *block[j].sprite;
+            float z = block[j].position.z * pixel_size;
+            BatchColour batch_colour = MakeBatchColour(block[j].colour);
+
+            float u[4];
+            float v[4];
+            GetSpriteTexCoords(sprite, u, v);
+
+            // a run can cover several sheets and layers of the same texture array
+            batch.current_texture_layer = GetSpriteTextureLayer(sprite, block[j].sprite_sheet_layer);
+
+            for(size_t c = 0; c < 4; ++c)
+            {
+                PushBatchVertex(xs[c][j], ys[c][j], z, u[c], v[c], batch_colour);
+            }
+
+            WriteQuadIndices();
+        }
+    }
+}
+
+Graphics::BatchColour Graphics::MakeBatchColour(const Vec4& colour)
+{
+    #ifdef HONEYBEAR_PACKED_VERTICES
+    return PackColour(colour);
+    #else
+    return colour;
+    #endif
+}
+
+void Graphics::PushBatchVertex(const float x, const float y, const float z, const float u, const float v, const BatchColour& colour)
+{
+    BatchVertex* vertex = batch.buffer_ptr;
+
+    #ifdef HONEYBEAR_PACKED_VERTICES
+    vertex->position.x = x;
+    vertex->position.y = y;
+    vertex->tex_coords[0] = (uint16_t)(std::min(std::max(u, 0.0f), 1.0f) * 65535.0f + 0.5f);
+    vertex->tex_coords[1] = (uint16_t)(std::min(std::max(v, 0.0f), 1.0f) * 65535.0f + 0.5f);
+    vertex->colour = colour;
+    vertex->z = FloatToHalf(z);
+    #else
+    vertex->position.x = x;
+    vertex->position.y = y;
+    vertex->position.z = z;
+    vertex->tex_coords.x = u;
+    vertex->tex_coords.y = v;
+    vertex->colour = colour;
+    #endif
+    vertex->packed_indices = batch.current_texture_slot | (batch.current_texture_layer << VERTEX_TEXTURE_LAYER_SHIFT) | (batch.current_material_index << VERTEX_MATERIAL_INDEX_SHIFT);
+
+    batch.buffer_ptr++;
+}
+
+uint32_t Graphics::PackColour(const Vec4& colour)
+{
+    uint32_t r = (uint32_t)(std::min(std::max(colour.x, 0.0f), 1.0f) * 255.0f + 0.5f);
+    uint32_t g = (uint32_t)(std::min(std::max(colour.y, 0.0f), 1.0f) * 255.0f + 0.5f);
+    uint32_t b = (uint32_t)(std::min(std::max(colour.z, 0.0f), 1.0f) * 255.0f + 0.5f);
+    uint32_t a = (uint32_t)(std::min(std::max(colour.w, 0.0f), 1.0f) * 255.0f + 0.5f);
+    return r | (g << 8) | (b << 16) | (a << 24);
 }
 
 void Graphics::FillTriangle(const Vec2& pos_a, const Vec2& pos_b, const Vec2& pos_c, const uint32_t frame_buffer_index, const Vec4& colour)
 {
+    Capture::Scope capture_scope;
+    if(capture_scope.recording) Capture::Record(CAPTURE_FILL_TRIANGLE, pos_a, pos_b, pos_c, frame_buffer_index, colour);
     int indices_count = 3;
 
-    DoBatchRenderSetUp(frame_buffer_index, batch.shape_texture, indices_count);
+    DoBatchRenderSetUp(frame_buffer_index, batch.shape_texture, indices_count, 3);
+    UseDynamicIndices();
 
     //float pixel_size = frame_buffers[frame_buffer_index].auto_scaling_value;
     float pixel_size = 1.0f;
     if(frame_buffers[frame_buffer_index].use_auto_scaling) pixel_size = Honeybear::game_scale;
+    BatchColour batch_colour = MakeBatchColour(colour);
 
-    batch.buffer_ptr->position.x = pos_a.x * pixel_size;
-    batch.buffer_ptr->position.y = pos_a.y * pixel_size;
-    batch.buffer_ptr->tex_coords.x = 0.0f;
-    batch.buffer_ptr->tex_coords.y = 0.0f;
-    batch.buffer_ptr->colour = colour;
-    batch.buffer_ptr++;
+    PushBatchVertex(pos_a.x * pixel_size, pos_a.y * pixel_size, 0.0f, 0.0f, 0.0f, batch_colour);
 
-    batch.buffer_ptr->position.x = pos_b.x * pixel_size;
-    batch.buffer_ptr->position.y = pos_b.y * pixel_size;
-    batch.buffer_ptr->tex_coords.x = 0.0f;
-    batch.buffer_ptr->tex_coords.y = 0.0f;
-    batch.buffer_ptr->colour = colour;
-    batch.buffer_ptr++;
+    PushBatchVertex(pos_b.x * pixel_size, pos_b.y * pixel_size, 0.0f, 0.0f, 0.0f, batch_colour);
 
-    batch.buffer_ptr->position.x = pos_c.x * pixel_size;
-    batch.buffer_ptr->position.y = pos_c.y * pixel_size;
-    batch.buffer_ptr->tex_coords.x = 0.0f;
-    batch.buffer_ptr->tex_coords.y = 0.0f;
-    batch.buffer_ptr->colour = colour;
-    batch.buffer_ptr++;
+    PushBatchVertex(pos_c.x * pixel_size, pos_c.y * pixel_size, 0.0f, 0.0f, 0.0f, batch_colour);
 
     batch.index_buffer[batch.index_count + 0] = 0 + batch.current_index_offset;
     batch.index_buffer[batch.index_count + 1] = 1 + batch.current_index_offset;
@@ -963,66 +2243,36 @@ void Graphics::FillRect(const float x, const float y, const float w, const float
 
 void Graphics::FillRect(const float x, const float y, const float z, const float w, const float h, const uint32_t frame_buffer_index, const Vec4& colour)
 {
+    Capture::Scope capture_scope;
+    if(capture_scope.recording) Capture::Record(CAPTURE_FILL_RECT, x, y, z, w, h, frame_buffer_index, colour);
     int indices_count = 6;
 
-    DoBatchRenderSetUp(frame_buffer_index, batch.shape_texture, indices_count);
+    DoBatchRenderSetUp(frame_buffer_index, batch.shape_texture, indices_count, 4);
 
     //float pixel_size = frame_buffers[frame_buffer_index].auto_scaling_value;
     float pixel_size = 1.0f;
     if(frame_buffers[frame_buffer_index].use_auto_scaling) pixel_size = Honeybear::game_scale;
+    BatchColour batch_colour = MakeBatchColour(colour);
 
     // bottom right
-    batch.buffer_ptr->position.x = (x + w) * pixel_size;
-    batch.buffer_ptr->position.y = (y + h) * pixel_size;
-    batch.buffer_ptr->position.z = z * pixel_size;
-    batch.buffer_ptr->tex_coords.x = 1.0f;
-    batch.buffer_ptr->tex_coords.y = 1.0f;
-    batch.buffer_ptr->colour = colour;
-    batch.buffer_ptr++;
+    PushBatchVertex((x + w) * pixel_size, (y + h) * pixel_size, z * pixel_size, 1.0f, 1.0f, batch_colour);
 
     // top right
-    batch.buffer_ptr->position.x = (x + w) * pixel_size;
-    batch.buffer_ptr->position.y = y * pixel_size;
-    batch.buffer_ptr->position.z = z * pixel_size;
-    batch.buffer_ptr->tex_coords.x = 1.0f;
-    batch.buffer_ptr->tex_coords.y = 0.0f;
-    batch.buffer_ptr->colour = colour;
-    batch.buffer_ptr++;
+    PushBatchVertex((x + w) * pixel_size, y * pixel_size, z * pixel_size, 1.0f, 0.0f, batch_colour);
 
     // top left
-    batch.buffer_ptr->position.x = x * pixel_size;
-    batch.buffer_ptr->position.y = y * pixel_size;
-    batch.buffer_ptr->position.z = z * pixel_size;
-    batch.buffer_ptr->tex_coords.x = 0.0f;
-    batch.buffer_ptr->tex_coords.y = 0.0f;
-    batch.buffer_ptr->colour = colour;
-    batch.buffer_ptr++;
+    PushBatchVertex(x * pixel_size, y * pixel_size, z * pixel_size, 0.0f, 0.0f, batch_colour);
 
     // bottom left
-    batch.buffer_ptr->position.x = x * pixel_size;
-    batch.buffer_ptr->position.y = (y + h) * pixel_size;
-    batch.buffer_ptr->position.z = z * pixel_size;
-    batch.buffer_ptr->tex_coords.x = 0.0f;
-    batch.buffer_ptr->tex_coords.y = 1.0f;
-    batch.buffer_ptr->colour = colour;
-    batch.buffer_ptr++;
-
-    // first tri indices
-    batch.index_buffer[batch.index_count + 0] = 0 + batch.current_index_offset;
-    batch.index_buffer[batch.index_count + 1] = 1 + batch.current_index_offset;
-    batch.index_buffer[batch.index_count + 2] = 3 + batch.current_index_offset;
-
-    // second tri indices
-    batch.index_buffer[batch.index_count + 3] = 1 + batch.current_index_offset;
-    batch.index_buffer[batch.index_count + 4] = 2 + batch.current_index_offset;
-    batch.index_buffer[batch.index_count + 5] = 3 + batch.current_index_offset;
+    PushBatchVertex(x * pixel_size, (y + h) * pixel_size, z * pixel_size, 0.0f, 1.0f, batch_colour);
 
-    batch.current_index_offset += 4;
-    batch.index_count += indices_count;
+    WriteQuadIndices();
 }
 
 void Graphics::FillCircle(const Vec2& pos, const float radius, const uint32_t frame_buffer_index, const Vec4& colour)
 {
+    Capture::Scope capture_scope;
+    if(capture_scope.recording) Capture::Record(CAPTURE_FILL_CIRCLE, pos, radius, frame_buffer_index, colour);
     if(!(radius > 0.0f))
     {
         return;
@@ -1031,78 +2281,131 @@ void Graphics::FillCircle(const Vec2& pos, const float radius, const uint32_t fr
     //float pixel_size = frame_buffers[frame_buffer_index].auto_scaling_value;
     float pixel_size = 1.0f;
     if(frame_buffers[frame_buffer_index].use_auto_scaling) pixel_size = Honeybear::game_scale;
+    BatchColour batch_colour = MakeBatchColour(colour);
 
-    // -----------------------------
-    // the below formula was taken from here: https://stackoverflow.com/questions/11774038/how-to-render-a-circle-with-as-few-vertices-as-possible
-    float error = 0.25f;
-    float th = std::acos(2 * ((1 - error / (radius * pixel_size)) * (1 - error / (radius * pixel_size))) - 1);
-    int number_of_sides = std::ceil(2 * PI / th);
-    // -----------------------------
+    UnitCircle circle = GetUnitCircle(CircleSidesForRadius(radius * pixel_size));
 
-    float angle_per_side = 360.0f / number_of_sides;
+    int indices_count = circle.sides * 3;
 
-    int indices_count = number_of_sides * 3;
+    DoBatchRenderSetUp(frame_buffer_index, batch.shape_texture, indices_count, circle.sides + 1);
+    UseDynamicIndices();
 
-    DoBatchRenderSetUp(frame_buffer_index, batch.shape_texture, indices_count);
+    float centre_x = pos.x * pixel_size;
+    float centre_y = pos.y * pixel_size;
+    float scaled_radius = radius * pixel_size;
 
     // center
-    batch.buffer_ptr->position.x = pos.x * pixel_size;
-    batch.buffer_ptr->position.y = pos.y * pixel_size;
-    batch.buffer_ptr->tex_coords.x = 0.0f;
-    batch.buffer_ptr->tex_coords.y = 0.0f;
-    batch.buffer_ptr->colour = colour;
-    batch.buffer_ptr++;
+    PushBatchVertex(centre_x, centre_y, 0.0f, 0.0f, 0.0f, batch_colour);
+
+    // all the others, the last triangle wraps back round to the first edge vertex
+    for(int i = 0; i < circle.sides; ++i)
+    {
+        PushBatchVertex(centre_x + circle.x[i] * scaled_radius, centre_y + circle.y[i] * scaled_radius, 0.0f, 0.0f, 0.0f, batch_colour);
+
+        batch.index_buffer[batch.index_count + 0] = batch.current_index_offset + 0;
+        batch.index_buffer[batch.index_count + 1] = batch.current_index_offset + 1 + i;
+        batch.index_buffer[batch.index_count + 2] = batch.current_index_offset + (i + 1 < circle.sides ? 2 + i : 1);
+
+        batch.index_count += 3;
+    }
 
-    // all the others
-    for(size_t i = 0; i < number_of_sides; ++i)
+    batch.current_index_offset += circle.sides + 1;
+}
+
+void Graphics::FillPie(const Vec2& pos, const float radius, const float start_degrees, const float end_degrees, const uint32_t frame_buffer_index, const Vec4& colour)
+{
+    Capture::Scope capture_scope;
+    if(capture_scope.recording) Capture::Record(CAPTURE_FILL_PIE, pos, radius, start_degrees, end_degrees, frame_buffer_index, colour);
+    if(!(radius > 0.0f) || start_degrees == end_degrees)
     {
-        float degrees = i * angle_per_side;
+        return;
+    }
+
+    //float pixel_size = frame_buffers[frame_buffer_index].auto_scaling_value;
+    float pixel_size = 1.0f;
+    if(frame_buffers[frame_buffer_index].use_auto_scaling) pixel_size = Honeybear::game_scale;
+    BatchColour batch_colour = MakeBatchColour(colour);
+
+    Vec2 points[UNIT_CIRCLE_MAX_SIDES + 2];
+    int number_of_points = GetArcPoints(GetUnitCircle(CircleSidesForRadius(radius * pixel_size)), start_degrees, end_degrees, points);
+
+    int indices_count = (number_of_points - 1) * 3;
+
+    DoBatchRenderSetUp(frame_buffer_index, batch.shape_texture, indices_count, number_of_points + 1);
+    UseDynamicIndices();
 
-        float radians = degrees * (PI / 180.0f);
+    float centre_x = pos.x * pixel_size;
+    float centre_y = pos.y * pixel_size;
+    float scaled_radius = radius * pixel_size;
 
-        batch.buffer_ptr->position.x = (pos.x + std::cos(radians) * radius) * pixel_size;
-        batch.buffer_ptr->position.y = (pos.y + std::sin(radians) * radius) * pixel_size;
-        batch.buffer_ptr->tex_coords.x = 0.0f;
-        batch.buffer_ptr->tex_coords.y = 0.0f;
-        batch.buffer_ptr->colour = colour;
-        batch.buffer_ptr++;
+    // center
+    PushBatchVertex(centre_x, centre_y, 0.0f, 0.0f, 0.0f, batch_colour);
+
+    for(int i = 0; i < number_of_points; ++i)
+    {
+        PushBatchVertex(centre_x + points[i].x * scaled_radius, centre_y + points[i].y * scaled_radius, 0.0f, 0.0f, 0.0f, batch_colour);
+    }
 
+    for(int i = 0; i < number_of_points - 1; ++i)
+    {
         batch.index_buffer[batch.index_count + 0] = batch.current_index_offset + 0;
-        batch.index_buffer[batch.index_count + 1] = batch.current_index_offset + 1 * i;
-        batch.index_buffer[batch.index_count + 2] = batch.current_index_offset + 1 * (i + 1);
+        batch.index_buffer[batch.index_count + 1] = batch.current_index_offset + 1 + i;
+        batch.index_buffer[batch.index_count + 2] = batch.current_index_offset + 2 + i;
 
         batch.index_count += 3;
     }
 
-    batch.index_buffer[batch.index_count + 0] = batch.current_index_offset + 0;
-    batch.index_buffer[batch.index_count + 1] = batch.current_index_offset + number_of_sides;
-    batch.index_buffer[batch.index_count + 2] = batch.current_index_offset + 1;
+    batch.current_index_offset += number_of_points + 1;
+}
+
+int Graphics::GetArcPoints(const UnitCircle& circle, const float start_degrees, const float end_degrees, Vec2* points)
+{
+    // always sweeps anticlockwise from start to end, never more than all the way round
+    float start = DegreesToRadians(start_degrees);
+    float sweep = DegreesToRadians(end_degrees) - start;
+    if(sweep < 0.0f) sweep = std::fmod(sweep, 2.0f * (float)PI) + 2.0f * (float)PI;
+    if(sweep > 2.0f * (float)PI) sweep = 2.0f * (float)PI;
+    float end = start + sweep;
+
+    float step = 2.0f * (float)PI / circle.sides;
+
+    int number_of_points = 0;
+
+    // the two ends are exact, everything between them comes straight from the table
+    points[number_of_points++] = Vec2(std::cos(start), std::sin(start));
+
+    int first = (int)std::floor(start / step) + 1;
+    int last = (int)std::ceil(end / step) - 1;
+    for(int i = first; i <= last && number_of_points < circle.sides + 1; ++i)
+    {
+        int table_index = ((i % circle.sides) + circle.sides) % circle.sides;
+        points[number_of_points++] = Vec2(circle.x[table_index], circle.y[table_index]);
+    }
 
-    batch.index_count += 3;
+    points[number_of_points++] = Vec2(std::cos(end), std::sin(end));
 
-    batch.current_index_offset += number_of_sides + 1;
+    return number_of_points;
 }
 
 void Graphics::FillConvexPoly(const std::vector<Vec2>& points, const uint32_t frame_buffer_index, const Vec4& colour)
 {
+    Capture::Scope capture_scope;
+    if(capture_scope.recording) Capture::Record(CAPTURE_FILL_CONVEX_POLY, CaptureArray<Vec2>{ points.data(), (uint32_t)points.size() }, frame_buffer_index, colour);
     int tri_count = points.size() - 2;
     int indices_count = tri_count * 3;
 
-    DoBatchRenderSetUp(frame_buffer_index, batch.shape_texture, indices_count);
+    DoBatchRenderSetUp(frame_buffer_index, batch.shape_texture, indices_count, points.size());
+    UseDynamicIndices();
 
     //float pixel_size = frame_buffers[frame_buffer_index].auto_scaling_value;
     float pixel_size = 1.0f;
     if(frame_buffers[frame_buffer_index].use_auto_scaling) pixel_size = Honeybear::game_scale;
+    BatchColour batch_colour = MakeBatchColour(colour);
 
     // set up vertices
     for(size_t i = 0; i < points.size(); ++i)
     {
-        batch.buffer_ptr->position.x = points[i].x * pixel_size;
-        batch.buffer_ptr->position.y = points[i].y * pixel_size;
-        batch.buffer_ptr->tex_coords.x = 0.0f;
-        batch.buffer_ptr->tex_coords.y = 0.0f;
-        batch.buffer_ptr->colour = colour;
-        batch.buffer_ptr++;
+        PushBatchVertex(points[i].x * pixel_size, points[i].y * pixel_size, 0.0f, 0.0f, 0.0f, batch_colour);
     }
 
     // set up indices
@@ -1121,7 +2424,8 @@ void Graphics::FillConvexPoly(const std::vector<Vec2>& points, const uint32_t fr
 // todo: DrawCustom and FillCustom are kinda the same thing
 void Graphics::DrawCustom(size_t num_verts, Vec3* positions, Vec2* tex_coords, Vec4* colours, size_t num_indices, int* indices, const uint32_t frame_buffer_index)
 {
-    DoBatchRenderSetUp(frame_buffer_index, batch.shape_texture, num_indices, LINES);
+    DoBatchRenderSetUp(frame_buffer_index, batch.shape_texture, num_indices, num_verts, LINES);
+    UseDynamicIndices();
 
     //float pixel_size = frame_buffers[frame_buffer_index].auto_scaling_value;
     float pixel_size = 1.0f;
@@ -1129,12 +2433,7 @@ void Graphics::DrawCustom(size_t num_verts, Vec3* positions, Vec2* tex_coords, V
 
     for(size_t i = 0; i < num_verts; ++i)
     {
-        batch.buffer_ptr->position.x = positions[i].x * pixel_size;
-        batch.buffer_ptr->position.y = positions[i].y * pixel_size;
-        batch.buffer_ptr->position.z = positions[i].z * pixel_size;
-        batch.buffer_ptr->tex_coords = tex_coords[i];
-        batch.buffer_ptr->colour     = colours[i];
-        batch.buffer_ptr++;
+        PushBatchVertex(positions[i].x * pixel_size, positions[i].y * pixel_size, positions[i].z * pixel_size, tex_coords[i].x, tex_coords[i].y, MakeBatchColour(colours[i]));
     }
 
     for(size_t i = 0; i < num_indices; ++i)
@@ -1150,246 +2449,1555 @@ void Graphics::FillCustom(size_t num_verts, Vec3* positions, Vec2* tex_coords, V
 {
     GLuint tex_id;
 
-    if(texture_id == -1)
+    if(texture_id == -1)
+    {
+        tex_id = batch.shape_texture;
+    }
+    else
+    {
+        tex_id = texture_id;
+    }
+
+    DoBatchRenderSetUp(frame_buffer_index, tex_id, num_indices, num_verts, TEXTURE);
+    UseDynamicIndices();
+
+    //float pixel_size = frame_buffers[frame_buffer_index].auto_scaling_value;
+    float pixel_size = 1.0f;
+    if(frame_buffers[frame_buffer_index].use_auto_scaling) pixel_size = Honeybear::game_scale;
+
+    for(size_t i = 0; i < num_verts; ++i)
+    {
+        PushBatchVertex(positions[i].x * pixel_size, positions[i].y * pixel_size, positions[i].z * pixel_size, tex_coords[i].x, tex_coords[i].y, MakeBatchColour(colours[i]));
+    }
+
+    for(size_t i = 0; i < num_indices; ++i)
+    {
+        batch.index_buffer[batch.index_count] = batch.current_index_offset + indices[i];
+        batch.index_count++;
+    }
+
+    batch.current_index_offset += num_verts;
+}
+
+void Graphics::DrawLine(const Vec2& start, const Vec2& end, const uint32_t frame_buffer_index, const Vec4& colour)
+{
+    Capture::Scope capture_scope;
+    if(capture_scope.recording) Capture::Record(CAPTURE_DRAW_LINE, start, end, frame_buffer_index, colour);
+    // a two point strip, so single lines don't break up a batch of outlines
+    Vec2 points[2] = { start, end };
+    DrawLineStrip(points, 2, false, frame_buffer_index, colour);
+}
+
+void Graphics::DrawLineStrip(const Vec2* points, const size_t number_of_points, const bool closed, const uint32_t frame_buffer_index, const Vec4& colour)
+{
+    Capture::Scope capture_scope;
+    if(capture_scope.recording) Capture::Record(CAPTURE_DRAW_LINE_STRIP, CaptureArray<Vec2>{ points, (uint32_t)number_of_points }, closed, frame_buffer_index, colour);
+    if(number_of_points < 2)
+    {
+        return;
+    }
+
+    // too long for one batch, draw it as strips that share their end points and close it with a last segment
+    const size_t max_strip_points = std::min(max_index_count - 2, max_vertex_count);
+    if(number_of_points > max_strip_points)
+    {
+        for(size_t first = 0; first + 1 < number_of_points; first += max_strip_points - 1)
+        {
+            DrawLineStrip(points + first, std::min(max_strip_points, number_of_points - first), false, frame_buffer_index, colour);
+        }
+
+        if(closed)
+        {
+            Vec2 closing[2] = { points[number_of_points - 1], points[0] };
+            DrawLineStrip(closing, 2, false, frame_buffer_index, colour);
+        }
+        return;
+    }
+
+    // closing the loop repeats the first index, then the restart index ends the strip
+    int indices_count = number_of_points + (closed ? 1 : 0) + 1;
+
+    DoBatchRenderSetUp(frame_buffer_index, batch.shape_texture, indices_count, number_of_points, LINE_STRIPS);
+    UseDynamicIndices();
+
+    //float pixel_size = frame_buffers[frame_buffer_index].auto_scaling_value;
+    float pixel_size = 1.0f;
+    if(frame_buffers[frame_buffer_index].use_auto_scaling) pixel_size = Honeybear::game_scale;
+    BatchColour batch_colour = MakeBatchColour(colour);
+
+    for(size_t i = 0; i < number_of_points; ++i)
+    {
+        PushBatchVertex(points[i].x * pixel_size, points[i].y * pixel_size, 0.0f, 0.0f, 0.0f, batch_colour);
+        batch.index_buffer[batch.index_count++] = batch.current_index_offset + i;
+    }
+
+    if(closed)
+    {
+        batch.index_buffer[batch.index_count++] = batch.current_index_offset;
+    }
+
+    batch.index_buffer[batch.index_count++] = PRIMITIVE_RESTART_INDEX;
+
+    batch.current_index_offset += number_of_points;
+}
+
+void Graphics::DrawRect(const float x, const float y, const float w, const float h, const uint32_t frame_buffer_index, const Vec4& colour)
+{
+    Capture::Scope capture_scope;
+    if(capture_scope.recording) Capture::Record(CAPTURE_DRAW_RECT, x, y, w, h, frame_buffer_index, colour);
+    Vec2 points[4] = { Vec2(x, y), Vec2(x + w, y), Vec2(x + w, y + h), Vec2(x, y + h) };
+    DrawLineStrip(points, 4, true, frame_buffer_index, colour);
+}
+
+void Graphics::DrawCircle(const Vec2& pos, const float radius, const uint32_t frame_buffer_index, const Vec4& colour)
+{
+    Capture::Scope capture_scope;
+    if(capture_scope.recording) Capture::Record(CAPTURE_DRAW_CIRCLE, pos, radius, frame_buffer_index, colour);
+    if(!(radius > 0.0f))
+    {
+        return;
+    }
+
+    //float pixel_size = frame_buffers[frame_buffer_index].auto_scaling_value;
+    float pixel_size = 1.0f;
+    if(frame_buffers[frame_buffer_index].use_auto_scaling) pixel_size = Honeybear::game_scale;
+
+    UnitCircle circle = GetUnitCircle(CircleSidesForRadius(radius * pixel_size));
+
+    Vec2 points[UNIT_CIRCLE_MAX_SIDES];
+    for(int i = 0; i < circle.sides; ++i)
+    {
+        points[i] = Vec2(pos.x + circle.x[i] * radius, pos.y + circle.y[i] * radius);
+    }
+
+    DrawLineStrip(points, circle.sides, true, frame_buffer_index, colour);
+}
+
+void Graphics::DrawArc(const Vec2& pos, const float radius, const float start_degrees, const float end_degrees, const uint32_t frame_buffer_index, const Vec4& colour)
+{
+    Capture::Scope capture_scope;
+    if(capture_scope.recording) Capture::Record(CAPTURE_DRAW_ARC, pos, radius, start_degrees, end_degrees, frame_buffer_index, colour);
+    if(!(radius > 0.0f) || start_degrees == end_degrees)
+    {
+        return;
+    }
+
+    //float pixel_size = frame_buffers[frame_buffer_index].auto_scaling_value;
+    float pixel_size = 1.0f;
+    if(frame_buffers[frame_buffer_index].use_auto_scaling) pixel_size = Honeybear::game_scale;
+
+    Vec2 points[UNIT_CIRCLE_MAX_SIDES + 2];
+    int number_of_points = GetArcPoints(GetUnitCircle(CircleSidesForRadius(radius * pixel_size)), start_degrees, end_degrees, points);
+
+    for(int i = 0; i < number_of_points; ++i)
+    {
+        points[i] = pos + points[i] * radius;
+    }
+
+    DrawLineStrip(points, number_of_points, false, frame_buffer_index, colour);
+}
+
+void Graphics::DrawPoly(const std::vector<Vec2>& points, const uint32_t frame_buffer_index, const Vec4& colour)
+{
+    Capture::Scope capture_scope;
+    if(capture_scope.recording) Capture::Record(CAPTURE_DRAW_POLY, CaptureArray<Vec2>{ points.data(), (uint32_t)points.size() }, frame_buffer_index, colour);
+    DrawLineStrip(points.data(), points.size(), true, frame_buffer_index, colour);
+}
+
+void Graphics::DrawPolyline(const std::vector<Vec2>& points, const float width, const LineJoin join, const LineCap cap, const bool closed, const uint32_t frame_buffer_index, const Vec4& colour)
+{
+    Capture::Scope capture_scope;
+    if(capture_scope.recording) Capture::Record(CAPTURE_DRAW_POLYLINE, CaptureArray<Vec2>{ points.data(), (uint32_t)points.size() }, width, join, cap, closed, frame_buffer_index, colour);
+    if(!(width > 0.0f))
+    {
+        return;
+    }
+
+    //float pixel_size = frame_buffers[frame_buffer_index].auto_scaling_value;
+    float pixel_size = 1.0f;
+    if(frame_buffers[frame_buffer_index].use_auto_scaling) pixel_size = Honeybear::game_scale;
+    BatchColour batch_colour = MakeBatchColour(colour);
+
+    // scratch space reused between calls, the geometry is built here first so it can go into the batch in one go
+    thread_local std::vector<Vec2> path;
+    thread_local std::vector<Vec2> directions;
+    thread_local std::vector<Vec2> positions;
+    thread_local std::vector<uint32_t> indices;
+    path.clear();
+    directions.clear();
+    positions.clear();
+    indices.clear();
+
+    // repeated points have no direction
+    for(size_t i = 0; i < points.size(); ++i)
+    {
+        if(path.empty() || !(points[i] == path.back())) path.push_back(points[i]);
+    }
+
+    bool is_closed = closed;
+    if(is_closed && path.size() > 1 && path.front() == path.back()) path.pop_back();
+    if(path.size() < 3) is_closed = false;
+    if(path.size() < 2) return;
+
+    size_t number_of_points = path.size();
+    size_t number_of_segments = is_closed ? number_of_points : number_of_points - 1;
+    for(size_t i = 0; i < number_of_segments; ++i)
+    {
+        directions.push_back((path[(i + 1) % number_of_points] - path[i]).Normalised());
+    }
+
+    float half_width = width * 0.5f;
+    UnitCircle circle = GetUnitCircle(CircleSidesForRadius(half_width * pixel_size));
+    Vec2 arc_points[UNIT_CIRCLE_MAX_SIDES + 2];
+
+    auto add_vertex = [&](const Vec2& position)
+    {
+        positions.push_back(position);
+        return (uint32_t)(positions.size() - 1);
+    };
+
+    // fan out from the centre round the arc, the arc always goes anticlockwise
+    auto add_fan = [&](const uint32_t centre, const Vec2& arc_centre, const float start_degrees, const float end_degrees)
+    {
+        int number_of_arc_points = GetArcPoints(circle, start_degrees, end_degrees, arc_points);
+        uint32_t first = positions.size();
+        for(int i = 0; i < number_of_arc_points; ++i)
+        {
+            add_vertex(arc_centre + arc_points[i] * half_width);
+        }
+
+        for(int i = 0; i < number_of_arc_points - 1; ++i)
+        {
+            indices.push_back(centre);
+            indices.push_back(first + i);
+            indices.push_back(first + i + 1);
+        }
+    };
+
+    // each point ends the segment coming into it and starts the one going out, they only differ when the join needs extra triangles
+    struct PolylineJoint
+    {
+        uint32_t end_left;
+        uint32_t end_right;
+        uint32_t start_left;
+        uint32_t start_right;
+    };
+
+    thread_local std::vector<PolylineJoint> joints;
+    joints.resize(number_of_points);
+
+    for(size_t i = 0; i < number_of_points; ++i)
+    {
+        const Vec2& point = path[i];
+        PolylineJoint& joint = joints[i];
+
+        bool is_start = !is_closed && i == 0;
+        bool is_end = !is_closed && i == number_of_points - 1;
+
+        if(is_start || is_end)
+        {
+            Vec2 direction = is_start ? directions.front() : directions.back();
+            Vec2 normal(-direction.y, direction.x);
+
+            Vec2 base = point;
+            if(cap == SQUARE_CAP) base += direction * (is_start ? -half_width : half_width);
+
+            uint32_t left = add_vertex(base + normal * half_width);
+            uint32_t right = add_vertex(base - normal * half_width);
+            joint = { left, right, left, right };
+
+            if(cap == ROUND_CAP)
+            {
+                // half a circle round the back of the start or the front of the end
+                float normal_degrees = VectorToDegrees(is_start ? normal : normal.Negated());
+                add_fan(add_vertex(point), point, normal_degrees, normal_degrees + 180.0f);
+            }
+
+            continue;
+        }
+
+        Vec2 incoming = directions[(i + number_of_segments - 1) % number_of_segments];
+        Vec2 outgoing = directions[i % number_of_segments];
+        Vec2 incoming_normal(-incoming.y, incoming.x);
+        Vec2 outgoing_normal(-outgoing.y, outgoing.x);
+
+        float cross = incoming.x * outgoing.y - incoming.y * outgoing.x;
+        Vec2 miter = incoming_normal + outgoing_normal;
+
+        // (nearly) straight on, one pair does both segments
+        if(std::abs(cross) < 1e-4f && incoming.Dot(outgoing) > 0.0f)
+        {
+            uint32_t left = add_vertex(point + incoming_normal * half_width);
+            uint32_t right = add_vertex(point - incoming_normal * half_width);
+            joint = { left, right, left, right };
+            continue;
+        }
+
+        // a full turn back on itself has no miter, the inner point just sits on the line
+        float miter_length = 0.0f;
+        if(miter.SquaredMagnitude() > 1e-8f)
+        {
+            miter = miter.Normalised();
+            miter_length = half_width / miter.Dot(incoming_normal);
+        }
+
+        if(join == MITER_JOIN && miter_length > 0.0f && miter_length <= half_width * LINE_MITER_LIMIT)
+        {
+            uint32_t left = add_vertex(point + miter * miter_length);
+            uint32_t right = add_vertex(point - miter * miter_length);
+            joint = { left, right, left, right };
+            continue;
+        }
+
+        // bevel (and round), the inside of the turn still meets at the miter point and the outside gets filled in
+        float inner_side = cross > 0.0f ? 1.0f : -1.0f;
+        uint32_t inner = add_vertex(point + miter * (inner_side * std::min(miter_length, half_width * LINE_MITER_LIMIT)));
+        Vec2 outer_a = point - incoming_normal * (inner_side * half_width);
+        Vec2 outer_b = point - outgoing_normal * (inner_side * half_width);
+        uint32_t a = add_vertex(outer_a);
+        uint32_t b = add_vertex(outer_b);
+
+        if(inner_side > 0.0f) joint = { inner, a, inner, b };
+        else joint = { a, inner, b, inner };
+
+        if(join == ROUND_JOIN)
+        {
+            float a_degrees = VectorToDegrees(outer_a - point);
+            float b_degrees = VectorToDegrees(outer_b - point);
+            if(inner_side > 0.0f) add_fan(inner, point, a_degrees, b_degrees);
+            else add_fan(inner, point, b_degrees, a_degrees);
+        }
+        else
+        {
+            indices.push_back(inner);
+            indices.push_back(a);
+            indices.push_back(b);
+        }
+    }
+
+    for(size_t i = 0; i < number_of_segments; ++i)
+    {
+        const PolylineJoint& start = joints[i];
+        const PolylineJoint& end = joints[(i + 1) % number_of_points];
+
+        indices.push_back(start.start_left);
+        indices.push_back(start.start_right);
+        indices.push_back(end.end_right);
+
+        indices.push_back(start.start_left);
+        indices.push_back(end.end_right);
+        indices.push_back(end.end_left);
+    }
+
+    if(indices.size() <= max_index_count && positions.size() <= max_vertex_count)
+    {
+        DoBatchRenderSetUp(frame_buffer_index, batch.shape_texture, indices.size(), positions.size());
+        UseDynamicIndices();
+
+        for(size_t i = 0; i < positions.size(); ++i)
+        {
+            PushBatchVertex(positions[i].x * pixel_size, positions[i].y * pixel_size, 0.0f, 0.0f, 0.0f, batch_colour);
+        }
+
+        for(size_t i = 0; i < indices.size(); ++i)
+        {
+            batch.index_buffer[batch.index_count + i] = batch.current_index_offset + indices[i];
+        }
+
+        batch.index_count += indices.size();
+        batch.current_index_offset += positions.size();
+        return;
+    }
+
+    // too big for one batch, split it into unshared triangles across as many batches as it takes
+    const size_t max_chunk = (max_vertex_count / 3) * 3;
+    for(size_t first = 0; first < indices.size(); first += max_chunk)
+    {
+        size_t chunk = std::min(max_chunk, indices.size() - first);
+
+        DoBatchRenderSetUp(frame_buffer_index, batch.shape_texture, chunk, chunk);
+        UseDynamicIndices();
+
+        for(size_t i = 0; i < chunk; ++i)
+        {
+            const Vec2& position = positions[indices[first + i]];
+            PushBatchVertex(position.x * pixel_size, position.y * pixel_size, 0.0f, 0.0f, 0.0f, batch_colour);
+            batch.index_buffer[batch.index_count + i] = batch.current_index_offset + i;
+        }
+
+        batch.index_count += chunk;
+        batch.current_index_offset += chunk;
+    }
+}
+
+void Graphics::FillSmoothCircle(const Vec2& pos, const float radius, const uint32_t frame_buffer_index, const Vec4& colour)
+{
+    Capture::Scope capture_scope;
+    if(capture_scope.recording) Capture::Record(CAPTURE_FILL_SMOOTH_CIRCLE, pos, radius, frame_buffer_index, colour);
+    if(RecordDrawListCall([=]() { FillSmoothCircle(pos, radius, frame_buffer_index, colour); })) return;
+
+    PushShapeInstance(frame_buffer_index, pos, Vec2(radius), radius, 0.0f, 0.0f, colour);
+}
+
+void Graphics::DrawSmoothCircle(const Vec2& pos, const float radius, const float thickness, const uint32_t frame_buffer_index, const Vec4& colour)
+{
+    Capture::Scope capture_scope;
+    if(capture_scope.recording) Capture::Record(CAPTURE_DRAW_SMOOTH_CIRCLE, pos, radius, thickness, frame_buffer_index, colour);
+    if(RecordDrawListCall([=]() { DrawSmoothCircle(pos, radius, thickness, frame_buffer_index, colour); })) return;
+
+    PushShapeInstance(frame_buffer_index, pos, Vec2(radius), radius, thickness, 0.0f, colour);
+}
+
+void Graphics::FillRoundedRect(const float x, const float y, const float w, const float h, const float corner_radius, const uint32_t frame_buffer_index, const Vec4& colour)
+{
+    Capture::Scope capture_scope;
+    if(capture_scope.recording) Capture::Record(CAPTURE_FILL_ROUNDED_RECT, x, y, w, h, corner_radius, frame_buffer_index, colour);
+    if(RecordDrawListCall([=]() { FillRoundedRect(x, y, w, h, corner_radius, frame_buffer_index, colour); })) return;
+
+    float radius = std::min(corner_radius, std::min(w, h) * 0.5f);
+    PushShapeInstance(frame_buffer_index, Vec2(x + w * 0.5f, y + h * 0.5f), Vec2(w * 0.5f, h * 0.5f), radius, 0.0f, 0.0f, colour);
+}
+
+void Graphics::DrawRoundedRect(const float x, const float y, const float w, const float h, const float corner_radius, const float thickness, const uint32_t frame_buffer_index, const Vec4& colour)
+{
+    Capture::Scope capture_scope;
+    if(capture_scope.recording) Capture::Record(CAPTURE_DRAW_ROUNDED_RECT, x, y, w, h, corner_radius, thickness, frame_buffer_index, colour);
+    if(RecordDrawListCall([=]() { DrawRoundedRect(x, y, w, h, corner_radius, thickness, frame_buffer_index, colour); })) return;
+
+    float radius = std::min(corner_radius, std::min(w, h) * 0.5f);
+    PushShapeInstance(frame_buffer_index, Vec2(x + w * 0.5f, y + h * 0.5f), Vec2(w * 0.5f, h * 0.5f), radius, thickness, 0.0f, colour);
+}
+
+void Graphics::DrawThickLine(const Vec2& start, const Vec2& end, const float thickness, const uint32_t frame_buffer_index, const Vec4& colour)
+{
+    Capture::Scope capture_scope;
+    if(capture_scope.recording) Capture::Record(CAPTURE_DRAW_THICK_LINE, start, end, thickness, frame_buffer_index, colour);
+    if(RecordDrawListCall([=]() { DrawThickLine(start, end, thickness, frame_buffer_index, colour); })) return;
+
+    // a capsule is a box around the line with fully rounded ends
+    float dx = end.x - start.x;
+    float dy = end.y - start.y;
+    float half_thickness = thickness * 0.5f;
+    float half_length = std::sqrt(dx * dx + dy * dy) * 0.5f;
+
+    Vec2 centre((start.x + end.x) * 0.5f, (start.y + end.y) * 0.5f);
+    PushShapeInstance(frame_buffer_index, centre, Vec2(half_length + half_thickness, half_thickness), half_thickness, 0.0f, std::atan2(dy, dx), colour);
+}
+
+void Graphics::PushShapeInstance(const uint32_t frame_buffer_index, const Vec2& centre, const Vec2& half_size, const float corner_radius, const float thickness, const float angle_radians, const Vec4& colour)
+{
+    // the deferred queue only records vertices, so the shape goes in as a quad instead of an instance
+    if(draw_queue.recording)
+    {
+        PushShapeQuad(frame_buffer_index, centre, half_size, corner_radius, thickness, angle_radians, colour);
+        return;
+    }
+
+    DoBatchRenderSetUp(frame_buffer_index, batch.shape_texture, 0, 0, SHAPE_INSTANCES);
+
+    float pixel_size = 1.0f;
+    if(frame_buffers[frame_buffer_index].use_auto_scaling) pixel_size = Honeybear::game_scale;
+
+    ShapeInstance* shape = batch.shape_buffer_ptr;
+    shape->centre.x = centre.x * pixel_size;
+    shape->centre.y = centre.y * pixel_size;
+    shape->half_size.x = half_size.x * pixel_size;
+    shape->half_size.y = half_size.y * pixel_size;
+    shape->corner_radius = corner_radius * pixel_size;
+    shape->thickness = thickness * pixel_size;
+    shape->angle_radians = angle_radians;
+    shape->colour = PackColour(colour);
+
+    batch.shape_buffer_ptr++;
+    batch.shape_count++;
+}
+
+void Graphics::PushShapeQuad(const uint32_t frame_buffer_index, const Vec2& centre, const Vec2& half_size, const float corner_radius, const float thickness, const float angle_radians, const Vec4& colour)
+{
+    #ifdef HONEYBEAR_PACKED_VERTICES
+    // packed uvs are clamped to 0..1 so they can't hold the offset from the centre, the box is tessellated instead.
+    // outlines are stroked along the middle of the border so they cover the same pixels as the sdf version
+    float inset = thickness > 0.0f ? thickness * 0.5f : 0.0f;
+    Vec2 inner_half_size(std::max(half_size.x - inset, 0.0f), std::max(half_size.y - inset, 0.0f));
+    float radius = std::max(corner_radius - inset, 0.0f);
+
+    float pixel_size = 1.0f;
+    if(frame_buffers[frame_buffer_index].use_auto_scaling) pixel_size = Honeybear::game_scale;
+    UnitCircle circle = GetUnitCircle(CircleSidesForRadius(radius * pixel_size));
+
+    float c = std::cos(angle_radians);
+    float s = std::sin(angle_radians);
+
+    // a quarter circle around each corner, anticlockwise from the +x +y one
+    const float corner_signs[4][2] = { { 1.0f, 1.0f }, { -1.0f, 1.0f }, { -1.0f, -1.0f }, { 1.0f, -1.0f } };
+    std::vector<Vec2> points;
+    Vec2 arc_points[UNIT_CIRCLE_MAX_SIDES + 2];
+    for(int i = 0; i < 4; ++i)
+    {
+        Vec2 corner_centre(corner_signs[i][0] * (inner_half_size.x - radius), corner_signs[i][1] * (inner_half_size.y - radius));
+        int number_of_points = radius > 0.0f ? GetArcPoints(circle, i * 90.0f, (i + 1) * 90.0f, arc_points) : 1;
+        if(radius <= 0.0f) arc_points[0] = Vec2(0.0f);
+
+        for(int j = 0; j < number_of_points; ++j)
+        {
+            float lx = corner_centre.x + arc_points[j].x * radius;
+            float ly = corner_centre.y + arc_points[j].y * radius;
+            points.push_back(Vec2(centre.x + lx * c - ly * s, centre.y + lx * s + ly * c));
+        }
+    }
+
+    if(thickness > 0.0f)
+    {
+        DrawPolyline(points, thickness, MITER_JOIN, BUTT_CAP, true, frame_buffer_index, colour);
+    }
+    else
+    {
+        FillConvexPoly(points, frame_buffer_index, colour);
+    }
+    #else
+    // drawn with the shape shader's quad version, which gets everything the instance has from the vertices. the uvs are
+    // the offset from the centre (so the corners also give it the half size), z is the corner radius and the thickness
+    // goes in the bits of the packed indices a texture layer and material would use, in 1/256ths of a pixel
+    ShaderHandle previous_shader = activated_shader;
+    ActivateShader(shape_quad_shader);
+    DoBatchRenderSetUp(frame_buffer_index, batch.shape_texture, 6, 4);
+
+    float pixel_size = 1.0f;
+    if(frame_buffers[frame_buffer_index].use_auto_scaling) pixel_size = Honeybear::game_scale;
+    BatchColour batch_colour = MakeBatchColour(colour);
+
+    // grown by a pixel on each side so the anti aliased edge doesn't get cut off, the same as the instanced version
+    Vec2 extent(half_size.x * pixel_size + 1.0f, half_size.y * pixel_size + 1.0f);
+    float c = std::cos(angle_radians);
+    float s = std::sin(angle_radians);
+    float cx = centre.x * pixel_size;
+    float cy = centre.y * pixel_size;
+    uint32_t packed_thickness = (uint32_t)std::min(std::max(thickness * pixel_size, 0.0f) * 256.0f + 0.5f, (float)0xffffff);
+
+    // bottom right, top right, top left, bottom left, the order WriteQuadIndices expects
+    const float corners[4][2] = { { 1.0f, 1.0f }, { 1.0f, -1.0f }, { -1.0f, -1.0f }, { -1.0f, 1.0f } };
+    for(int i = 0; i < 4; ++i)
+    {
+        float lx = corners[i][0] * extent.x;
+        float ly = corners[i][1] * extent.y;
+        PushBatchVertex(cx + lx * c - ly * s, cy + lx * s + ly * c, corner_radius * pixel_size, lx, ly, batch_colour);
+        BatchVertex* vertex = batch.buffer_ptr - 1;
+        vertex->packed_indices = (vertex->packed_indices & VERTEX_TEXTURE_SLOT_MASK) | (packed_thickness << VERTEX_TEXTURE_LAYER_SHIFT);
+    }
+
+    WriteQuadIndices();
+    ActivateShader(previous_shader);
+    #endif
+}
+
+void Graphics::BeginBatch()
+{
+    if(batch.streaming_mode == PERSISTENT_MAPPED)
+    {
+        // the batch carries on from where the last flush ended, it can fill up to a whole batch so it needs that much room
+        if(batch.region_vertex_cursor + max_vertex_count > region_vertex_count || batch.region_index_cursor + max_index_count > region_index_count)
+        {
+            AdvanceBatchRegion();
+        }
+
+        batch.base_vertex = batch.current_region * region_vertex_count + batch.region_vertex_cursor;
+        batch.base_index = batch.current_region * region_index_count + batch.region_index_cursor;
+        batch.buffer = batch.mapped_buffer + batch.base_vertex;
+        batch.index_buffer = batch.mapped_index_buffer + batch.base_index;
+    }
+    else
+    {
+        // recording into the draw queue leaves these pointing at its arena, which is what gets emitted from
+        batch.buffer = batch.staging_buffer;
+        batch.index_buffer = batch.staging_index_buffer;
+    }
+
+    batch.buffer_ptr = batch.buffer;
+    batch.instance_buffer_ptr = batch.instance_buffer;
+    batch.shape_buffer_ptr = batch.shape_buffer;
+    batch.quads_only = true;
+}
+
+void Graphics::EndBatch()
+{
+    if(batch.batch_type == SPRITE_INSTANCES)
+    {
+        if(batch.instance_count == 0) return;
+        glBindBuffer(GL_ARRAY_BUFFER, batch.instance_VBO);
+        glBufferData(GL_ARRAY_BUFFER, max_quad_count * sizeof(SpriteInstance), nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, batch.instance_count * sizeof(SpriteInstance), batch.instance_buffer);
+        return;
+    }
+
+    if(batch.batch_type == SHAPE_INSTANCES)
+    {
+        if(batch.shape_count == 0) return;
+        glBindBuffer(GL_ARRAY_BUFFER, batch.shape_VBO);
+        glBufferData(GL_ARRAY_BUFFER, max_quad_count * sizeof(ShapeInstance), nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, batch.shape_count * sizeof(ShapeInstance), batch.shape_buffer);
+        return;
+    }
+
+    if(batch.index_count == 0) return;
+
+    // persistent mapped buffers are coherent, the vertices and indices are already visible to the gpu
+    if(batch.streaming_mode == PERSISTENT_MAPPED) return;
+
+    // orphan the old storage so the driver doesn't have to wait for any draws still reading from it
+    GLsizeiptr size = (uint8_t*)batch.buffer_ptr - (uint8_t*)batch.buffer;
+    glBindBuffer(GL_ARRAY_BUFFER, batch.VBO);
+    glBufferData(GL_ARRAY_BUFFER, max_vertex_count * sizeof(BatchVertex), nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, size, batch.buffer);
+
+    // quad only batches draw from the prebuilt indices, so only the vertices need uploading
+    if(batch.quads_only) return;
+
+    glBindVertexArray(batch.VAO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, batch.IB);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, max_index_count * sizeof(uint32_t), nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, batch.index_count * sizeof(uint32_t), batch.index_buffer);
+}
+
+void Graphics::FlushBatch()
+{
+    if(batch.batch_type == SPRITE_INSTANCES)
+    {
+        FlushSpriteInstances();
+        return;
+    }
+
+    if(batch.batch_type == SHAPE_INSTANCES)
+    {
+        FlushShapeInstances();
+        return;
+    }
+
+    if(batch.index_count == 0) return;
+    ShaderHandle current_shader = activated_shader;
+    bool should_reset_shader = false;
+
+    // materials set since the last draw, any vertex in this batch could use them
+    UploadMaterials();
+
+    glBindVertexArray(batch.quads_only ? batch.quad_VAO : batch.VAO);
+    GLenum render_type = GL_TRIANGLES;
+    if(batch.batch_type == LINES) render_type = GL_LINES;
+    else if(batch.batch_type == LINE_STRIPS)
+    {
+        render_type = GL_LINE_STRIP;
+        EnablePrimitiveRestart();
+    }
+    else if(batch.batch_type == FONT)
+    {
+        // todo: think about another solution for this (maybe font rendering should have its own batch system)
+        glUseProgram(GetShaderProgram(msdf_font_shader).program);
+        activated_shader = msdf_font_shader;
+        should_reset_shader = true;
+    }
+
+    GLenum index_type = batch.quads_only ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+
+    if(batch.streaming_mode == PERSISTENT_MAPPED)
+    {
+        // draw from where this batch starts, the next one starts after what it used. the region's fence covers it
+        const void* index_offset = batch.quads_only ? nullptr : (const void*)(batch.base_index * sizeof(uint32_t));
+        glDrawElementsBaseVertex(render_type, batch.index_count, index_type, index_offset, batch.base_vertex);
+        batch.region_vertex_cursor += batch.current_index_offset;
+        if(!batch.quads_only) batch.region_index_cursor += batch.index_count;
+    }
+    else
+    {
+        glDrawElements(render_type, batch.index_count, index_type, nullptr);
+    }
+
+    if(render_type == GL_LINE_STRIP) DisablePrimitiveRestart();
+
+    batch.index_count = 0;
+    batch.current_index_offset = 0;
+    glBindVertexArray(0); // speed: @performance maybe not needed?
+
+    // todo: this might be wrong
+    FrameBuffer* current_buffer = &frame_buffers[current_frame_buffer_index];
+    current_buffer->resolved = false;
+
+    if(should_reset_shader)
+    {
+        ActivateShader(current_shader);
+    }
+}
+
+void Graphics::WriteQuadIndices()
+{
+    // quad only batches draw with the prebuilt quad indices, so there's nothing to write
+    if(!batch.quads_only)
+    {
+        // first tri indices
+        batch.index_buffer[batch.index_count + 0] = 0 + batch.current_index_offset;
+        batch.index_buffer[batch.index_count + 1] = 1 + batch.current_index_offset;
+        batch.index_buffer[batch.index_count + 2] = 3 + batch.current_index_offset;
+
+        // second tri indices
+        batch.index_buffer[batch.index_count + 3] = 1 + batch.current_index_offset;
+        batch.index_buffer[batch.index_count + 4] = 2 + batch.current_index_offset;
+        batch.index_buffer[batch.index_count + 5] = 3 + batch.current_index_offset;
+    }
+
+    batch.current_index_offset += 4;
+    batch.index_count += 6;
+}
+
+void Graphics::UseDynamicIndices()
+{
+    if(!batch.quads_only) return;
+
+    // write out the indices for the quads already in the batch, from here on everything writes its own
+    uint32_t quad_count = batch.current_index_offset / 4;
+    for(uint32_t i = 0; i < quad_count; ++i)
+    {
+        uint32_t offset = i * 4;
+        batch.index_buffer[i * 6 + 0] = offset + 0;
+        batch.index_buffer[i * 6 + 1] = offset + 1;
+        batch.index_buffer[i * 6 + 2] = offset + 3;
+        batch.index_buffer[i * 6 + 3] = offset + 1;
+        batch.index_buffer[i * 6 + 4] = offset + 2;
+        batch.index_buffer[i * 6 + 5] = offset + 3;
+    }
+
+    batch.quads_only = false;
+}
+
+void Graphics::FlushSpriteInstances()
+{
+    if(batch.instance_count == 0) return;
+    ShaderHandle current_shader = activated_shader;
+
+    // like font batches, instanced sprites always draw with their own shader
+    glUseProgram(GetShaderProgram(sprite_instanced_shader).program);
+    activated_shader = sprite_instanced_shader;
+
+    glBindVertexArray(batch.instance_VAO);
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, batch.instance_count);
+    batch.instance_count = 0;
+    glBindVertexArray(0);
+
+    FrameBuffer* current_buffer = &frame_buffers[current_frame_buffer_index];
+    current_buffer->resolved = false;
+
+    ActivateShader(current_shader);
+}
+
+void Graphics::FlushShapeInstances()
+{
+    if(batch.shape_count == 0) return;
+    ShaderHandle current_shader = activated_shader;
+
+    glUseProgram(GetShaderProgram(shape_shader).program);
+    activated_shader = shape_shader;
+
+    glBindVertexArray(batch.shape_VAO);
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, batch.shape_count);
+    batch.shape_count = 0;
+    glBindVertexArray(0);
+
+    FrameBuffer* current_buffer = &frame_buffers[current_frame_buffer_index];
+    current_buffer->resolved = false;
+
+    ActivateShader(current_shader);
+}
+
+void Graphics::AdvanceBatchRegion()
+{
+    // nothing has been drawn from this region yet, so there's no reason to leave it
+    if(batch.region_vertex_cursor == 0 && batch.region_index_cursor == 0) return;
+
+    // every draw from the region so far is covered by one fence, then the next region is waited on if it's still in use
+    batch.region_fences[batch.current_region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    batch.current_region = (batch.current_region + 1) % BATCH_FRAMES_IN_FLIGHT;
+    WaitForBatchRegion(batch.current_region);
+
+    batch.region_vertex_cursor = 0;
+    batch.region_index_cursor = 0;
+}
+
+void Graphics::WaitForBatchRegion(const uint32_t region)
+{
+    GLsync fence = batch.region_fences[region];
+    if(!fence) return;
+
+    GLbitfield wait_flags = 0;
+    GLuint64 wait_duration = 0;
+    while(true)
+    {
+        GLenum wait_result = glClientWaitSync(fence, wait_flags, wait_duration);
+        if(wait_result == GL_ALREADY_SIGNALED || wait_result == GL_CONDITION_SATISFIED || wait_result == GL_WAIT_FAILED)
+        {
+            break;
+        }
+
+        // the gpu is still reading the frame BATCH_FRAMES_IN_FLIGHT back, or a frame filled its region early
+        if(wait_flags == 0 && Profiler::BatchBreakDiagnosticsEnabled()) Profiler::RecordBatchBufferWait();
+
+        // the first wait didn't flush, so make sure the fence actually gets submitted and wait for up to a second
+        wait_flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+        wait_duration = 1000000000;
+    }
+
+    glDeleteSync(fence);
+    batch.region_fences[region] = nullptr;
+}
+
+void Graphics::EndBatchFrame()
+{
+    if(batch.streaming_mode != PERSISTENT_MAPPED) return;
+
+    // the last batch of the frame has to be drawn before the region it's in is fenced, the next frame starts in the next region
+    CheckAndStartNewBatch();
+    AdvanceBatchRegion();
+    BeginBatch();
+}
+
+void Graphics::ResolveMultiSampledFrameBuffer(const uint32_t frame_buffer_index)
+{
+    Capture::Scope capture_scope;
+    if(capture_scope.recording) Capture::Record(CAPTURE_RESOLVE_FRAME_BUFFER, frame_buffer_index);
+    if(RecordDrawListCall([=]() { ResolveMultiSampledFrameBuffer(frame_buffer_index); })) return;
+    FrameBuffer* current_frame_buffer = &frame_buffers[current_frame_buffer_index];
+    FrameBuffer* frame_buffer = &frame_buffers[frame_buffer_index];
+    if(frame_buffer->multisampled && !frame_buffer->resolved)
+    {
+        ShaderHandle current_shader = activated_shader;
+        bool should_reset_shader = false;
+
+        if(current_shader.index != default_shader.index)
+        {
+            glUseProgram(GetShaderProgram(default_shader).program);
+            activated_shader = default_shader;
+            should_reset_shader = true;
+        }
+
+        Profiler::BeginGPUPass("resolve");
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, frame_buffer->FBO);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, frame_buffer->intermediate_FBO);
+        glBlitFramebuffer(0, 0, frame_buffer->width, frame_buffer->height, 0, 0, frame_buffer->width, frame_buffer->height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, current_frame_buffer->FBO);
+        Profiler::EndGPUPass();
+
+        frame_buffer->resolved = true;
+
+        if(should_reset_shader)
+        {
+            // switch straight back, going through ActivateShader would flush (or when deferring, not rebind at all)
+            glUseProgram(current_shader.index == INVALID_HANDLE ? 0 : GetShaderProgram(current_shader).program);
+            activated_shader = current_shader;
+        }
+    }
+}
+
+void Graphics::DoBatchRenderSetUp(const uint32_t frame_buffer_index, const GLuint tex_id, const uint32_t num_indices, const uint32_t num_vertices, BatchType batch_type, const char* file, const int line)
+{
+    if(draw_queue.recording)
+    {
+        RecordDrawCommand(frame_buffer_index, tex_id, num_indices, num_vertices, batch_type);
+        return;
+    }
+
+    //if(frame_buffer_index != current_frame_buffer_index)
+    if(frame_buffers[frame_buffer_index].FBO != current_fbo)
+    {
+        BindFrameBuffer(frame_buffer_index);
+    }
+
+    bool should_start_new_batch = false;
+    BatchBreakReason reason = BATCH_BREAK_CAPACITY;
+
+    // line strips use about a vertex per index, so the vertices can run out before the indices do
+    if(batch.index_count + num_indices > max_index_count || batch.current_index_offset + num_vertices > max_vertex_count)
+    {
+        should_start_new_batch = true;
+    }
+
+    if(batch.batch_type != batch_type)
+    {
+        should_start_new_batch = true;
+        reason = BATCH_BREAK_BATCH_TYPE;
+    }
+
+    if(batch_type == SPRITE_INSTANCES && batch.instance_count >= max_quad_count)
+    {
+        should_start_new_batch = true;
+    }
+
+    if(batch_type == SHAPE_INSTANCES && batch.shape_count >= max_quad_count)
+    {
+        should_start_new_batch = true;
+    }
+
+    if(should_start_new_batch)
+    {
+        CheckAndStartNewBatch(reason, file, line);
+    }
+
+    batch.current_texture_slot = GetBatchTextureSlot(tex_id, file, line);
+    batch.current_texture_layer = 0;
+    batch.batch_type = batch_type;
+}
+
+uint8_t Graphics::GetBatchTextureSlot(const GLuint tex_id, const char* file, const int line)
+{
+    // most draws use the same texture as the one before
+    uint8_t current_slot = (uint8_t)batch.current_texture_slot;
+    if(current_slot < batch.texture_slot_count && batch.texture_slots[current_slot] == tex_id)
+    {
+        return current_slot;
+    }
+
+    for(uint8_t i = 0; i < batch.texture_slot_count; ++i)
+    {
+        if(batch.texture_slots[i] == tex_id)
+        {
+            return i;
+        }
+    }
+
+    // texture arrays have a slot of their own, only one array fits in a batch
+    if(tex_id == batch.texture_array) return TEXTURE_ARRAY_SLOT;
+    if(IsTextureArray(tex_id))
+    {
+        if(batch.texture_array != 0) CheckAndStartNewBatch(BATCH_BREAK_TEXTURE_SLOTS, file, line);
+        batch.texture_array = tex_id;
+        BindTextureArray(tex_id);
+        return TEXTURE_ARRAY_SLOT;
+    }
+
+    // only break the batch once every slot is in use
+    if(batch.texture_slot_count == batch.max_texture_slots)
+    {
+        CheckAndStartNewBatch(BATCH_BREAK_TEXTURE_SLOTS, file, line);
+    }
+
+    uint8_t slot = batch.texture_slot_count++;
+    batch.texture_slots[slot] = tex_id;
+    BindTexture(tex_id, slot);
+    return slot;
+}
+
+void Graphics::EnableDeferredBatching()
+{
+    Capture::Scope capture_scope;
+    if(capture_scope.recording) Capture::Record(CAPTURE_ENABLE_DEFERRED_BATCHING);
+    if(draw_queue.recording) return;
+
+    // draw anything already batched the normal way before switching over
+    CheckAndStartNewBatch(BATCH_BREAK_DEFERRED_QUEUE);
+
+    draw_queue.recording = true;
+    draw_queue.current_shader_index = 0;
+    if(activated_shader.index != INVALID_HANDLE)
+    {
+        // register the active shader so the first recorded commands have a valid shader index
+        ShaderHandle shader = activated_shader;
+        activated_shader = ShaderHandle();
+        ActivateShader(shader);
+
+        // it's already the bound program
+        draw_queue.shader_dirty = false;
+    }
+
+    // from here on the batch writes into the queue arena
+    batch.index_count = 0;
+    batch.current_index_offset = 0;
+    EnsureDrawQueueCapacity();
+}
+
+void Graphics::DisableDeferredBatching()
+{
+    Capture::Scope capture_scope;
+    if(capture_scope.recording) Capture::Record(CAPTURE_DISABLE_DEFERRED_BATCHING);
+    if(!draw_queue.recording) return;
+
+    FlushDrawQueue();
+    draw_queue.recording = false;
+
+    // point the batch back at the gpu buffers
+    batch.index_count = 0;
+    batch.current_index_offset = 0;
+    BeginBatch();
+}
+
+void Graphics::SetDrawLayer(const uint8_t layer)
+{
+    Capture::Scope capture_scope;
+    if(capture_scope.recording) Capture::Record(CAPTURE_SET_DRAW_LAYER, layer);
+    draw_queue.current_layer = layer;
+}
+
+void Graphics::SetDrawLayerSortedByState(const uint8_t layer, const bool sorted_by_state)
+{
+    Capture::Scope capture_scope;
+    if(capture_scope.recording) Capture::Record(CAPTURE_SET_DRAW_LAYER_SORTED_BY_STATE, layer, sorted_by_state);
+    // by default a layer keeps painter's order, sorting by state is only safe when nothing in the layer overlaps
+    draw_queue.layer_sorted_by_state[layer] = sorted_by_state;
+}
+
+void Graphics::RecordDrawCommand(const uint32_t frame_buffer_index, const GLuint tex_id, const uint32_t num_indices, const uint32_t num_vertices, BatchType batch_type)
+{
+    EnsureDrawQueueCapacity();
+
+    // if nothing has changed since the last draw just keep adding to it
+    if(!draw_queue.commands.empty())
+    {
+        DrawCommand* last = &draw_queue.commands.back();
+
+        bool same_state =
+            last->frame_buffer_index == frame_buffer_index &&
+            last->texture_id == tex_id &&
+            last->batch_type == batch_type &&
+            last->shader_index == draw_queue.current_shader_index &&
+            last->layer == draw_queue.current_layer;
+
+        // a command has to fit in a single batch when it's emitted
+        bool fits =
+            (batch.index_count - last->first_index) + num_indices <= max_index_count &&
+            (batch.current_index_offset - last->first_vertex) + num_vertices <= max_vertex_count;
+
+        if(same_state && fits)
+        {
+            return;
+        }
+    }
+
+    DrawCommand command;
+    command.frame_buffer_index = frame_buffer_index;
+    command.texture_id = tex_id;
+    command.batch_type = batch_type;
+    command.shader_index = draw_queue.current_shader_index;
+    command.layer = draw_queue.current_layer;
+    command.first_vertex = batch.current_index_offset;
+    command.vertex_count = 0;
+    command.first_index = batch.index_count;
+    command.index_count = 0;
+    command.sort_key = MakeDrawSortKey(command, draw_queue.commands.size());
+
+    draw_queue.commands.push_back(command);
+}
+
+void Graphics::EnsureDrawQueueCapacity()
+{
+    // always keep room for a full batch, the same guarantee the normal batch gives the Render/Fill/Draw functions
+    size_t needed_vertices = batch.current_index_offset + max_vertex_count;
+    if(draw_queue.vertices.size() < needed_vertices)
+    {
+        draw_queue.vertices.resize(std::max(needed_vertices, draw_queue.vertices.size() * 2));
+    }
+
+    size_t needed_indices = batch.index_count + max_index_count;
+    if(draw_queue.indices.size() < needed_indices)
+    {
+        draw_queue.indices.resize(std::max(needed_indices, draw_queue.indices.size() * 2));
+    }
+
+    batch.buffer = draw_queue.vertices.data();
+    batch.buffer_ptr = batch.buffer + batch.current_index_offset;
+    batch.index_buffer = draw_queue.indices.data();
+
+    // the recorded commands get re-indexed when they're emitted, so every index has to actually be written
+    batch.quads_only = false;
+}
+
+uint64_t Graphics::MakeDrawSortKey(const DrawCommand& command, const uint32_t sequence)
+{
+    // | frame buffer (8) | layer (8) | sequence (24) | state (24) |  painter's order within the layer
+    // | frame buffer (8) | layer (8) | state (24) | sequence (24) |  layers sorted by state
+    // state = shader (8) | texture (12) | batch type (4), shader indices and texture ids only need to group, not be unique.
+    // past 256 shaders in a frame some share a bucket, each command still draws with its own
+    uint64_t state = ((uint64_t)(command.shader_index & 0xff) << 16) | ((uint64_t)(command.texture_id & 0xfff) << 4) | (uint64_t)(command.batch_type & 0xf);
+    uint64_t order = sequence & 0xffffff;
+
+    uint64_t key = ((uint64_t)(command.frame_buffer_index & 0xff) << 56) | ((uint64_t)command.layer << 48);
+    if(draw_queue.layer_sorted_by_state[command.layer])
+    {
+        key |= (state << 24) | order;
+    }
+    else
+    {
+        key |= (order << 24) | state;
+    }
+    return key;
+}
+
+void Graphics::SortDrawCommands()
+{
+    // lsd radix sort, a byte at a time
+    std::vector<DrawCommand>& commands = draw_queue.commands;
+    std::vector<DrawCommand>& scratch = draw_queue.sorted_commands;
+    scratch.resize(commands.size());
+
+    for(uint32_t shift = 0; shift < 64; shift += 8)
+    {
+        size_t counts[256] = {};
+        for(size_t i = 0; i < commands.size(); ++i)
+        {
+            counts[(commands[i].sort_key >> shift) & 0xff]++;
+        }
+
+        // every key has the same byte here (usually the case for the frame buffer and layer bytes) so skip the pass
+        if(counts[(commands[0].sort_key >> shift) & 0xff] == commands.size())
+        {
+            continue;
+        }
+
+        size_t offsets[256];
+        size_t total = 0;
+        for(size_t i = 0; i < 256; ++i)
+        {
+            offsets[i] = total;
+            total += counts[i];
+        }
+
+        for(size_t i = 0; i < commands.size(); ++i)
+        {
+            scratch[offsets[(commands[i].sort_key >> shift) & 0xff]++] = commands[i];
+        }
+
+        commands.swap(scratch);
+    }
+}
+
+void Graphics::FlushDrawQueue(const BatchBreakReason reason, const char* file, const int line)
+{
+    // replayed calls were captured when they were recorded
+    Capture::Scope capture_scope;
+    if(!draw_queue.recording) return;
+
+    // nothing gets drawn while a static batch or draw list is being recorded, it all goes into that instead
+    if(draw_queue.static_batch_recording || draw_queue.draw_list) return;
+
+    std::vector<DrawCommand>& commands = draw_queue.commands;
+    ShaderHandle recorded_shader = activated_shader;
+
+    if(!commands.empty())
+    {
+        CloseDrawCommandRanges();
+        SortDrawCommands();
+
+        // point the batch back at the gpu buffers to emit everything
+        draw_queue.recording = false;
+        batch.index_count = 0;
+        batch.current_index_offset = 0;
+        BeginBatch();
+
+        // the gl program could be anything at this point, so make sure the first command binds its shader
+        activated_shader = ShaderHandle();
+
+        EmitDrawCommands(commands, draw_queue.shaders, draw_queue.calls, draw_queue.vertices.data(), draw_queue.indices.data());
+
+        // the last batch is drawn because of whatever asked for the queue to be flushed
+        CheckAndStartNewBatch(reason, file, line);
+
+        commands.clear();
+        draw_queue.recording = true;
+        draw_queue.shader_dirty = true;
+    }
+
+    // leave the gl program matching whatever shader the game thinks is active
+    if(draw_queue.shader_dirty && recorded_shader.index != INVALID_HANDLE)
+    {
+        const ShaderProgram& program = GetShaderProgram(recorded_shader);
+        glUseProgram(program.program);
+        batch.max_texture_slots = program.texture_slots;
+        draw_queue.shader_dirty = false;
+    }
+    activated_shader = recorded_shader;
+
+    // start recording again from the beginning of the arena
+    batch.index_count = 0;
+    batch.current_index_offset = 0;
+    EnsureDrawQueueCapacity();
+}
+
+void Graphics::EmitDrawCommands(const std::vector<DrawCommand>& commands, const std::vector<ShaderHandle>& shaders, const std::vector<std::function<void()>>& calls, const BatchVertex* vertices, const uint32_t* indices)
+{
+    // goes through the normal batch, which only binds and flushes when the state actually changes
+    for(size_t i = 0; i < commands.size(); ++i)
+    {
+        const DrawCommand& command = commands[i];
+
+        // recorded state changes run in between the draws with the shader that was active when they were recorded
+        if(command.batch_type == DEFERRED_CALL)
+        {
+            ActivateShader(shaders[command.shader_index]);
+            calls[command.call_index]();
+            continue;
+        }
+
+        if(command.index_count == 0) continue;
+
+        ActivateShader(shaders[command.shader_index]);
+        DoBatchRenderSetUp(command.frame_buffer_index, command.texture_id, command.index_count, command.vertex_count, command.batch_type);
+        UseDynamicIndices();
+
+        std::memcpy(batch.buffer_ptr, vertices + command.first_vertex, command.vertex_count * sizeof(BatchVertex));
+        for(uint32_t j = 0; j < command.vertex_count; ++j)
+        {
+            // texture slots are only known once the command is in a real batch
+            batch.buffer_ptr->packed_indices = (batch.buffer_ptr->packed_indices & ~VERTEX_TEXTURE_SLOT_MASK) | batch.current_texture_slot;
+            batch.buffer_ptr++;
+        }
+
+        const uint32_t* src_indices = indices + command.first_index;
+        uint32_t rebase = batch.current_index_offset - command.first_vertex;
+        for(uint32_t j = 0; j < command.index_count; ++j)
+        {
+            // restart indices mark the end of a line strip, they aren't vertex indices
+            uint32_t index = src_indices[j];
+            batch.index_buffer[batch.index_count + j] = index == PRIMITIVE_RESTART_INDEX ? index : index + rebase;
+        }
+
+        batch.index_count += command.index_count;
+        batch.current_index_offset += command.vertex_count;
+    }
+}
+
+void Graphics::CloseDrawCommandRanges()
+{
+    // commands were recorded back to back so each one ends where the next starts
+    std::vector<DrawCommand>& commands = draw_queue.commands;
+    for(size_t i = 0; i < commands.size(); ++i)
+    {
+        uint32_t end_vertex = i + 1 < commands.size() ? commands[i + 1].first_vertex : batch.current_index_offset;
+        uint32_t end_index = i + 1 < commands.size() ? commands[i + 1].first_index : batch.index_count;
+        commands[i].vertex_count = end_vertex - commands[i].first_vertex;
+        commands[i].index_count = end_index - commands[i].first_index;
+    }
+}
+
+void Graphics::BeginStaticBatch()
+{
+    // static batches are recorded through the draw queue, so draw anything already queued first or it would get baked in
+    draw_queue.resume_after_static_batch = draw_queue.recording;
+    if(draw_queue.recording)
+    {
+        FlushDrawQueue();
+    }
+    else
+    {
+        EnableDeferredBatching();
+    }
+
+    draw_queue.static_batch_recording = true;
+}
+
+uint32_t Graphics::EndStaticBatch()
+{
+    CloseDrawCommandRanges();
+
+    StaticBatch static_batch;
+    std::vector<BatchVertex> vertices;
+    std::vector<uint32_t> indices;
+    vertices.reserve(batch.current_index_offset);
+    indices.reserve(batch.index_count);
+
+    // keep the recorded order, neighbouring commands with the same state get merged into a single run
+    for(size_t i = 0; i < draw_queue.commands.size(); ++i)
+    {
+        const DrawCommand& command = draw_queue.commands[i];
+        if(command.index_count == 0) continue;
+
+        // same as FlushBatch, font runs always use the msdf shader
+        ShaderHandle shader = command.batch_type == FONT ? msdf_font_shader : draw_queue.shaders[command.shader_index];
+        std::vector<StaticBatchRun>& runs = static_batch.runs;
+        if(runs.empty() || runs.back().shader.index != shader.index || runs.back().texture_id != command.texture_id || runs.back().batch_type != command.batch_type)
+        {
+            StaticBatchRun run;
+            run.shader = shader;
+            run.translation_uniform = INVALID_HANDLE;
+            const ShaderProgram& program = GetShaderProgram(shader);
+            auto translation_it = program.uniform_indices.find("translation");
+            if(translation_it != program.uniform_indices.end()) run.translation_uniform = translation_it->second;
+            run.texture_id = command.texture_id;
+            run.batch_type = command.batch_type;
+            run.first_index = indices.size();
+            run.index_count = 0;
+            runs.push_back(run);
+        }
+
+        uint32_t rebase = vertices.size() - command.first_vertex;
+        bool texture_array = IsTextureArray(command.texture_id);
+        for(uint32_t j = 0; j < command.vertex_count; ++j)
+        {
+            // each run only ever binds one texture, always to unit 0 or the texture array unit
+            BatchVertex vertex = draw_queue.vertices[command.first_vertex + j];
+            vertex.packed_indices = (vertex.packed_indices & ~VERTEX_TEXTURE_SLOT_MASK) | (texture_array ? TEXTURE_ARRAY_SLOT : 0);
+            vertices.push_back(vertex);
+        }
+
+        for(uint32_t j = 0; j < command.index_count; ++j)
+        {
+            uint32_t index = draw_queue.indices[command.first_index + j];
+            indices.push_back(index == PRIMITIVE_RESTART_INDEX ? index : index + rebase);
+        }
+
+        runs.back().index_count += command.index_count;
+    }
+
+    glGenVertexArrays(1, &static_batch.VAO);
+    glBindVertexArray(static_batch.VAO);
+
+    glGenBuffers(1, &static_batch.VBO);
+    glBindBuffer(GL_ARRAY_BUFFER, static_batch.VBO);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(BatchVertex), vertices.data(), GL_STATIC_DRAW);
+
+    glGenBuffers(1, &static_batch.IB);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, static_batch.IB);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint32_t), indices.data(), GL_STATIC_DRAW);
+
+    SetBatchVertexAttributes();
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    // reuse the slot of a deleted static batch if there is one
+    uint32_t static_batch_index = static_batches.size();
+    for(uint32_t i = 0; i < static_batches.size(); ++i)
+    {
+        if(static_batches[i].VAO == 0)
+        {
+            static_batch_index = i;
+            break;
+        }
+    }
+
+    if(static_batch_index == static_batches.size())
     {
-        tex_id = batch.shape_texture;
+        static_batches.push_back(static_batch);
     }
     else
     {
-        tex_id = texture_id;
+        static_batches[static_batch_index] = static_batch;
     }
 
-    DoBatchRenderSetUp(frame_buffer_index, tex_id, num_indices, TEXTURE);
-
-    //float pixel_size = frame_buffers[frame_buffer_index].auto_scaling_value;
-    float pixel_size = 1.0f;
-    if(frame_buffers[frame_buffer_index].use_auto_scaling) pixel_size = Honeybear::game_scale;
-
-    for(size_t i = 0; i < num_verts; ++i)
+    // throw away the recorded commands and go back to however things were being drawn before
+    draw_queue.commands.clear();
+    draw_queue.static_batch_recording = false;
+    if(draw_queue.resume_after_static_batch)
     {
-        batch.buffer_ptr->position.x = positions[i].x * pixel_size;
-        batch.buffer_ptr->position.y = positions[i].y * pixel_size;
-        batch.buffer_ptr->position.z = positions[i].z * pixel_size;
-        batch.buffer_ptr->tex_coords = tex_coords[i];
-        batch.buffer_ptr->colour     = colours[i];
-        batch.buffer_ptr++;
+        FlushDrawQueue();
     }
-
-    for(size_t i = 0; i < num_indices; ++i)
+    else
     {
-        batch.index_buffer[batch.index_count] = batch.current_index_offset + indices[i];
-        batch.index_count++;
+        DisableDeferredBatching();
     }
 
-    batch.current_index_offset += num_verts;
+    return static_batch_index;
 }
 
-void Graphics::DrawLine(const Vec2& start, const Vec2& end, const uint32_t frame_buffer_index, const Vec4& colour)
+void Graphics::DrawStaticBatch(const uint32_t static_batch_index, const uint32_t frame_buffer_index, const Vec2& offset)
 {
-    int indices_count = 2;
+    if(RecordDrawListCall([=]() { DrawStaticBatch(static_batch_index, frame_buffer_index, offset); })) return;
+    // draw everything batched so far first so the static batch keeps its place in the draw order
+    CheckAndStartNewBatch();
 
-    DoBatchRenderSetUp(frame_buffer_index, batch.shape_texture, indices_count, LINES);
+    if(frame_buffers[frame_buffer_index].FBO != current_fbo)
+    {
+        BindFrameBuffer(frame_buffer_index);
+    }
 
-    //float pixel_size = frame_buffers[frame_buffer_index].auto_scaling_value;
     float pixel_size = 1.0f;
     if(frame_buffers[frame_buffer_index].use_auto_scaling) pixel_size = Honeybear::game_scale;
 
-    // start
-    batch.buffer_ptr->position.x = start.x * pixel_size;
-    batch.buffer_ptr->position.y = start.y * pixel_size;
-    batch.buffer_ptr->tex_coords.x = 0.0f;
-    batch.buffer_ptr->tex_coords.y = 0.0f;
-    batch.buffer_ptr->colour = colour;
-    batch.buffer_ptr++;
+    StaticBatch& static_batch = static_batches[static_batch_index];
+    UploadMaterials();
+    glBindVertexArray(static_batch.VAO);
 
-    // end
-    batch.buffer_ptr->position.x = end.x * pixel_size;
-    batch.buffer_ptr->position.y = end.y * pixel_size;
-    batch.buffer_ptr->tex_coords.x = 0.0f;
-    batch.buffer_ptr->tex_coords.y = 0.0f;
-    batch.buffer_ptr->colour = colour;
-    batch.buffer_ptr++;
+    for(size_t i = 0; i < static_batch.runs.size(); ++i)
+    {
+        const StaticBatchRun& run = static_batch.runs[i];
 
-    // indices
-    batch.index_buffer[batch.index_count + 0] = 0 + batch.current_index_offset;
-    batch.index_buffer[batch.index_count + 1] = 1 + batch.current_index_offset;
+        ShaderProgram& program = GetShaderProgram(run.shader);
+        glUseProgram(program.program);
 
-    batch.index_count += indices_count;
-    batch.current_index_offset += indices_count;
-}
+        // shaders without a translation uniform just draw the batch where it was recorded
+        GLint translation_location = -1;
+        if(run.translation_uniform != INVALID_HANDLE)
+        {
+            // it's set straight on the bound program here, so whatever the setters cached for it is stale
+            ShaderUniform& uniform = program.uniforms[run.translation_uniform];
+            translation_location = uniform.location;
+            uniform.cached_words = 0;
+        }
+        glUniform2f(translation_location, offset.x * pixel_size, offset.y * pixel_size);
 
-void Graphics::DrawRect(const float x, const float y, const float w, const float h, const uint32_t frame_buffer_index, const Vec4& colour)
-{
-    // todo: slow (but who cares?) this shouldn't use DrawLine and should be done properly with GL_LINE_STRIP
-    DrawLine(Vec2(x, y), Vec2(x + w, y), frame_buffer_index, colour);
-    DrawLine(Vec2(x + w, y), Vec2(x + w, y + h), frame_buffer_index, colour);
-    DrawLine(Vec2(x + w, y + h), Vec2(x, y + h), frame_buffer_index, colour);
-    DrawLine(Vec2(x, y + h), Vec2(x, y), frame_buffer_index, colour);
-}
+        if(IsTextureArray(run.texture_id)) BindTextureArray(run.texture_id);
+        else BindTexture(run.texture_id, 0);
 
-void Graphics::DrawCircle(const Vec2& pos, const float radius, const uint32_t frame_buffer_index, const Vec4& colour)
-{
-    if(!(radius > 0.0f))
-    {
-        return;
-    }
+        GLenum render_type = GL_TRIANGLES;
+        if(run.batch_type == LINES) render_type = GL_LINES;
+        else if(run.batch_type == LINE_STRIPS) render_type = GL_LINE_STRIP;
 
-    //float pixel_size = frame_buffers[frame_buffer_index].auto_scaling_value;
-    float pixel_size = 1.0f;
-    if(frame_buffers[frame_buffer_index].use_auto_scaling) pixel_size = Honeybear::game_scale;
+        if(render_type == GL_LINE_STRIP) EnablePrimitiveRestart();
+        glDrawElements(render_type, run.index_count, GL_UNSIGNED_INT, (const void*)(run.first_index * sizeof(uint32_t)));
+        if(render_type == GL_LINE_STRIP) DisablePrimitiveRestart();
 
-    // -----------------------------
-    // the below formula was taken from here: https://stackoverflow.com/questions/11774038/how-to-render-a-circle-with-as-few-vertices-as-possible
-    float error = 0.25f;
-    float th = std::acos(2 * ((1 - error / (radius * pixel_size)) * (1 - error / (radius * pixel_size))) - 1);
-    int number_of_sides = std::ceil(2 * PI / th);
-    // -----------------------------
+        // everything else gets drawn untranslated
+        glUniform2f(translation_location, 0.0f, 0.0f);
+    }
 
-    float angle_per_side = 360.0f / number_of_sides;
+    glBindVertexArray(0);
+    frame_buffers[frame_buffer_index].resolved = false;
 
-    // todo: dumb and slow?
-    for(size_t i = 0; i < number_of_sides; ++i)
+    // put back the program the batch is expecting
+    if(activated_shader.index != INVALID_HANDLE)
     {
-        float degrees = i * angle_per_side;
-        float radians = degrees * (PI / 180.0f);
-        Vec2 start(
-            pos.x + std::cos(radians) * radius,
-            pos.y + std::sin(radians) * radius
-        );
-        radians = (degrees + angle_per_side) * (PI / 180.0f);
-        Vec2 end(
-            pos.x + std::cos(radians) * radius,
-            pos.y + std::sin(radians) * radius
-        );
-        DrawLine(start, end, frame_buffer_index, colour);
+        glUseProgram(GetShaderProgram(activated_shader).program);
     }
 }
 
-void Graphics::DrawPoly(const std::vector<Vec2>& points, const uint32_t frame_buffer_index, const Vec4& colour)
+void Graphics::DeleteStaticBatch(const uint32_t static_batch_index)
 {
-    for(size_t i = 0; i < points.size(); ++i)
-    {
-        size_t next_i = (i + 1) % points.size();
-        DrawLine(points[i], points[next_i], frame_buffer_index, colour);
-    }
+    // the slot is left empty rather than removed so the other static batch indices stay valid, the next EndStaticBatch reuses it
+    StaticBatch& static_batch = static_batches[static_batch_index];
+    glDeleteBuffers(1, &static_batch.VBO);
+    glDeleteBuffers(1, &static_batch.IB);
+    glDeleteVertexArrays(1, &static_batch.VAO);
+
+    static_batch.VAO = 0;
+    static_batch.VBO = 0;
+    static_batch.IB = 0;
+    static_batch.runs.clear();
 }
 
-void Graphics::BeginBatch()
+void Graphics::BeginDrawList(DrawList* draw_list)
 {
-    batch.buffer_ptr = batch.buffer;
-}
+    // anything this thread already batched gets drawn first, worker threads never have anything
+    CheckAndStartNewBatch();
 
-void Graphics::EndBatch()
-{
-    if(batch.index_count == 0) return;
-    GLsizeiptr size = (uint8_t*)batch.buffer_ptr - (uint8_t*)batch.buffer;
-    glBindBuffer(GL_ARRAY_BUFFER, batch.VBO);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, size, batch.buffer);
+    draw_queue.draw_list = draw_list;
+    draw_queue.recording = true;
+
+    // record straight into the list, reusing whatever its vectors grew to last time
+    draw_queue.commands.swap(draw_list->commands);
+    draw_queue.vertices.swap(draw_list->vertices);
+    draw_queue.indices.swap(draw_list->indices);
+    draw_queue.shaders.swap(draw_list->shaders);
+    draw_queue.calls.swap(draw_list->calls);
+    draw_queue.commands.clear();
+    draw_queue.shaders.clear();
+    draw_queue.calls.clear();
+
+    // worker threads have never activated a shader, so they start on the default one
+    draw_list->previous_shader = activated_shader;
+    ShaderHandle shader = activated_shader.index == INVALID_HANDLE ? default_shader : activated_shader;
+    activated_shader = ShaderHandle();
+    draw_queue.current_shader_index = 0;
+    ActivateShader(shader);
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, batch.IB);
-    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, batch.index_count * sizeof(uint32_t), batch.index_buffer);
+    batch.index_count = 0;
+    batch.current_index_offset = 0;
+    EnsureDrawQueueCapacity();
 }
 
-void Graphics::FlushBatch()
+void Graphics::EndDrawList()
 {
-    if(batch.index_count == 0) return;
-    std::string current_shader = activated_shader_id;
-    bool should_reset_shader = false;
+    DrawList* draw_list = draw_queue.draw_list;
+    if(!draw_list) return;
+
+    CloseDrawCommandRanges();
+    draw_list->vertex_count = batch.current_index_offset;
+    draw_list->index_count = batch.index_count;
+
+    // hand the recorded vectors to the list and take this thread's own ones back
+    draw_queue.commands.swap(draw_list->commands);
+    draw_queue.vertices.swap(draw_list->vertices);
+    draw_queue.indices.swap(draw_list->indices);
+    draw_queue.shaders.swap(draw_list->shaders);
+    draw_queue.calls.swap(draw_list->calls);
+
+    draw_queue.draw_list = nullptr;
+    draw_queue.recording = false;
+    draw_queue.shader_dirty = false;
+
+    // nothing touched the gl program while recording
+    activated_shader = draw_list->previous_shader;
 
-    glBindVertexArray(batch.VAO);
-    GLenum render_type = GL_TRIANGLES;
-    if(batch.batch_type == LINES) render_type = GL_LINES;
-    else if(batch.batch_type == FONT)
-    {
-        // todo: think about another solution for this (maybe font rendering should have its own batch system)
-        glUseProgram(shaders["msdf_font"]);
-        activated_shader_id = "msdf_font";
-        should_reset_shader = true;
-    }
-    glDrawElements(render_type, batch.index_count, GL_UNSIGNED_INT, nullptr);
     batch.index_count = 0;
     batch.current_index_offset = 0;
-    glBindVertexArray(0); // speed: @performance maybe not needed?
-
-    // todo: this might be wrong
-    FrameBuffer* current_buffer = &frame_buffers[current_frame_buffer_index];
-    current_buffer->resolved = false;
 
-    if(should_reset_shader)
+    // only the gl thread's batch has gpu buffers to go back to
+    if(batch.VAO != 0)
     {
-        ActivateShader(current_shader);
+        BeginBatch();
     }
 }
 
-void Graphics::ResolveMultiSampledFrameBuffer(const uint32_t frame_buffer_index)
+bool Graphics::RecordDrawListCall(const std::function<void()>& call)
 {
-    FrameBuffer* current_frame_buffer = &frame_buffers[current_frame_buffer_index];
-    FrameBuffer* frame_buffer = &frame_buffers[frame_buffer_index];
-    if(frame_buffer->multisampled && !frame_buffer->resolved)
-    {
-        std::string current_shader = activated_shader_id;
-        bool should_reset_shader = false;
-
-        if(current_shader != "default")
-        {
-            glUseProgram(shaders["default"]);
-            activated_shader_id = "default";
-            should_reset_shader = true;
-        }
-
-        glBindFramebuffer(GL_READ_FRAMEBUFFER, frame_buffer->FBO);
-        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, frame_buffer->intermediate_FBO);
-        glBlitFramebuffer(0, 0, frame_buffer->width, frame_buffer->height, 0, 0, frame_buffer->width, frame_buffer->height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
-        glBindFramebuffer(GL_FRAMEBUFFER, current_frame_buffer->FBO);
-
-        frame_buffer->resolved = true;
-
-        if(should_reset_shader)
-        {
-            ActivateShader(current_shader);
-        }
-    }
+    if(!draw_queue.draw_list) return false;
+
+    DrawCommand command;
+    command.sort_key = 0;
+    command.frame_buffer_index = 0;
+    command.texture_id = 0;
+    command.batch_type = DEFERRED_CALL;
+    command.shader_index = draw_queue.current_shader_index;
+    command.layer = draw_queue.current_layer;
+    command.first_vertex = batch.current_index_offset;
+    command.vertex_count = 0;
+    command.first_index = batch.index_count;
+    command.index_count = 0;
+    command.call_index = draw_queue.calls.size();
+
+    draw_queue.commands.push_back(command);
+    draw_queue.calls.push_back(call);
+    return true;
 }
 
-void Graphics::DoBatchRenderSetUp(const uint32_t frame_buffer_index, const GLuint tex_id, const uint32_t num_indices, BatchType batch_type)
+void Graphics::SubmitDrawList(const DrawList& draw_list)
 {
-    //if(frame_buffer_index != current_frame_buffer_index)
-    if(frame_buffers[frame_buffer_index].FBO != current_fbo)
-    {
-        BindFrameBuffer(frame_buffer_index);
-    }
+    const DrawList* draw_lists = &draw_list;
+    SubmitDrawLists(&draw_lists, 1);
+}
 
-    bool should_start_new_batch = false;
-    bool should_bind_texture = false;
+void Graphics::SubmitDrawLists(const DrawList* const* draw_lists, const size_t num_draw_lists)
+{
+    // replayed calls were captured when they were recorded
+    Capture::Scope capture_scope;
+    // anything the main thread couldn't do without the context, before the frame that came after it
+    RunPendingContextCalls();
+    // draw whatever was batched or queued before the lists so they end up on top of it
+    CheckAndStartNewBatch();
 
-    //uint32_t texture_id = batch.shape_texture;
-    if(bound_textures[0] != tex_id)
+    ShaderHandle current_shader = activated_shader;
+    bool deferred = draw_queue.recording;
+    if(deferred)
     {
-        should_start_new_batch = true;
-        should_bind_texture = true;
+        draw_queue.recording = false;
+        batch.index_count = 0;
+        batch.current_index_offset = 0;
+        BeginBatch();
     }
 
-    if(batch.index_count + num_indices > max_index_count)
+    // lists are drawn in the order they're given, so the result doesn't depend on which thread finished first
+    for(size_t i = 0; i < num_draw_lists; ++i)
     {
-        should_start_new_batch = true;
+        const DrawList* draw_list = draw_lists[i];
+        EmitDrawCommands(draw_list->commands, draw_list->shaders, draw_list->calls, draw_list->vertices.data(), draw_list->indices.data());
     }
 
-    if(batch.batch_type != batch_type)
-    {
-        should_start_new_batch = true;
-    }
+    CheckAndStartNewBatch();
 
-    if(should_start_new_batch)
+    // put back the shader the game thinks is active
+    if(current_shader.index != INVALID_HANDLE)
     {
-        CheckAndStartNewBatch();
+        ActivateShader(current_shader);
     }
 
-    if(should_bind_texture)
+    if(deferred)
     {
-        BindTexture(tex_id, 0);
+        draw_queue.recording = true;
+        batch.index_count = 0;
+        batch.current_index_offset = 0;
+        EnsureDrawQueueCapacity();
     }
-
-    batch.batch_type = batch_type;
 }
 
 Sprite* Graphics::GetSprite(const uint32_t sprite_id)
@@ -1403,6 +4011,8 @@ Sprite* Graphics::GetSprite(const uint32_t sprite_id)
 
 void Graphics::CreateSprite(const uint32_t sprite_id, SpriteSheet* sprite_sheet, int tex_x, int tex_y, int tex_w, int tex_h)
 {
+    Capture::Scope capture_scope(true);
+    if(capture_scope.recording) Capture::Record(CAPTURE_CREATE_SPRITE, sprite_id, Capture::GetSpriteSheetName(sprite_sheet), tex_x, tex_y, tex_w, tex_h);
     sprites[sprite_id].id = sprite_id;
     sprites[sprite_id].name = "test";
     sprites[sprite_id].sprite_sheet = sprite_sheet;
@@ -1419,10 +4029,112 @@ void Graphics::CreateSprite(const uint32_t sprite_id, SpriteSheet* sprite_sheet,
     sprites[sprite_id].texture_h = tex_h / texture_height;
 }
 
+TextureArray* Graphics::CreateSpriteSheetArray(const std::string& texture_array_name, const std::vector<std::string>& sprite_sheet_names, const FilterType filter_type)
+{
+    Capture::Scope capture_scope(true);
+    if(capture_scope.recording) Capture::Record(CAPTURE_CREATE_SPRITE_SHEET_ARRAY, texture_array_name, CaptureArray<std::string>{ sprite_sheet_names.data(), (uint32_t)sprite_sheet_names.size() }, filter_type);
+
+    // every layer of an array is the same size, so the sheets have to be as well
+    std::vector<SpriteSheet*> array_sheets;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    for(const std::string& sprite_sheet_name : sprite_sheet_names)
+    {
+        auto it = sprite_sheets.find(sprite_sheet_name);
+        if(it == sprite_sheets.end() || it->second->diffuse == nullptr)
+        {
+            std::cout << "ERROR::TEXTURE_ARRAY: Sprite sheet not found: " << sprite_sheet_name << std::endl;
+            continue;
+        }
+
+        Texture* diffuse = it->second->diffuse;
+        if(array_sheets.empty())
+        {
+            width = diffuse->width;
+            height = diffuse->height;
+        }
+        else if(diffuse->width != width || diffuse->height != height)
+        {
+            std::cout << "ERROR::TEXTURE_ARRAY: " << sprite_sheet_name << " isn't the same size as the other sheets in " << texture_array_name << std::endl;
+            continue;
+        }
+
+        // the packed vertices only have a byte for the layer
+        if((array_sheets.size() + 1) * 3 > MAX_TEXTURE_ARRAY_LAYERS)
+        {
+            std::cout << "ERROR::TEXTURE_ARRAY: Too many sprite sheets in " << texture_array_name << ", leaving out " << sprite_sheet_name << std::endl;
+            continue;
+        }
+
+        array_sheets.push_back(it->second);
+    }
+
+    if(array_sheets.empty()) return nullptr;
+
+    GLuint filter = GL_LINEAR;
+    if(filter_type == NEAREST) filter = GL_NEAREST;
+
+    // if there is already an array with this name, then delete it
+    if(texture_arrays.count(texture_array_name) > 0)
+    {
+        CheckAndUnbindTexture(texture_arrays[texture_array_name].ID);
+        glDeleteTextures(1, &texture_arrays[texture_array_name].ID);
+    }
+
+    TextureArray* texture_array = &texture_arrays[texture_array_name];
+    texture_array->width = width;
+    texture_array->height = height;
+    texture_array->layer_count = array_sheets.size() * 3;
+
+    // the array and the layers read back share the scratch unit, they're bound to different targets
+    glGenTextures(1, &texture_array->ID);
+    BindScratchTexture(GL_TEXTURE_2D_ARRAY, texture_array->ID);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA, width, height, texture_array->layer_count, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, filter);
+
+    // the sheets only keep their pixels on the gpu, so each layer is read back and copied in.
+    // a sheet without a specular or normal map gets an empty layer in its place
+    std::vector<uint8_t> pixels(width * height * 4);
+    for(size_t i = 0; i < array_sheets.size(); ++i)
+    {
+        SpriteSheet* sprite_sheet = array_sheets[i];
+        Texture* layer_textures[3] = { sprite_sheet->diffuse, sprite_sheet->specular, sprite_sheet->normal };
+
+        for(uint32_t layer = 0; layer < 3; ++layer)
+        {
+            Texture* texture = layer_textures[layer];
+            if(texture && texture->width == width && texture->height == height)
+            {
+                BindScratchTexture(GL_TEXTURE_2D, texture->ID);
+                glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+            }
+            else
+            {
+                std::fill(pixels.begin(), pixels.end(), 0);
+            }
+
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, i * 3 + layer, width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+        }
+
+        sprite_sheet->texture_array = texture_array;
+        sprite_sheet->array_layer = i * 3;
+    }
+
+    glActiveTexture(GL_TEXTURE0);
+
+    return texture_array;
+}
+
 void Graphics::BindFrameBuffer(const uint32_t frame_buffer_index)
 {
+    Capture::Scope capture_scope;
+    if(capture_scope.recording) Capture::Record(CAPTURE_BIND_FRAME_BUFFER, frame_buffer_index);
     // flush any batched quads to the previous frame buffer
-    CheckAndStartNewBatch();
+    CheckAndStartNewBatch(BATCH_BREAK_FRAME_BUFFER);
+    Profiler::MarkFrameBufferPass(frame_buffer_index);
 
     FrameBuffer* frame_buffer = &frame_buffers[frame_buffer_index];
     glBindFramebuffer(GL_FRAMEBUFFER, frame_buffer->FBO);
@@ -1431,7 +4143,7 @@ void Graphics::BindFrameBuffer(const uint32_t frame_buffer_index)
     current_frame_buffer_index = frame_buffer_index;
 
     // make sure the shader projection matrix is set up
-    SetShaderProjection(activated_shader_id, 0.0f, frame_buffer->width, 0.0f, frame_buffer->height, -1.0f, 1.0f);
+    SetShaderProjection(activated_shader, 0.0f, frame_buffer->width, 0.0f, frame_buffer->height, -1.0f, 1.0f);
 }
 
 uint32_t Graphics::AddMultiSampledFrameBuffer(const uint32_t samples)
@@ -1443,6 +4155,8 @@ uint32_t Graphics::AddMultiSampledFrameBuffer(const uint32_t samples)
 
 uint32_t Graphics::AddMultiSampledFrameBuffer(const uint32_t width, const uint32_t height, const uint32_t samples)
 {
+    Capture::Scope capture_scope(true);
+    if(capture_scope.recording) Capture::Record(CAPTURE_ADD_MULTISAMPLED_FRAME_BUFFER, width, height, samples);
     // todo: cleanup: mostly copy paste from AddFrameBuffer
     frame_buffers.push_back(FrameBuffer());
     uint32_t frame_buffer_index = frame_buffers.size() - 1;
@@ -1560,6 +4274,8 @@ uint32_t Graphics::AddMultiSampledFrameBuffer(const uint32_t width, const uint32
 
 void Graphics::AttachDepthBuffer(const uint32_t frame_buffer_index)
 {
+    Capture::Scope capture_scope(true);
+    if(capture_scope.recording) Capture::Record(CAPTURE_ATTACH_DEPTH_BUFFER, frame_buffer_index);
     FrameBuffer* frame_buffer = &frame_buffers[frame_buffer_index];
     frame_buffer->depth_testing_enabled = true;
 
@@ -1584,12 +4300,16 @@ uint32_t Graphics::GetFrameBufferTextureID(const uint32_t frame_buffer_index)
 
 void Graphics::EnableBufferAutoScaling(const uint32_t frame_buffer_index)
 {
+    Capture::Scope capture_scope(true);
+    if(capture_scope.recording) Capture::Record(CAPTURE_ENABLE_BUFFER_AUTO_SCALING, frame_buffer_index);
     FrameBuffer* frame_buffer = &frame_buffers[frame_buffer_index];
     frame_buffer->use_auto_scaling = true;
 }
 
 void Graphics::DisableBufferAutoScaling(const uint32_t frame_buffer_index)
 {
+    Capture::Scope capture_scope(true);
+    if(capture_scope.recording) Capture::Record(CAPTURE_DISABLE_BUFFER_AUTO_SCALING, frame_buffer_index);
     FrameBuffer* frame_buffer = &frame_buffers[frame_buffer_index];
     frame_buffer->use_auto_scaling = false;
 }
@@ -1603,6 +4323,8 @@ uint32_t Graphics::AddFrameBuffer()
 
 uint32_t Graphics::AddFrameBuffer(const uint32_t width, const uint32_t height)
 {
+    Capture::Scope capture_scope(true);
+    if(capture_scope.recording) Capture::Record(CAPTURE_ADD_FRAME_BUFFER, width, height);
     frame_buffers.push_back(FrameBuffer());
     uint32_t frame_buffer_index = frame_buffers.size() - 1;
     FrameBuffer* frame_buffer = &frame_buffers[frame_buffer_index];
@@ -1706,6 +4428,15 @@ uint32_t Graphics::AddFrameBuffer(const uint32_t width, const uint32_t height)
 
 void Graphics::UpdateFrameBufferSize(const uint32_t frame_buffer_index, const uint32_t width, const uint32_t height)
 {
+    Capture::Scope capture_scope(true);
+    if(capture_scope.recording) Capture::Record(CAPTURE_UPDATE_FRAME_BUFFER_SIZE, frame_buffer_index, width, height);
+    if(RecordDrawListCall([=]() { UpdateFrameBufferSize(frame_buffer_index, width, height); })) return;
+    // resizing from the main thread while the render thread has the context, e.g. after ChangeResolution
+    if(glfwGetCurrentContext() != window)
+    {
+        RunWithContext([=]() { UpdateFrameBufferSize(frame_buffer_index, width, height); });
+        return;
+    }
     FrameBuffer* frame_buffer = &frame_buffers[frame_buffer_index];
 
     // todo: cleanup
@@ -1807,40 +4538,48 @@ void Graphics::RenderFrameBuffer(const uint32_t frame_buffer_index)
 
 void Graphics::RenderFrameBuffer(const uint32_t frame_buffer_index, const Vec2& offset)
 {
+    Capture::Scope capture_scope;
+    if(capture_scope.recording) Capture::Record(CAPTURE_RENDER_FRAME_BUFFER, frame_buffer_index, offset);
+    if(RecordDrawListCall([=]() { RenderFrameBuffer(frame_buffer_index, offset); })) return;
     // before we render the frame buffer to the screen, make sure all batched quads have been flushed to their buffer
-    CheckAndStartNewBatch();
+    CheckAndStartNewBatch(BATCH_BREAK_RENDER_FRAME_BUFFER);
 
     // will do nothing if the frame buffer is not multisampled
     ResolveMultiSampledFrameBuffer(frame_buffer_index);
 
     GLuint source_colour_buffer = GetFrameBufferTextureID(frame_buffer_index);
 
-    int window_width, window_height;
-    glfwGetWindowSize(window, &window_width, &window_height);
+    int window_width = frame_window_width;
+    int window_height = frame_window_height;
     glViewport(0, 0, window_width, window_height);
 
     // frame buffer textures are upside down, so use a projection that will flip them the right way
-    SetShaderProjection(activated_shader_id, 0.0f - offset.x, (float)window_width - offset.x, (float)window_height - offset.y, 0.0f - offset.y, -1.0f, 1.0f);
+    SetShaderProjection(activated_shader, 0.0f - offset.x, (float)window_width - offset.x, (float)window_height - offset.y, 0.0f - offset.y, -1.0f, 1.0f);
 
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
     current_fbo = 0;
     BindTexture(source_colour_buffer, 0);
+    Profiler::BeginGPUPass("composite");
     glBindVertexArray(screen_render_data.quad_VAO);
     glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr);
     glBindVertexArray(0);
+    Profiler::EndGPUPass();
 }
 
 void Graphics::RenderFrameBuffer(const uint32_t frame_buffer_index, const float src_x, const float src_y, const float src_w, const float src_h)
 {
-    CheckAndStartNewBatch();
+    Capture::Scope capture_scope;
+    if(capture_scope.recording) Capture::Record(CAPTURE_RENDER_FRAME_BUFFER_REGION, frame_buffer_index, src_x, src_y, src_w, src_h);
+    if(RecordDrawListCall([=]() { RenderFrameBuffer(frame_buffer_index, src_x, src_y, src_w, src_h); })) return;
+    CheckAndStartNewBatch(BATCH_BREAK_RENDER_FRAME_BUFFER);
     ResolveMultiSampledFrameBuffer(frame_buffer_index);
     GLuint source_colour_buffer = GetFrameBufferTextureID(frame_buffer_index);
 
-    int window_width, window_height;
-    glfwGetWindowSize(window, &window_width, &window_height);
+    int window_width = frame_window_width;
+    int window_height = frame_window_height;
     glViewport(0, 0, window_width, window_height);
 
-    SetShaderProjection(activated_shader_id, 0.0f, (float)window_width, (float)window_height, 0.0f, -1.0f, 1.0f);
+    SetShaderProjection(activated_shader, 0.0f, (float)window_width, (float)window_height, 0.0f, -1.0f, 1.0f);
 
     // update the screen render quad vao tex coords to the src rectangle provided
     UpdateScreenRenderData(frame_buffer_index, src_x, src_y, src_w, src_h);
@@ -1848,9 +4587,11 @@ void Graphics::RenderFrameBuffer(const uint32_t frame_buffer_index, const float
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
     current_fbo = 0;
     BindTexture(source_colour_buffer, 0);
+    Profiler::BeginGPUPass("composite");
     glBindVertexArray(screen_render_data.quad_VAO);
     glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr);
     glBindVertexArray(0);
+    Profiler::EndGPUPass();
 
     // reset the screen render data quad vao
     UpdateScreenRenderData();
@@ -1858,9 +4599,12 @@ void Graphics::RenderFrameBuffer(const uint32_t frame_buffer_index, const float
 
 void Graphics::RenderFrameBufferToFrameBuffer(const uint32_t source_frame_buffer_index, const uint32_t dest_frame_buffer_index)
 {
+    Capture::Scope capture_scope;
+    if(capture_scope.recording) Capture::Record(CAPTURE_RENDER_FRAME_BUFFER_TO_FRAME_BUFFER, source_frame_buffer_index, dest_frame_buffer_index);
+    if(RecordDrawListCall([=]() { RenderFrameBufferToFrameBuffer(source_frame_buffer_index, dest_frame_buffer_index); })) return;
     FrameBuffer* dest_frame_buffer = &frame_buffers[dest_frame_buffer_index];
 
-    CheckAndStartNewBatch();
+    CheckAndStartNewBatch(BATCH_BREAK_RENDER_FRAME_BUFFER);
 
     ResolveMultiSampledFrameBuffer(source_frame_buffer_index);
 
@@ -1868,80 +4612,98 @@ void Graphics::RenderFrameBufferToFrameBuffer(const uint32_t source_frame_buffer
 
     BindFrameBuffer(dest_frame_buffer_index);
     BindTexture(source_colour_buffer, 0);
+    Profiler::BeginGPUPass("composite");
     glBindVertexArray(dest_frame_buffer->quad_VAO);
     glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr);
     glBindVertexArray(0);
+    Profiler::EndGPUPass();
 }
 
 void Graphics::RenderFrameBufferToQuad(const uint32_t source_frame_buffer_index, const float x, const float y, const float w, const float h, const uint32_t dest_frame_buffer_index, const Vec4& colour)
 {
+    Capture::Scope capture_scope;
+    if(capture_scope.recording) Capture::Record(CAPTURE_RENDER_FRAME_BUFFER_TO_QUAD, source_frame_buffer_index, x, y, w, h, dest_frame_buffer_index, colour);
     int indices_count = 6;
 
+    // the source frame buffer might still have recorded draws that sort after this one
+    FlushDrawQueue();
+
     ResolveMultiSampledFrameBuffer(source_frame_buffer_index);
     GLuint tex_buffer = GetFrameBufferTextureID(source_frame_buffer_index);
 
-    DoBatchRenderSetUp(dest_frame_buffer_index, tex_buffer, indices_count);
+    DoBatchRenderSetUp(dest_frame_buffer_index, tex_buffer, indices_count, 4);
 
     //float pixel_size = frame_buffers[dest_frame_buffer_index].auto_scaling_value;
     float pixel_size = 1.0f;
     if(frame_buffers[dest_frame_buffer_index].use_auto_scaling) pixel_size = Honeybear::game_scale;
+    BatchColour batch_colour = MakeBatchColour(colour);
 
     // bottom right
-    batch.buffer_ptr->position.x = (x + w) * pixel_size;
-    batch.buffer_ptr->position.y = (y + h) * pixel_size;
-    batch.buffer_ptr->tex_coords.x = 1.0f;
-    batch.buffer_ptr->tex_coords.y = 1.0f;
-    batch.buffer_ptr->colour = colour;
-    batch.buffer_ptr++;
+    PushBatchVertex((x + w) * pixel_size, (y + h) * pixel_size, 0.0f, 1.0f, 1.0f, batch_colour);
 
     // top right
-    batch.buffer_ptr->position.x = (x + w) * pixel_size;
-    batch.buffer_ptr->position.y = y * pixel_size;
-    batch.buffer_ptr->tex_coords.x = 1.0f;
-    batch.buffer_ptr->tex_coords.y = 0.0f;
-    batch.buffer_ptr->colour = colour;
-    batch.buffer_ptr++;
+    PushBatchVertex((x + w) * pixel_size, y * pixel_size, 0.0f, 1.0f, 0.0f, batch_colour);
 
     // top left
-    batch.buffer_ptr->position.x = x * pixel_size;
-    batch.buffer_ptr->position.y = y * pixel_size;
-    batch.buffer_ptr->tex_coords.x = 0.0f;
-    batch.buffer_ptr->tex_coords.y = 0.0f;
-    batch.buffer_ptr->colour = colour;
-    batch.buffer_ptr++;
+    PushBatchVertex(x * pixel_size, y * pixel_size, 0.0f, 0.0f, 0.0f, batch_colour);
 
     // bottom left
-    batch.buffer_ptr->position.x = x * pixel_size;
-    batch.buffer_ptr->position.y = (y + h) * pixel_size;
-    batch.buffer_ptr->tex_coords.x = 0.0f;
-    batch.buffer_ptr->tex_coords.y = 1.0f;
-    batch.buffer_ptr->colour = colour;
-    batch.buffer_ptr++;
+    PushBatchVertex(x * pixel_size, (y + h) * pixel_size, 0.0f, 0.0f, 1.0f, batch_colour);
 
-    // first tri indices
-    batch.index_buffer[batch.index_count + 0] = 0 + batch.current_index_offset;
-    batch.index_buffer[batch.index_count + 1] = 1 + batch.current_index_offset;
-    batch.index_buffer[batch.index_count + 2] = 3 + batch.current_index_offset;
+    WriteQuadIndices();
+}
 
-    // second tri indices
-    batch.index_buffer[batch.index_count + 3] = 1 + batch.current_index_offset;
-    batch.index_buffer[batch.index_count + 4] = 2 + batch.current_index_offset;
-    batch.index_buffer[batch.index_count + 5] = 3 + batch.current_index_offset;
+void Graphics::UpdateFrameWindowSize()
+{
+    glfwGetWindowSize(window, &frame_window_width, &frame_window_height);
+}
 
-    batch.current_index_offset += 4;
-    batch.index_count += indices_count;
+void Graphics::RunWithContext(const std::function<void()>& call)
+{
+    if(glfwGetCurrentContext() == window)
+    {
+        call();
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(pending_context_calls_mutex);
+    pending_context_calls.push_back(call);
+}
+
+void Graphics::RunPendingContextCalls()
+{
+    std::vector<std::function<void()>> calls;
+    {
+        std::lock_guard<std::mutex> lock(pending_context_calls_mutex);
+        calls.swap(pending_context_calls);
+    }
+
+    for(size_t i = 0; i < calls.size(); ++i)
+    {
+        calls[i]();
+    }
 }
 
 void Graphics::ChangeResolution(const uint32_t width, const uint32_t height)
 {
-    // change the window size
+    // the window is changed on the main thread, the gl side happens on whichever thread has the context
     glfwSetWindowSize(window, width, height);
 
     // center the window
     const GLFWvidmode* mode = glfwGetVideoMode(glfwGetPrimaryMonitor());
     glfwSetWindowPos(window, mode->width / 2 - width / 2, mode->height / 2 - height / 2);
 
-    glViewport(0, 0, width, height);
+    // the frames recorded from now on are this size, even if the window system hasn't caught up yet
+    frame_window_width = width;
+    frame_window_height = height;
+
+    RunWithContext([=]()
+    {
+        glViewport(0, 0, width, height);
+
+        // update the quad VAO that is used for rendering framebuffers to the screen
+        UpdateScreenRenderData();
+    });
 
     // update every framebuffer that is mapped to the size of the window
     for(size_t i = 0; i < frame_buffers.size(); ++i)
@@ -1951,9 +4713,6 @@ void Graphics::ChangeResolution(const uint32_t width, const uint32_t height)
         //     UpdateFrameBufferSize(i, width, height);
         // }
     }
-
-    // update the quad VAO that is used for rendering framebuffers to the screen
-    UpdateScreenRenderData();
 }
 
 void Graphics::GetResolution(int* width, int* height)
@@ -1976,13 +4735,25 @@ void Graphics::ToggleFullscreen(const bool enabled)
 
 void Graphics::ToggleVSync(const bool enabled)
 {
-    glfwSwapInterval(enabled ? 1 : 0);
+    if(RecordDrawListCall([=]() { ToggleVSync(enabled); })) return;
+    // the swap interval belongs to the context, so it has to be set on the thread that has it
+    RunWithContext([=]() { glfwSwapInterval(enabled ? 1 : 0); });
 }
 
 Graphics::MSDF_Font* Graphics::LoadMSDFFont(const std::string& font_id, const std::string& font_atlas_file_name, const std::string& font_data_file_name)
 {
+    Capture::Scope capture_scope(true);
+    if(capture_scope.recording) Capture::Record(CAPTURE_LOAD_MSDF_FONT, font_id, font_atlas_file_name, font_data_file_name);
     MSDF_Font* font = &msdf_fonts[font_id];
 
+    // loading a font again under the same id keeps its handle
+    if(font->handle.index == INVALID_HANDLE)
+    {
+        font->font_id = font_id;
+        font->handle.index = font_handles.size();
+        font_handles.push_back(font);
+    }
+
     font->tallest_char_height = 0.0f;
     font->texture = LoadTexture(font_atlas_file_name, LINEAR);
 
@@ -2030,15 +4801,32 @@ Graphics::MSDF_Font* Graphics::LoadMSDFFont(const std::string& font_id, const st
     return font;
 }
 
+FontHandle Graphics::GetFontHandle(const std::string& font_id)
+{
+    auto it = msdf_fonts.find(font_id);
+    if(it == msdf_fonts.end()) return FontHandle();
+    return it->second.handle;
+}
+
 void Graphics::RenderText(const std::string& text, const Vec2& position, const std::string& font_id, const float size, const uint32_t frame_buffer_index, const Vec4& colour)
 {
+    RenderText(text, position, GetFontHandle(font_id), size, frame_buffer_index, colour);
+}
+
+void Graphics::RenderText(const std::string& text, const Vec2& position, const FontHandle font_handle, const float size, const uint32_t frame_buffer_index, const Vec4& colour)
+{
+    if(font_handle.index == INVALID_HANDLE) return;
+    MSDF_Font* font = font_handles[font_handle.index];
+
+    Capture::Scope capture_scope;
+    if(capture_scope.recording) Capture::Record(CAPTURE_RENDER_TEXT, text, position, font->font_id, size, frame_buffer_index, colour);
     //float pixel_size = frame_buffers[frame_buffer_index].auto_scaling_value;
     float pixel_size = 1.0f;
     if(frame_buffers[frame_buffer_index].use_auto_scaling) pixel_size = Honeybear::game_scale;
+    BatchColour batch_colour = MakeBatchColour(colour);
 
     float adjusted_size = size * pixel_size;
 
-    MSDF_Font* font = &msdf_fonts[font_id];
     float atlas_width = font->texture->width;
     float atlas_height = font->texture->height;
 
@@ -2054,7 +4842,7 @@ void Graphics::RenderText(const std::string& text, const Vec2& position, const s
     {
         int indices_count = 6;
 
-        DoBatchRenderSetUp(frame_buffer_index, font->texture->ID, indices_count, FONT);
+        DoBatchRenderSetUp(frame_buffer_index, font->texture->ID, indices_count, 4, FONT);
 
         char c = text_c_str[i];
         int ascii_code = static_cast<int>(c);
@@ -2086,53 +4874,18 @@ void Graphics::RenderText(const std::string& text, const Vec2& position, const s
         float distance_factor = scale * 20.0f;
 
         // bottom right
-        batch.buffer_ptr->position.x = quad_right;
-        batch.buffer_ptr->position.y = quad_bottom;
-        batch.buffer_ptr->position.z = distance_factor;
-        batch.buffer_ptr->tex_coords.x = tex_right;
-        batch.buffer_ptr->tex_coords.y = tex_bottom;
-        batch.buffer_ptr->colour = colour;
-        batch.buffer_ptr++;
+        PushBatchVertex(quad_right, quad_bottom, distance_factor, tex_right, tex_bottom, batch_colour);
 
         // top right
-        batch.buffer_ptr->position.x = quad_right;
-        batch.buffer_ptr->position.y = quad_top;
-        batch.buffer_ptr->position.z = distance_factor;
-        batch.buffer_ptr->tex_coords.x = tex_right;
-        batch.buffer_ptr->tex_coords.y = tex_top;
-        batch.buffer_ptr->colour = colour;
-        batch.buffer_ptr++;
+        PushBatchVertex(quad_right, quad_top, distance_factor, tex_right, tex_top, batch_colour);
 
         // top left
-        batch.buffer_ptr->position.x = quad_left;
-        batch.buffer_ptr->position.y = quad_top;
-        batch.buffer_ptr->position.z = distance_factor;
-        batch.buffer_ptr->tex_coords.x = tex_left;
-        batch.buffer_ptr->tex_coords.y = tex_top;
-        batch.buffer_ptr->colour = colour;
-        batch.buffer_ptr++;
+        PushBatchVertex(quad_left, quad_top, distance_factor, tex_left, tex_top, batch_colour);
 
         // bottom left
-        batch.buffer_ptr->position.x = quad_left;
-        batch.buffer_ptr->position.y = quad_bottom;
-        batch.buffer_ptr->position.z = distance_factor;
-        batch.buffer_ptr->tex_coords.x = tex_left;
-        batch.buffer_ptr->tex_coords.y = tex_bottom;
-        batch.buffer_ptr->colour = colour;
-        batch.buffer_ptr++;
-
-        // first tri indices
-        batch.index_buffer[batch.index_count + 0] = 0 + batch.current_index_offset;
-        batch.index_buffer[batch.index_count + 1] = 1 + batch.current_index_offset;
-        batch.index_buffer[batch.index_count + 2] = 3 + batch.current_index_offset;
-
-        // second tri indices
-        batch.index_buffer[batch.index_count + 3] = 1 + batch.current_index_offset;
-        batch.index_buffer[batch.index_count + 4] = 2 + batch.current_index_offset;
-        batch.index_buffer[batch.index_count + 5] = 3 + batch.current_index_offset;
+        PushBatchVertex(quad_left, quad_bottom, distance_factor, tex_left, tex_bottom, batch_colour);
 
-        batch.current_index_offset += 4;
-        batch.index_count += indices_count;
+        WriteQuadIndices();
 
         //x += char_data.advance * size * size_mod;
         cursor_x += char_data.advance * adjusted_size;
@@ -2142,6 +4895,18 @@ void Graphics::RenderText(const std::string& text, const Vec2& position, const s
 
 void Graphics::CalcTextDimensions(const std::string& text, const std::string& font_id, const float size, float* width, float* height)
 {
+    CalcTextDimensions(text, GetFontHandle(font_id), size, width, height);
+}
+
+void Graphics::CalcTextDimensions(const std::string& text, const FontHandle font_handle, const float size, float* width, float* height)
+{
+    if(font_handle.index == INVALID_HANDLE)
+    {
+        *width = 0.0f;
+        *height = 0.0f;
+        return;
+    }
+
     float min_x = 0.0f;
     float max_x = 0.0f;
     float min_y = 0.0f;
@@ -2150,7 +4915,7 @@ void Graphics::CalcTextDimensions(const std::string& text, const std::string& fo
     float cursor_x = 0.0f;
     float cursor_y = 0.0f;
 
-    MSDF_Font* font = &msdf_fonts[font_id];
+    MSDF_Font* font = font_handles[font_handle.index];
     size_t str_len = text.length();
     const char* text_c_str = text.c_str();
 
@@ -2182,61 +4947,91 @@ void Graphics::CalcTextDimensions(const std::string& text, const std::string& fo
 
 void Graphics::EnableBlending()
 {
-    CheckAndStartNewBatch();
+    Capture::Scope capture_scope;
+    if(capture_scope.recording) Capture::Record(CAPTURE_ENABLE_BLENDING);
+    if(RecordDrawListCall([=]() { EnableBlending(); })) return;
+    CheckAndStartNewBatch(BATCH_BREAK_RENDER_STATE);
     glEnable(GL_BLEND);
 }
 
 void Graphics::DisableBlending()
 {
-    CheckAndStartNewBatch();
+    Capture::Scope capture_scope;
+    if(capture_scope.recording) Capture::Record(CAPTURE_DISABLE_BLENDING);
+    if(RecordDrawListCall([=]() { DisableBlending(); })) return;
+    CheckAndStartNewBatch(BATCH_BREAK_RENDER_STATE);
     glDisable(GL_BLEND);
 }
 
 void Graphics::SetBlendFunction(GLenum source_factor, GLenum dest_factor)
 {
-    CheckAndStartNewBatch();
+    Capture::Scope capture_scope;
+    if(capture_scope.recording) Capture::Record(CAPTURE_SET_BLEND_FUNCTION, (uint32_t)source_factor, (uint32_t)dest_factor);
+    if(RecordDrawListCall([=]() { SetBlendFunction(source_factor, dest_factor); })) return;
+    CheckAndStartNewBatch(BATCH_BREAK_RENDER_STATE);
     glBlendFunc(source_factor, dest_factor);
 }
 
 void Graphics::SetBlendFunctionSeperate(GLenum source_factor_rgb, GLenum dest_factor_rgb, GLenum source_factor_alpha, GLenum dest_factor_alpha)
 {
-    CheckAndStartNewBatch();
+    Capture::Scope capture_scope;
+    if(capture_scope.recording) Capture::Record(CAPTURE_SET_BLEND_FUNCTION_SEPERATE, (uint32_t)source_factor_rgb, (uint32_t)dest_factor_rgb, (uint32_t)source_factor_alpha, (uint32_t)dest_factor_alpha);
+    if(RecordDrawListCall([=]() { SetBlendFunctionSeperate(source_factor_rgb, dest_factor_rgb, source_factor_alpha, dest_factor_alpha); })) return;
+    CheckAndStartNewBatch(BATCH_BREAK_RENDER_STATE);
     glBlendFuncSeparate(source_factor_rgb, dest_factor_rgb, source_factor_alpha, dest_factor_alpha);
 }
 
 void Graphics::EnableDepthTesting()
 {
-    CheckAndStartNewBatch();
+    Capture::Scope capture_scope;
+    if(capture_scope.recording) Capture::Record(CAPTURE_ENABLE_DEPTH_TESTING);
+    if(RecordDrawListCall([=]() { EnableDepthTesting(); })) return;
+    CheckAndStartNewBatch(BATCH_BREAK_RENDER_STATE);
     glEnable(GL_DEPTH_TEST);
 }
 
 void Graphics::DisableDepthTesting()
 {
-    CheckAndStartNewBatch();
+    Capture::Scope capture_scope;
+    if(capture_scope.recording) Capture::Record(CAPTURE_DISABLE_DEPTH_TESTING);
+    if(RecordDrawListCall([=]() { DisableDepthTesting(); })) return;
+    CheckAndStartNewBatch(BATCH_BREAK_RENDER_STATE);
     glDisable(GL_DEPTH_TEST);
 }
 
 void Graphics::EnableScissorTesting()
 {
-    CheckAndStartNewBatch();
+    Capture::Scope capture_scope;
+    if(capture_scope.recording) Capture::Record(CAPTURE_ENABLE_SCISSOR_TESTING);
+    if(RecordDrawListCall([=]() { EnableScissorTesting(); })) return;
+    CheckAndStartNewBatch(BATCH_BREAK_RENDER_STATE);
     glEnable(GL_SCISSOR_TEST);
 }
 
 void Graphics::DisableScissorTesting()
 {
-    CheckAndStartNewBatch();
+    Capture::Scope capture_scope;
+    if(capture_scope.recording) Capture::Record(CAPTURE_DISABLE_SCISSOR_TESTING);
+    if(RecordDrawListCall([=]() { DisableScissorTesting(); })) return;
+    CheckAndStartNewBatch(BATCH_BREAK_RENDER_STATE);
     glDisable(GL_SCISSOR_TEST);
 }
 
 void Graphics::SetScissorRegion(const int x, const int y, const int width, const int height)
 {
-    CheckAndStartNewBatch();
+    Capture::Scope capture_scope;
+    if(capture_scope.recording) Capture::Record(CAPTURE_SET_SCISSOR_REGION, x, y, width, height);
+    if(RecordDrawListCall([=]() { SetScissorRegion(x, y, width, height); })) return;
+    CheckAndStartNewBatch(BATCH_BREAK_RENDER_STATE);
     glScissor(x, y, width, height);
 }
 
 void Graphics::SetScissorRegion(const uint32_t frame_buffer_index, const int x, const int y, const int width, const int height)
 {
-    CheckAndStartNewBatch();
+    Capture::Scope capture_scope;
+    if(capture_scope.recording) Capture::Record(CAPTURE_SET_FRAME_BUFFER_SCISSOR_REGION, frame_buffer_index, x, y, width, height);
+    if(RecordDrawListCall([=]() { SetScissorRegion(frame_buffer_index, x, y, width, height); })) return;
+    CheckAndStartNewBatch(BATCH_BREAK_RENDER_STATE);
     float pixel_size = 1.0f;
     if(frame_buffers[frame_buffer_index].use_auto_scaling) pixel_size = Honeybear::game_scale;
     glScissor(x * pixel_size, y * pixel_size, width * pixel_size, height * pixel_size);
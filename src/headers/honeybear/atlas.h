@@ -0,0 +1,64 @@
+#ifndef ATLAS_H
+#define ATLAS_H
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+#include "graphics.h"
+
+// pages are packed up to this size square, then trimmed down to what was used
+#define ATLAS_DEFAULT_PAGE_SIZE 2048
+
+namespace Honeybear
+{
+    // sprite sheets, single images and msdf font atlases packed together into shared pages, so sprites, ui and text
+    // drawn together don't use a texture slot each. fill it in with the Add functions then call BuildAtlas once
+    // everything it packs has been loaded
+    struct TextureAtlas
+    {
+        std::string name;
+
+        uint32_t page_size = ATLAS_DEFAULT_PAGE_SIZE;
+
+        // empty pixels left between packed rects
+        uint32_t padding = 2;
+
+        // the edge pixels of each rect are repeated this far outwards so linear filtering at the edge
+        // of a sprite doesn't pull in whatever is packed next to it
+        uint32_t extrude = 1;
+
+        // sprites can be turned 90 degrees to fit better, font glyphs never are
+        bool allow_rotation = false;
+
+        // one filter for the whole page, msdf fonts only look right with LINEAR
+        Graphics::FilterType filter_type = Graphics::LINEAR;
+
+        std::vector<std::string> sprite_sheets;
+        std::vector<std::string> images;
+        std::vector<uint32_t> image_sprite_ids;
+        std::vector<std::string> fonts;
+
+        // filled in by BuildAtlas, a sprite sheet per page named "<name>_<page>". a page only has a specular or normal
+        // texture if something packed onto it did
+        std::vector<SpriteSheet*> pages;
+    };
+
+    namespace TextureAtlases
+    {
+        // every sprite created on the sheet is packed, the sheet itself is left loaded
+        void AddSpriteSheet(TextureAtlas* atlas, const std::string& sprite_sheet_name);
+
+        // the image is loaded when the atlas is built and becomes sprite_id, if it doesn't fit on a page the sprite isn't touched
+        void AddImage(TextureAtlas* atlas, const std::string& image_file_name, const uint32_t sprite_id);
+
+        // the font's glyphs are packed and its texture pointed at the page they went on
+        void AddFont(TextureAtlas* atlas, const std::string& font_id);
+
+        // packs everything with max rects (best short side fit) and moves the sprites and glyphs over to the pages.
+        // the original textures are read back from the gpu so they aren't loaded again, they're left for the caller to free
+        bool BuildAtlas(TextureAtlas* atlas);
+    };
+};
+
+#endif
\ No newline at end of file
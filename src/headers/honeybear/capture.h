@@ -0,0 +1,203 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <atomic>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <type_traits>
+
+#include "maths.h"
+
+namespace Honeybear
+{
+    struct SpriteSheet;
+
+    namespace Graphics
+    {
+        struct SpriteDraw;
+    };
+
+    // every recorded Graphics:: call starts with one of these, followed by its arguments in order
+    enum CaptureOp : uint8_t
+    {
+        // resources, these go into the setup log which is always recorded so a capture can be started at any time
+        CAPTURE_LOAD_TEXTURE,
+        CAPTURE_LOAD_SPRITES_FILE,
+        CAPTURE_LOAD_SPRITE_SHEET,
+        CAPTURE_CREATE_SPRITE,
+        CAPTURE_LOAD_SHADER,
+        CAPTURE_CREATE_SHADER_PROGRAM,
+        CAPTURE_LOAD_MSDF_FONT,
+        CAPTURE_ADD_FRAME_BUFFER,
+        CAPTURE_ADD_MULTISAMPLED_FRAME_BUFFER,
+        CAPTURE_ENABLE_BUFFER_AUTO_SCALING,
+        CAPTURE_DISABLE_BUFFER_AUTO_SCALING,
+        CAPTURE_ATTACH_DEPTH_BUFFER,
+        CAPTURE_UPDATE_FRAME_BUFFER_SIZE,
+        CAPTURE_SET_CLEAR_COLOUR,
+        CAPTURE_SET_FRAME_BUFFER_CLEAR_COLOUR,
+
+        // per frame calls
+        CAPTURE_ACTIVATE_SHADER,
+        CAPTURE_SET_SHADER_PROJECTION,
+        CAPTURE_SET_SHADER_FLOAT,
+        CAPTURE_SET_SHADER_INT,
+        CAPTURE_SET_SHADER_VEC2,
+        CAPTURE_SET_SHADER_VEC3,
+        CAPTURE_SET_SHADER_VEC4,
+        CAPTURE_SET_SHADER_FLOAT_ARRAY,
+        CAPTURE_SET_SHADER_INT_ARRAY,
+        CAPTURE_SET_SHADER_VEC2_ARRAY,
+        CAPTURE_SET_SHADER_VEC3_ARRAY,
+        CAPTURE_SET_SHADER_VEC4_ARRAY,
+        CAPTURE_SET_SHADER_TEXTURE,
+        CAPTURE_SET_SHADER_FRAMEBUFFER_TEXTURE,
+        CAPTURE_RENDER_SPRITE,
+        CAPTURE_RENDER_SPRITE_INSTANCED,
+        CAPTURE_RENDER_SPRITES,
+        CAPTURE_DRAW_LINE,
+        CAPTURE_DRAW_RECT,
+        CAPTURE_DRAW_CIRCLE,
+        CAPTURE_DRAW_ARC,
+        CAPTURE_DRAW_POLY,
+        CAPTURE_DRAW_LINE_STRIP,
+        CAPTURE_DRAW_POLYLINE,
+        CAPTURE_FILL_SMOOTH_CIRCLE,
+        CAPTURE_DRAW_SMOOTH_CIRCLE,
+        CAPTURE_FILL_ROUNDED_RECT,
+        CAPTURE_DRAW_ROUNDED_RECT,
+        CAPTURE_DRAW_THICK_LINE,
+        CAPTURE_FILL_TRIANGLE,
+        CAPTURE_FILL_RECT,
+        CAPTURE_FILL_CIRCLE,
+        CAPTURE_FILL_PIE,
+        CAPTURE_FILL_CONVEX_POLY,
+        CAPTURE_RESOLVE_FRAME_BUFFER,
+        CAPTURE_RENDER_FRAME_BUFFER,
+        CAPTURE_RENDER_FRAME_BUFFER_REGION,
+        CAPTURE_RENDER_FRAME_BUFFER_TO_FRAME_BUFFER,
+        CAPTURE_RENDER_FRAME_BUFFER_TO_QUAD,
+        CAPTURE_BIND_FRAME_BUFFER,
+        CAPTURE_ENABLE_BLENDING,
+        CAPTURE_DISABLE_BLENDING,
+        CAPTURE_SET_BLEND_FUNCTION,
+        CAPTURE_SET_BLEND_FUNCTION_SEPERATE,
+        CAPTURE_ENABLE_DEPTH_TESTING,
+        CAPTURE_DISABLE_DEPTH_TESTING,
+        CAPTURE_ENABLE_SCISSOR_TESTING,
+        CAPTURE_DISABLE_SCISSOR_TESTING,
+        CAPTURE_SET_SCISSOR_REGION,
+        CAPTURE_SET_FRAME_BUFFER_SCISSOR_REGION,
+        CAPTURE_ENABLE_DEFERRED_BATCHING,
+        CAPTURE_DISABLE_DEFERRED_BATCHING,
+        CAPTURE_SET_DRAW_LAYER,
+        CAPTURE_SET_DRAW_LAYER_SORTED_BY_STATE,
+        CAPTURE_RENDER_TEXT,
+
+        // added after the first version, kept at the end so older captures still replay
+        CAPTURE_CREATE_MATERIAL,
+        CAPTURE_DELETE_MATERIAL,
+        CAPTURE_SET_MATERIAL,
+        CAPTURE_RENDER_SPRITE_MATERIAL,
+        CAPTURE_BUILD_ATLAS,
+        CAPTURE_CREATE_SPRITE_SHEET_ARRAY
+    };
+
+    template<typename T>
+    struct CaptureArray
+    {
+        const T* values;
+        uint32_t count;
+    };
+
+    struct CaptureFrame
+    {
+        float game_scale;
+        std::vector<uint8_t> data;
+    };
+
+    struct CaptureFile
+    {
+        uint32_t window_width;
+        uint32_t window_height;
+        std::vector<uint8_t> setup;
+        std::vector<CaptureFrame> frames;
+
+        // strings are written once per stream and referred to by index after that
+        std::vector<std::string> setup_strings;
+        std::vector<std::string> frame_strings;
+    };
+
+    namespace Capture
+    {
+        // true while frames are being captured, the hooks in the Graphics:: functions check this first so they cost nothing otherwise
+        extern std::atomic<bool> capturing;
+
+        // only the outermost Graphics:: call is recorded (DrawRect calling DrawLineStrip is just a DrawRect), and frame calls
+        // only from the thread that started the capture. resource calls go to the setup log whether capturing or not
+        struct Scope
+        {
+            bool recording = false;
+            bool entered = false;
+
+            Scope(const bool setup = false);
+            ~Scope();
+        };
+
+        void WriteValue(const uint8_t value);
+        void WriteValue(const int value);
+        void WriteValue(const uint32_t value);
+        void WriteValue(const float value);
+        void WriteValue(const bool value);
+        void WriteValue(const Vec2& value);
+        void WriteValue(const Vec3& value);
+        void WriteValue(const Vec4& value);
+        void WriteValue(const std::string& value);
+        void WriteValue(const char* value);
+        void WriteValue(const Graphics::SpriteDraw& value);
+
+        template<typename T>
+        typename std::enable_if<std::is_enum<T>::value>::type WriteValue(const T value)
+        {
+            WriteValue((uint32_t)value);
+        }
+
+        template<typename T>
+        void WriteValue(const CaptureArray<T>& array)
+        {
+            WriteValue(array.count);
+            for(uint32_t i = 0; i < array.count; ++i)
+            {
+                WriteValue(array.values[i]);
+            }
+        }
+
+        template<typename... Args>
+        void Record(const CaptureOp op, const Args&... args)
+        {
+            WriteValue((uint8_t)op);
+            int expand[] = { 0, (WriteValue(args), 0)... };
+            (void)expand;
+        }
+
+        // textures and sprite sheets are recorded by name, these are only looked up while capturing
+        std::string GetTextureName(const uint32_t texture_id);
+        std::string GetSpriteSheetName(const SpriteSheet* sprite_sheet);
+
+        // captures the next frame_count frames (Engine::Render ends each one) and writes them out once they're done
+        void BeginCapture(const std::string& file_name, const uint32_t frame_count);
+        void EndCapture();
+        void EndFrame();
+
+        bool SaveCapture(const std::string& file_name);
+        bool LoadCapture(const std::string& file_name, CaptureFile& capture);
+
+        // replaying goes through the normal Graphics:: functions, resource file names are relative to the working directory.
+        // a frame is only its draw calls, clearing and swapping are left to the caller like Engine::Render does
+        void ReplaySetup(CaptureFile& capture);
+        void ReplayFrame(CaptureFile& capture, const uint32_t frame_index);
+    };
+};
+
+#endif
\ No newline at end of file
@@ -34,6 +34,11 @@ namespace Honeybear
         void Render();
         void Quit();
 
+        // moves the gl context onto a render thread that submits and swaps frame N while this thread records frame N + 1,
+        // call it after all the textures, fonts, shaders and frame buffers have been created
+        void EnableRenderThread();
+        void StopRenderThread();
+
         double Ticks();
 
         void SetDrawCallback(draw_function func);
@@ -5,13 +5,75 @@
 #include <map>
 #include <unordered_map>
 #include <string>
+#include <functional>
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
 #include "maths.h"
+#include "profiler.h"
+
+// the persistent mapped batch buffers have a region per frame in flight, each big enough for this many full batches.
+// every flush draws from where the last one ended in the current region, so a small flush only uses what it wrote. a
+// region is fenced once at the end of the frame (or early if it runs out of room for another full batch) and is only
+// waited on when the ring comes back around to it, which the batch break diagnostics count (BatchBreakSummary::buffer_waits)
+#define BATCH_FRAMES_IN_FLIGHT 3
+#define BATCH_REGION_BATCHES 2
+
+// texture units 0 to BATCH_MAX_TEXTURE_SLOTS - 1 belong to the batch when the active shader samples from "images[]",
+// any extra samplers a custom shader wants should use the units above TEXTURE_SCRATCH_UNIT
+#define BATCH_MAX_TEXTURE_SLOTS 8
+
+// per draw shader parameters, see CreateMaterial. each material is MATERIAL_VEC4_COUNT vec4s in a buffer texture that
+// shaders with a "materials" samplerBuffer read from this unit
+#define MATERIAL_VEC4_COUNT 2
+#define MAX_MATERIALS 16384
+#define MATERIAL_TEXTURE_UNIT BATCH_MAX_TEXTURE_SLOTS
+
+// sprite sheets made into a texture array (see CreateSpriteSheetArray) are bound here for shaders with a "sprite_sheets"
+// sampler2DArray. their vertices get this texture slot, and the array layer to sample in the texture layer
+#define TEXTURE_ARRAY_UNIT (MATERIAL_TEXTURE_UNIT + 1)
+#define TEXTURE_ARRAY_SLOT BATCH_MAX_TEXTURE_SLOTS
+#define MAX_TEXTURE_ARRAY_LAYERS 255
+
+// a batch vertex's texture slot, texture array layer and material index share one integer attribute (location 3),
+// the slot in the low byte, the layer in the next and the material index in the top 16 bits
+#define VERTEX_TEXTURE_SLOT_MASK 0xffu
+#define VERTEX_TEXTURE_LAYER_SHIFT 8
+#define VERTEX_MATERIAL_INDEX_SHIFT 16
+
+// textures are uploaded and read back on this unit (see BindScratchTexture) so that never replaces what's bound for drawing
+#define TEXTURE_SCRATCH_UNIT (TEXTURE_ARRAY_UNIT + 1)
+
+// linked programs are kept in here between runs so warm startups skip compiling, deleting it just makes the next start cold
+#define SHADER_CACHE_FILE_NAME "shader_cache.bin"
+
+// ends a line strip so the next one can go in the same draw (the fixed restart index for 32 bit indices)
+#define PRIMITIVE_RESTART_INDEX 0xffffffff
+
+// miter joins longer than this many half widths get bevelled instead
+#define LINE_MITER_LIMIT 4.0f
+
+// what the Get*Handle functions return for a resource that doesn't exist, using it does nothing
+#define INVALID_HANDLE 0xffffffff
 
 namespace Honeybear
 {
+    // indices into the dense resource tables, looked up by name once so the per frame calls never hash a string
+    struct ShaderHandle
+    {
+        uint32_t index = INVALID_HANDLE;
+    };
+
+    struct FontHandle
+    {
+        uint32_t index = INVALID_HANDLE;
+    };
+
+    struct TextureHandle
+    {
+        uint32_t index = INVALID_HANDLE;
+    };
+
     struct Texture
     {
         GLuint ID;
@@ -23,6 +85,17 @@ namespace Honeybear
         GLuint image_format;
         GLuint wrap_s;
         GLuint wrap_t;
+
+        TextureHandle handle;
+    };
+
+    struct TextureArray
+    {
+        GLuint ID;
+
+        uint32_t width;
+        uint32_t height;
+        uint32_t layer_count;
     };
 
     struct SpriteSheet
@@ -30,6 +103,10 @@ namespace Honeybear
         Texture* diffuse;
         Texture* specular;
         Texture* normal;
+
+        // set once the sheet is in a texture array, its diffuse, specular and normal are the three layers from array_layer
+        TextureArray* texture_array = nullptr;
+        uint32_t array_layer = 0;
     };
 
     struct Sprite
@@ -46,6 +123,9 @@ namespace Honeybear
         float texture_y;
         float texture_w;
         float texture_h;
+
+        // packed into an atlas turned 90 degrees clockwise, the texture rect is the turned one
+        bool rotated = false;
     };
 
     enum SpriteSheetLayer
@@ -63,18 +143,109 @@ namespace Honeybear
             LINEAR
         };
 
+        enum LineJoin
+        {
+            MITER_JOIN,
+            BEVEL_JOIN,
+            ROUND_JOIN
+        };
+
+        enum LineCap
+        {
+            BUTT_CAP,
+            SQUARE_CAP,
+            ROUND_CAP
+        };
+
         struct Vertex
         {
             Vec3 position;
             Vec2 tex_coords;
             Vec4 colour;
+            uint32_t packed_indices; // texture slot, texture layer and material index, see VERTEX_TEXTURE_SLOT_MASK
+        };
+
+        // build with HONEYBEAR_PACKED_VERTICES defined to batch with this 24 byte layout instead of the 40 byte Vertex,
+        // uvs get clamped to 0..1 and z (the msdf distance factor for text) is stored as a half float.
+        // it was 20 bytes before materials and texture arrays, the packed indices take 4 bytes which doesn't fit next to
+        // z in the 4 the slot used to share with it. getting back to 20 would mean sharing z with the material index, so
+        // z would only be usable in text batches. the padding keeps the position floats of every vertex 4 byte aligned
+        #ifdef HONEYBEAR_PACKED_VERTICES
+        struct PackedVertex
+        {
+            Vec2 position;
+            uint16_t tex_coords[2];
+            uint32_t colour;
+            uint16_t z;
+            uint8_t padding[2];
+            uint32_t packed_indices;
+        };
+
+        typedef PackedVertex BatchVertex;
+        typedef uint32_t BatchColour;
+        #else
+        typedef Vertex BatchVertex;
+        typedef Vec4 BatchColour;
+        #endif
+
+        // one per sprite drawn with RenderSpriteInstanced, the quad is built in the vertex shader
+        struct SpriteInstance
+        {
+            Vec3 position;
+            Vec2 size;
+            Vec2 origin;
+            float angle_radians;
+            uint16_t tex_rect[4]; // normalised x, y, w, h
+            uint32_t colour;      // rgba8
+            float texture_slot;
+            float texture_layer;
+        };
+
+        // one per shape drawn with the sdf shape functions, every shape is a box with rounded corners
+        // (circles and capsules have fully rounded corners), thickness 0 fills it, otherwise it's an outline
+        struct ShapeInstance
+        {
+            Vec2 centre;
+            Vec2 half_size;
+            float corner_radius;
+            float thickness;
+            float angle_radians;
+            uint32_t colour; // rgba8
+        };
+
+        // one per sprite drawn with RenderSprites
+        struct SpriteDraw
+        {
+            const Sprite* sprite;
+            Vec3 position;
+            Vec2 size;
+            Vec2 origin;
+            float angle_degrees;
+            Vec4 colour;
+            SpriteSheetLayer sprite_sheet_layer;
+        };
+
+        // what a custom shader reads for one draw, from texelFetch(materials, MaterialIndex * MATERIAL_VEC4_COUNT + i)
+        struct Material
+        {
+            Vec4 params[MATERIAL_VEC4_COUNT];
         };
 
         enum BatchType
         {
             TEXTURE,
             LINES,
-            FONT
+            LINE_STRIPS,
+            FONT,
+            SPRITE_INSTANCES,
+            SHAPE_INSTANCES,
+            DEFERRED_CALL
+        };
+
+        enum BatchStreamingMode
+        {
+            ORPHANING,          // re-specify the buffer storage then copy the cpu side buffers in with glBufferSubData
+            PERSISTENT_MAPPED   // write straight into persistently mapped gpu memory (needs GL 4.4 / ARB_buffer_storage)
         };
 
         struct Batch
@@ -83,17 +254,153 @@ namespace Honeybear
             GLuint VBO;
             GLuint IB;
 
+            // same vertex buffer as VAO but with the prebuilt 16 bit quad indices, used while quads_only is true
+            GLuint quad_VAO;
+            GLuint quad_IB;
+            bool quads_only = true;
+
             GLuint shape_texture;
 
-            Vertex* buffer = nullptr;
-            Vertex* buffer_ptr = nullptr;
+            // the textures this batch samples from, bound to units 0..texture_slot_count - 1
+            GLuint texture_slots[BATCH_MAX_TEXTURE_SLOTS];
+            uint8_t texture_slot_count = 0;
+            uint8_t max_texture_slots = 1;
+            uint32_t current_texture_slot = 0;
+
+            // the one texture array this batch samples from, and the layer written into the vertices using it
+            GLuint texture_array = 0;
+            uint32_t current_texture_layer = 0;
+
+            // written into every vertex, set by the RenderSprite overload that takes a material
+            uint32_t current_material_index = 0;
+
+            BatchVertex* buffer = nullptr;
+            BatchVertex* buffer_ptr = nullptr;
 
             uint32_t* index_buffer = nullptr;
             uint32_t current_index_offset;
             uint32_t index_count;
 
+            // instanced sprites have their own buffers
+            GLuint instance_VAO;
+            GLuint instance_VBO;
+            SpriteInstance* instance_buffer = nullptr;
+            SpriteInstance* instance_buffer_ptr = nullptr;
+            uint32_t instance_count = 0;
+
+            // so do sdf shapes
+            GLuint shape_VAO;
+            GLuint shape_VBO;
+            ShapeInstance* shape_buffer = nullptr;
+            ShapeInstance* shape_buffer_ptr = nullptr;
+            uint32_t shape_count = 0;
+
             bool draw_lines = false;
             BatchType batch_type = TEXTURE;
+
+            BatchStreamingMode streaming_mode = ORPHANING;
+
+            // orphaning mode only: the cpu side buffers uploaded at each flush. buffer and index_buffer point at the draw
+            // queue arena while it's recording, BeginBatch always points them back here
+            BatchVertex* staging_buffer = nullptr;
+            uint32_t* staging_index_buffer = nullptr;
+
+            // persistent mapped mode only: the whole mapped range, the region for this frame and how much of it the
+            // flushes so far have used. the batch being written starts at base_vertex and base_index in the buffers
+            BatchVertex* mapped_buffer = nullptr;
+            uint32_t* mapped_index_buffer = nullptr;
+            uint32_t current_region = 0;
+            uint32_t region_vertex_cursor = 0;
+            uint32_t region_index_cursor = 0;
+            uint32_t base_vertex = 0;
+            uint32_t base_index = 0;
+            GLsync region_fences[BATCH_FRAMES_IN_FLIGHT] = {};
+        };
+
+        // a run of recorded geometry that all shares the same state, see EnableDeferredBatching
+        struct DrawCommand
+        {
+            uint64_t sort_key;
+            uint32_t frame_buffer_index;
+            GLuint texture_id;
+            BatchType batch_type;
+            uint32_t shader_index;
+            uint8_t layer;
+
+            // where the geometry lives in the draw queue arena
+            uint32_t first_vertex;
+            uint32_t vertex_count;
+            uint32_t first_index;
+            uint32_t index_count;
+
+            // DEFERRED_CALL commands run this entry of the calls recorded alongside them instead of drawing
+            uint32_t call_index;
+        };
+
+        struct DrawQueue
+        {
+            bool recording = false;
+
+            std::vector<DrawCommand> commands;
+            std::vector<DrawCommand> sorted_commands;
+
+            // while recording the batch writes into these instead of the gpu buffers
+            std::vector<BatchVertex> vertices;
+            std::vector<uint32_t> indices;
+
+            // shaders are stored in the commands as an index into this
+            std::vector<ShaderHandle> shaders;
+            uint32_t current_shader_index = 0;
+            bool shader_dirty = false;
+
+            uint8_t current_layer = 0;
+            bool layer_sorted_by_state[256] = {};
+
+            // static batches are recorded into the queue too, but never drawn from it
+            bool static_batch_recording = false;
+            bool resume_after_static_batch = false;
+
+            // set while this thread is recording into a draw list, which is never drawn from the queue either
+            struct DrawList* draw_list = nullptr;
+            std::vector<std::function<void()>> calls;
+        };
+
+        // recorded on any thread with the normal Render/Fill/Draw functions between BeginDrawList and EndDrawList,
+        // then drawn on the gl thread with SubmitDrawList. the vectors keep their capacity between frames
+        struct DrawList
+        {
+            std::vector<DrawCommand> commands;
+            std::vector<BatchVertex> vertices;
+            std::vector<uint32_t> indices;
+            std::vector<ShaderHandle> shaders;
+
+            // gl state changes (uniforms, blending, frame buffer composites...) made while recording, run in order when submitted
+            std::vector<std::function<void()>> calls;
+
+            uint32_t vertex_count = 0;
+            uint32_t index_count = 0;
+
+            // the recording thread's shader before BeginDrawList, put back by EndDrawList
+            ShaderHandle previous_shader;
+        };
+
+        struct StaticBatchRun
+        {
+            ShaderHandle shader;
+            uint32_t translation_uniform; // index into the shader's uniforms, found when the batch is built
+            GLuint texture_id;
+            BatchType batch_type;
+            uint32_t first_index;
+            uint32_t index_count;
+        };
+
+        struct StaticBatch
+        {
+            GLuint VAO;
+            GLuint VBO;
+            GLuint IB;
+
+            std::vector<StaticBatchRun> runs;
         };
 
         struct FrameBuffer
@@ -128,6 +435,19 @@ namespace Honeybear
             GLuint matrices;
         };
 
+        // material 0 is all zeros, it's what everything drawn without a material gets
+        struct MaterialBuffer
+        {
+            GLuint TBO;
+            GLuint texture;
+            std::vector<Material> materials;
+            std::vector<uint32_t> free_materials;
+
+            // what's changed since the last upload, uploaded before the next batch is drawn
+            uint32_t dirty_first = 0;
+            uint32_t dirty_end = 0;
+        };
+
         struct ScreenRenderData
         {
             GLuint quad_VAO;
@@ -171,30 +491,93 @@ namespace Honeybear
 
         struct MSDF_Font
         {
+            std::string font_id;
+            FontHandle handle;
             Texture* texture;
             float tallest_char_height;
             std::map<int, MSDF_CharData> data;
             std::map<int, MSDF_FontData> font_data;
         };
 
-        extern std::unordered_map<std::string, uint32_t> shaders;
+        // a uniform found once by name, the setters that take one skip the string lookups and don't upload
+        // (or flush the batch for) a value the program already has
+        struct UniformHandle
+        {
+            uint32_t program_index = INVALID_HANDLE;
+            uint32_t uniform_index = INVALID_HANDLE;
+            GLenum type = GL_NONE;
+        };
+
+        struct ShaderUniform
+        {
+            std::string name;
+            GLint location;
+            GLenum type;
+            GLint size; // array length, 1 for everything else
+
+            // where this uniform's last uploaded value lives in the program's cache, and how many words of it are known
+            uint32_t cache_offset;
+            uint32_t cache_size;
+            uint32_t cached_words;
+        };
+
+        // a shader keeps its index when it's created again, and its uniforms are built from the linked program's active
+        // uniforms keeping theirs, so handles survive a reload (ones that aren't in the new program just get a location of -1)
+        struct ShaderProgram
+        {
+            std::string shader_id;
+            GLuint program;
+            uint8_t texture_slots;
+            std::vector<ShaderUniform> uniforms;
+
+            // true from CreateShaderProgram until FinishShaderProgram checks the link, the first time the shader is used.
+            // the shaders are only set when it was compiled from source rather than loaded from the cache
+            bool pending = false;
+            GLuint vertex_shader = 0;
+            GLuint fragment_shader = 0;
+            uint64_t cache_key = 0;
+            std::unordered_map<std::string, uint32_t> uniform_indices;
+            std::vector<uint32_t> cache;
+        };
+
+        extern std::vector<ShaderProgram> shader_programs;
+        extern std::unordered_map<std::string, uint32_t> shader_indices;
         extern std::unordered_map<std::string, Texture> textures;
+        extern std::vector<Texture*> texture_handles;
         extern std::map<uint8_t, uint32_t> bound_textures;
         extern std::unordered_map<std::string, SpriteSheet*> sprite_sheets;
+        extern std::unordered_map<std::string, TextureArray> texture_arrays;
         extern std::unordered_map<uint32_t, Sprite> sprites;
         extern std::unordered_map<std::string, MSDF_Font> msdf_fonts;
+        extern std::vector<MSDF_Font*> font_handles;
         extern std::vector<FrameBuffer> frame_buffers;
         extern uint32_t current_frame_buffer_index;
         extern UniformBlocks uniform_blocks;
+        extern MaterialBuffer material_buffer;
 
-        extern std::string activated_shader_id;
+        // each thread records into its own batch and draw queue, only the gl thread's ones are ever drawn
+        extern thread_local ShaderHandle activated_shader;
+
+        // the built in shaders, created by Init
+        extern ShaderHandle default_shader;
+        extern ShaderHandle msdf_font_shader;
+        extern ShaderHandle sprite_instanced_shader;
+        extern ShaderHandle shape_shader;
+        extern ShaderHandle shape_quad_shader;
 
         extern GLFWwindow* window;
 
-        extern Batch batch;
+        // the window size the frame is drawn at. glfw only lets the main thread ask for it, so it's kept here by Init,
+        // ChangeResolution and UpdateFrameWindowSize, and the render thread is handed the size with every frame it submits
+        extern thread_local int frame_window_width;
+        extern thread_local int frame_window_height;
+
+        extern thread_local Batch batch;
+        extern thread_local DrawQueue draw_queue;
+        extern std::vector<StaticBatch> static_batches;
         extern ScreenRenderData screen_render_data;
 
-        void Init(uint32_t window_width, uint32_t window_height, const std::string& window_title);
+        void Init(uint32_t window_width, uint32_t window_height, const std::string& window_title, const bool hidden = false);
         void SetClearColour(const Vec4& colour);
         void SetClearColour(const uint32_t frame_buffer_index, const Vec4& colour);
         void Clear();
@@ -205,18 +588,38 @@ namespace Honeybear
         void UpdateScreenRenderData();
         void UpdateScreenRenderData(const uint32_t frame_buffer_index, const float x, const float y, const float w, const float h);
         void InitUniformBlocks();
+        void InitShaderCompiler();
+        void InitMaterialBuffer();
+
+        void UpdateFrameWindowSize();
+
+        // gl calls from a thread without the context (the main thread once the render thread owns it) wait until the
+        // next draw list is submitted. on the context's own thread they run straight away
+        void RunWithContext(const std::function<void()>& call);
+        void RunPendingContextCalls();
 
         void ChangeResolution(const uint32_t width, const uint32_t height);
         void GetResolution(int* width, int* height);
         void ToggleFullscreen(const bool enabled);
         void ToggleVSync(const bool enabled);
 
-        void LoadShader(const std::string& shader_id, const char* vertex_file_name, const char* fragment_file_name);
-        void CreateShaderProgram(const std::string& shader_id, const char* vertex_code, const char* fragment_code);
+        ShaderHandle LoadShader(const std::string& shader_id, const char* vertex_file_name, const char* fragment_file_name);
+        ShaderHandle CreateShaderProgram(const std::string& shader_id, const char* vertex_code, const char* fragment_code);
+        void FinishShaderProgram(ShaderProgram& program);
+
+        // shaders finish linking the first time they're used, call this once everything is loaded to wait for them all up front
+        void FinishShaderPrograms();
+
+        // writes the program binaries out if any were added since the last save, FinishShaderPrograms and shutdown call it
+        void SaveShaderCache();
+        ShaderProgram& GetShaderProgram(const ShaderHandle shader);
+        ShaderHandle GetShaderHandle(const std::string& shader_id);
         void ActivateShader(const std::string& shader_id);
+        void ActivateShader(const ShaderHandle shader);
         void DeactivateShader();
 
         void SetShaderProjection(const std::string& shader_id, const float left, const float right, const float bottom, const float top, const float z_near, const float z_far);
+        void SetShaderProjection(const ShaderHandle shader, const float left, const float right, const float bottom, const float top, const float z_near, const float z_far);
 
         void SetShaderFloat(const std::string& shader_id, const std::string& uniform_name, const float value);
         void SetShaderInt(const std::string& shader_id, const std::string& uniform_name, const int value);
@@ -231,15 +634,53 @@ namespace Honeybear
         void SetShaderTexture(const std::string& shader_id, const std::string& uniform_name, const GLuint texture_id, const uint8_t texture_unit);
         void SetShaderFramebufferTexture(const std::string& shader_id, const std::string& uniform_name, const uint32_t frame_buffer_index, const uint8_t texture_unit);
 
+        UniformHandle GetUniformHandle(const std::string& shader_id, const std::string& uniform_name);
+        void SetShaderFloat(const UniformHandle& uniform, const float value);
+        void SetShaderInt(const UniformHandle& uniform, const int value);
+        void SetShaderVec2(const UniformHandle& uniform, const Vec2& value);
+        void SetShaderVec3(const UniformHandle& uniform, const Vec3& value);
+        void SetShaderVec4(const UniformHandle& uniform, const Vec4& value);
+        void SetShaderFloatArray(const UniformHandle& uniform, const float* values, const size_t n);
+        void SetShaderIntArray(const UniformHandle& uniform, const int* values, const size_t n);
+        void SetShaderVec2Array(const UniformHandle& uniform, const Vec2* values, const size_t n);
+        void SetShaderVec3Array(const UniformHandle& uniform, const Vec3* values, const size_t n);
+        void SetShaderVec4Array(const UniformHandle& uniform, const Vec4* values, const size_t n);
+        void SetShaderTexture(const UniformHandle& uniform, const GLuint texture_id, const uint8_t texture_unit);
+        void SetShaderFramebufferTexture(const UniformHandle& uniform, const uint32_t frame_buffer_index, const uint8_t texture_unit);
+        void SetShaderUniform(const UniformHandle& uniform, const GLenum value_type, const void* values, const uint32_t count);
+        void LoadShaderUniforms(ShaderProgram& program);
+
+        // materials let sprites drawn with different shader parameters share a batch, setting one never flushes.
+        // a material's values are read when its batch is drawn, so sprites that need different values in the
+        // same frame need a material each
+        uint32_t CreateMaterial(const Material& material = Material());
+        void SetMaterial(const uint32_t material_index, const Material& material);
+        void DeleteMaterial(const uint32_t material_index);
+        void UploadMaterials();
+
         Texture* LoadTexture(const std::string& texture_file_name, const FilterType filter_type);
+        // rgba pixels already in memory, these aren't recorded by captures so whatever made them has to be
+        Texture* CreateTexture(const std::string& texture_name, const uint8_t* data, const uint32_t width, const uint32_t height, const FilterType filter_type);
+        TextureHandle GetTextureHandle(const std::string& texture_file_name);
+        Texture* GetTexture(const TextureHandle texture);
         void BindTexture(const GLuint texture_id, const uint8_t texture_unit);
         void CheckAndUnbindTexture(const GLuint texture_id);
+        void BindTextureArray(const GLuint texture_id);
+
+        // leaves TEXTURE_SCRATCH_UNIT active with the texture bound to target, put GL_TEXTURE0 back once done with it
+        void BindScratchTexture(const GLenum target, const GLuint texture_id);
+        bool IsTextureArray(const GLuint texture_id);
 
         void LoadSpritesFile(const std::string& file_name, const FilterType filter_type);
         SpriteSheet* LoadSpriteSheet(const std::string& sprite_sheet_name, const char* diffuse, const char* specular, const char* normal, const FilterType filter_type);
         void CreateSprite(const uint32_t sprite_id, SpriteSheet* sprite_sheet, int tex_x, int tex_y, int tex_w, int tex_h);
         Sprite* GetSprite(const uint32_t sprite_id);
 
+        // copies the diffuse, specular and normal textures of each sheet into layers of one array, so sprites from any of
+        // them (and any of their layers) batch without rebinding. the sheets all have to be the same size, a single sheet is fine too.
+        // drawn with DIFFUSE, a lighting shader finds the specular and normal maps one and two layers after the texture layer
+        TextureArray* CreateSpriteSheetArray(const std::string& texture_array_name, const std::vector<std::string>& sprite_sheet_names, const FilterType filter_type);
+
         void RenderSprite(const Sprite& sprite, const Vec2& position, const uint32_t frame_buffer_index, const Vec4& colour = Vec4(1.0f));
         void RenderSprite(const Sprite& sprite, const Vec2& position, const Vec2& size, const uint32_t frame_buffer_index, const Vec4& colour = Vec4(1.0f));
         void RenderSprite(const Sprite& sprite, const Vec2& position, const float angle_degrees, const uint32_t frame_buffer_index, const Vec4& colour = Vec4(1.0f));
@@ -250,16 +691,50 @@ namespace Honeybear
         void RenderSprite(const Sprite& sprite, const Vec3& position, const Vec2& size, const uint32_t frame_buffer_index, const Vec4& colour = Vec4(1.0f));
         void RenderSprite(const Sprite& sprite, const Vec3& position, const uint32_t frame_buffer_index, const SpriteSheetLayer sprite_sheet_layer, const Vec4& colour = Vec4(1.0f));
         void RenderSprite(const Sprite& sprite, const Vec3& position, const Vec2& size, const float angle_degrees, const Vec2& origin, const uint32_t frame_buffer_index, const SpriteSheetLayer sprite_sheet_layer, const Vec4& colour = Vec4(1.0f));
+        void RenderSprite(const Sprite& sprite, const Vec3& position, const Vec2& size, const float angle_degrees, const Vec2& origin, const uint32_t frame_buffer_index, const SpriteSheetLayer sprite_sheet_layer, const uint32_t material_index, const Vec4& colour = Vec4(1.0f));
+
+        void RenderSprites(const SpriteDraw* sprites, const size_t count, const uint32_t frame_buffer_index);
+        void WriteSpriteQuads(const SpriteDraw* sprites, const size_t count, const float pixel_size);
+        GLuint GetSpriteTextureID(const Sprite& sprite, const SpriteSheetLayer sprite_sheet_layer);
+        uint32_t GetSpriteTextureLayer(const Sprite& sprite, const SpriteSheetLayer sprite_sheet_layer);
+        void GetSpriteTexCoords(const Sprite& sprite, float* u, float* v);
+
+        void RenderSpriteInstanced(const Sprite& sprite, const Vec2& position, const float angle_degrees, const Vec2& origin, const uint32_t frame_buffer_index, const Vec4& colour = Vec4(1.0f));
+        void RenderSpriteInstanced(const Sprite& sprite, const Vec3& position, const Vec2& size, const float angle_degrees, const Vec2& origin, const uint32_t frame_buffer_index, const SpriteSheetLayer sprite_sheet_layer, const Vec4& colour = Vec4(1.0f));
+        uint32_t PackColour(const Vec4& colour);
+        BatchColour MakeBatchColour(const Vec4& colour);
+        void PushBatchVertex(const float x, const float y, const float z, const float u, const float v, const BatchColour& colour);
 
         void DrawLine(const Vec2& start, const Vec2& end, const uint32_t frame_buffer_index, const Vec4& colour);
         void DrawRect(const float x, const float y, const float w, const float h, const uint32_t frame_buffer_index, const Vec4& colour);
         void DrawCircle(const Vec2& pos, const float radius, const uint32_t frame_buffer_index, const Vec4& colour);
+        void DrawArc(const Vec2& pos, const float radius, const float start_degrees, const float end_degrees, const uint32_t frame_buffer_index, const Vec4& colour);
         void DrawPoly(const std::vector<Vec2>& points, const uint32_t frame_buffer_index, const Vec4& colour);
 
+        // each point is written once, closed strips loop back to the first point
+        void DrawLineStrip(const Vec2* points, const size_t number_of_points, const bool closed, const uint32_t frame_buffer_index, const Vec4& colour);
+
+        // thick lines made of triangles in the normal texture batch, width is in game units, caps are ignored when closed
+        void DrawPolyline(const std::vector<Vec2>& points, const float width, const LineJoin join, const LineCap cap, const bool closed, const uint32_t frame_buffer_index, const Vec4& colour);
+
+        // anti aliased shapes drawn as a single quad each, thickness is in the same units as the size. they're instanced,
+        // except while deferring where the quad goes through the queue as normal vertices (see PushShapeQuad)
+        void FillSmoothCircle(const Vec2& pos, const float radius, const uint32_t frame_buffer_index, const Vec4& colour);
+        void DrawSmoothCircle(const Vec2& pos, const float radius, const float thickness, const uint32_t frame_buffer_index, const Vec4& colour);
+        void FillRoundedRect(const float x, const float y, const float w, const float h, const float corner_radius, const uint32_t frame_buffer_index, const Vec4& colour);
+        void DrawRoundedRect(const float x, const float y, const float w, const float h, const float corner_radius, const float thickness, const uint32_t frame_buffer_index, const Vec4& colour);
+        void DrawThickLine(const Vec2& start, const Vec2& end, const float thickness, const uint32_t frame_buffer_index, const Vec4& colour);
+        void PushShapeInstance(const uint32_t frame_buffer_index, const Vec2& centre, const Vec2& half_size, const float corner_radius, const float thickness, const float angle_radians, const Vec4& colour);
+        void PushShapeQuad(const uint32_t frame_buffer_index, const Vec2& centre, const Vec2& half_size, const float corner_radius, const float thickness, const float angle_radians, const Vec4& colour);
+
         void FillTriangle(const Vec2& pos_a, const Vec2& pos_b, const Vec2& pos_c, const uint32_t frame_buffer_index, const Vec4& colour);
         void FillRect(const float x, const float y, const float w, const float h, const uint32_t frame_buffer_index, const Vec4& colour);
         void FillRect(const float x, const float y, const float z, const float w, const float h, const uint32_t frame_buffer_index, const Vec4& colour);
         void FillCircle(const Vec2& pos, const float radius, const uint32_t frame_buffer_index, const Vec4& colour);
+        void FillPie(const Vec2& pos, const float radius, const float start_degrees, const float end_degrees, const uint32_t frame_buffer_index, const Vec4& colour);
+
+        // unit length points from start to end (anticlockwise) taken from the circle table, returns how many were written (at most sides + 2)
+        int GetArcPoints(const UnitCircle& circle, const float start_degrees, const float end_degrees, Vec2* points);
         void FillConvexPoly(const std::vector<Vec2>& points, const uint32_t frame_buffer_index, const Vec4& colour);
 
         void DrawCustom(size_t num_verts, Vec3* positions, Vec2* tex_coords, Vec4* colours, size_t num_indices, int* indices, const uint32_t frame_buffer_index);
@@ -299,12 +774,52 @@ namespace Honeybear
         void BeginBatch();
         void EndBatch();
         void FlushBatch();
-        void CheckAndStartNewBatch();
-        void DoBatchRenderSetUp(const uint32_t frame_buffer_index, const GLuint tex_id, const uint32_t num_indices, BatchType batch_type = TEXTURE);
+        void FlushSpriteInstances();
+        void FlushShapeInstances();
+        void SetBatchVertexAttributes();
+        void WriteQuadIndices();
+        void UseDynamicIndices();
+        void EnablePrimitiveRestart();
+        void DisablePrimitiveRestart();
+        void CheckAndStartNewBatch(const BatchBreakReason reason = BATCH_BREAK_OTHER, const char* file = HONEYBEAR_CALLER_FILE, const int line = HONEYBEAR_CALLER_LINE);
+        void DoBatchRenderSetUp(const uint32_t frame_buffer_index, const GLuint tex_id, const uint32_t num_indices, const uint32_t num_vertices, BatchType batch_type = TEXTURE, const char* file = HONEYBEAR_CALLER_FILE, const int line = HONEYBEAR_CALLER_LINE);
+        void AdvanceBatchRegion();
+        void WaitForBatchRegion(const uint32_t region);
+        void EndBatchFrame();
+        uint8_t GetBatchTextureSlot(const GLuint tex_id, const char* file = HONEYBEAR_CALLER_FILE, const int line = HONEYBEAR_CALLER_LINE);
+
+        void EnableDeferredBatching();
+        void DisableDeferredBatching();
+        void SetDrawLayer(const uint8_t layer);
+        void SetDrawLayerSortedByState(const uint8_t layer, const bool sorted_by_state);
+        void RecordDrawCommand(const uint32_t frame_buffer_index, const GLuint tex_id, const uint32_t num_indices, const uint32_t num_vertices, BatchType batch_type);
+        void EnsureDrawQueueCapacity();
+        uint64_t MakeDrawSortKey(const DrawCommand& command, const uint32_t sequence);
+        void SortDrawCommands();
+        void FlushDrawQueue(const BatchBreakReason reason = BATCH_BREAK_DEFERRED_QUEUE, const char* file = HONEYBEAR_CALLER_FILE, const int line = HONEYBEAR_CALLER_LINE);
+        void CloseDrawCommandRanges();
+        void EmitDrawCommands(const std::vector<DrawCommand>& commands, const std::vector<ShaderHandle>& shaders, const std::vector<std::function<void()>>& calls, const BatchVertex* vertices, const uint32_t* indices);
+
+        // while recording a draw list the Render/Fill/Draw functions record geometry and the functions that change gl state
+        // record themselves to be called when the list is submitted. resources (textures, fonts, shaders, frame buffers)
+        // have to be created outside of draw lists, and not on a thread that is already deferring or recording a static batch
+        void BeginDrawList(DrawList* draw_list);
+        void EndDrawList();
+        void SubmitDrawList(const DrawList& draw_list);
+        void SubmitDrawLists(const DrawList* const* draw_lists, const size_t num_draw_lists);
+        bool RecordDrawListCall(const std::function<void()>& call);
+
+        void BeginStaticBatch();
+        uint32_t EndStaticBatch();
+        void DrawStaticBatch(const uint32_t static_batch_index, const uint32_t frame_buffer_index, const Vec2& offset = Vec2(0.0f));
+        void DeleteStaticBatch(const uint32_t static_batch_index);
 
         MSDF_Font* LoadMSDFFont(const std::string& font_id, const std::string& font_atlas_file_name, const std::string& font_data_file_name);
+        FontHandle GetFontHandle(const std::string& font_id);
         void RenderText(const std::string& text, const Vec2& position, const std::string& font_id, const float size, const uint32_t frame_buffer_index, const Vec4& colour = Vec4(1.0f));
+        void RenderText(const std::string& text, const Vec2& position, const FontHandle font_handle, const float size, const uint32_t frame_buffer_index, const Vec4& colour = Vec4(1.0f));
         void CalcTextDimensions(const std::string& text, const std::string& font_id, const float size, float* width, float* height);
+        void CalcTextDimensions(const std::string& text, const FontHandle font_handle, const float size, float* width, float* height);
     }
 };
 
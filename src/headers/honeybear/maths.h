@@ -3,6 +3,12 @@
 
 #define PI 3.14159265358979323846
 
+// circles are tessellated from precomputed tables with a power of two number of sides in this range
+#define UNIT_CIRCLE_MIN_SIDES 8
+#define UNIT_CIRCLE_MAX_SIDES 512
+
+#include <cstdint>
+
 namespace Honeybear
 {
     struct Vec3;
@@ -89,6 +95,72 @@ namespace Honeybear
 
     float SmallestAngleDiff(const float a, const float b);
 
+    uint16_t FloatToHalf(const float value);
+
+    // ------------------------
+    // ** UNIT CIRCLE TABLES **
+    // ------------------------
+
+    // taylor series so the tables can be built at compile time, only accurate for x in [-pi, pi]
+    constexpr double ConstexprSin(const double x)
+    {
+        double term = x;
+        double sum = x;
+        for(int i = 1; i < 16; ++i)
+        {
+            term *= -x * x / ((2 * i) * (2 * i + 1));
+            sum += term;
+        }
+        return sum;
+    }
+
+    constexpr double ConstexprCos(const double x)
+    {
+        double term = 1.0;
+        double sum = 1.0;
+        for(int i = 1; i < 16; ++i)
+        {
+            term *= -x * x / ((2 * i - 1) * (2 * i));
+            sum += term;
+        }
+        return sum;
+    }
+
+    template<int SIDES>
+    struct UnitCircleTable
+    {
+        // one extra point that wraps back round to the first so closed loops don't need a modulo
+        float x[SIDES + 1];
+        float y[SIDES + 1];
+
+        constexpr UnitCircleTable() :
+            x(),
+            y()
+        {
+            for(int i = 0; i <= SIDES; ++i)
+            {
+                // shifted by pi into the range the series is good for, then flipped back
+                double angle = 2.0 * PI * (i % SIDES) / SIDES - PI;
+                x[i] = (float)-ConstexprCos(angle);
+                y[i] = (float)-ConstexprSin(angle);
+            }
+        }
+    };
+
+    // a view of one of the tables, point i is at (x[i], y[i]) and point sides is the same as point 0
+    struct UnitCircle
+    {
+        const float* x;
+        const float* y;
+        int sides;
+    };
+
+    // smallest table with at least this many sides, clamped to the largest one
+    UnitCircle GetUnitCircle(const int min_sides);
+
+    // enough sides that the edges never stray more than a quarter of a pixel from the true circle
+    int CircleSidesForRadius(const float radius_in_pixels);
+
     // -------------------
     // ** INTERPOLATION **
     // -------------------
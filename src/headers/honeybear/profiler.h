@@ -0,0 +1,154 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+#include "maths.h"
+
+// gpu timer results are read back this many frames late, by then the gpu is done with them so reading never waits
+#define GPU_TIMER_FRAME_LATENCY 4
+
+// timestamps per frame, any marks past this are ignored for the rest of the frame
+#define GPU_TIMER_MAX_QUERIES_PER_FRAME 256
+
+// where a function was called from, used as a default argument so it's the caller's file and line (gcc, clang and msvc 2019+)
+#if defined(__GNUC__) || defined(__clang__) || (defined(_MSC_VER) && _MSC_VER >= 1926)
+    #define HONEYBEAR_CALLER_FILE __builtin_FILE()
+    #define HONEYBEAR_CALLER_LINE __builtin_LINE()
+#else
+    #define HONEYBEAR_CALLER_FILE ""
+    #define HONEYBEAR_CALLER_LINE 0
+#endif
+
+// the defaults above only reach as far as the renderer's own call. in a build with HONEYBEAR_BATCH_DIAGNOSTICS defined, a
+// Graphics call wrapped in this, e.g. HONEYBEAR_CALL_SITE(Graphics::RenderSprite(...)), has any batch break it causes
+// reported at the game's file and line instead. otherwise it's just the call
+#ifdef HONEYBEAR_BATCH_DIAGNOSTICS
+    #define HONEYBEAR_CALL_SITE(...) [&]() { Honeybear::Profiler::CallSite honeybear_call_site(__FILE__, __LINE__); return __VA_ARGS__; }()
+#else
+    #define HONEYBEAR_CALL_SITE(...) (__VA_ARGS__)
+#endif
+
+namespace Honeybear
+{
+    // why the batch was drawn before it was full
+    enum BatchBreakReason
+    {
+        BATCH_BREAK_OTHER,
+        BATCH_BREAK_CAPACITY,
+        BATCH_BREAK_BATCH_TYPE,
+        BATCH_BREAK_TEXTURE_SLOTS,
+        BATCH_BREAK_SHADER,
+        BATCH_BREAK_SHADER_UNIFORM,
+        BATCH_BREAK_FRAME_BUFFER,
+        BATCH_BREAK_RENDER_FRAME_BUFFER,
+        BATCH_BREAK_RENDER_STATE,
+        BATCH_BREAK_DEFERRED_QUEUE,
+        BATCH_BREAK_REASON_COUNT
+    };
+
+    struct BatchBreak
+    {
+        BatchBreakReason reason;
+
+        // the line in the renderer that asked for the flush (the draw function, SetShader* call and so on), or the game's
+        // line when the call was wrapped in HONEYBEAR_CALL_SITE
+        const char* file;
+        int line;
+
+        uint32_t vertex_count;
+        uint32_t index_count;
+        uint32_t instance_count;
+    };
+
+    struct BatchBreakSite
+    {
+        BatchBreakReason reason;
+        const char* file;
+        int line;
+        uint32_t count;
+    };
+
+    struct BatchBreakSummary
+    {
+        uint32_t total;
+        uint32_t reason_counts[BATCH_BREAK_REASON_COUNT];
+        uint32_t vertex_count;
+        uint32_t index_count;
+        uint32_t instance_count;
+
+        // times the batch had to wait for the gpu to finish with the next frame's region of the streaming buffers
+        uint32_t buffer_waits;
+
+        // most frequent first
+        std::vector<BatchBreakSite> sites;
+    };
+
+    struct GPUPassTime
+    {
+        std::string name;
+        float milliseconds;
+
+        // how many separate times the pass was entered during the frame
+        uint32_t count;
+    };
+
+    namespace Profiler
+    {
+        // the query objects are created (and deleted) at the start of the next gpu frame, so these can be called from any thread
+        void EnableGPUTimers();
+        void DisableGPUTimers();
+        bool GPUTimersEnabled();
+
+        // the engine calls these around each frame on the thread that owns the gl context
+        void BeginGPUFrame();
+        void EndGPUFrame();
+
+        // passes are flat, a timestamp is written at every mark and the gpu time until the next one goes to the pass named here
+        void MarkGPUPass(const std::string& name);
+        void MarkFrameBufferPass(const uint32_t frame_buffer_index);
+
+        // times everything between begin and end under name, then goes back to timing whatever pass was active before,
+        // anything already batched is flushed first so it's counted in the right pass
+        void BeginGPUPass(const std::string& name);
+        void EndGPUPass();
+
+        // results from the most recent frame that has come back from the gpu
+        std::vector<GPUPassTime> GetGPUPassTimes();
+        float GetGPUPassTime(const std::string& name);
+        float GetGPUFrameTime();
+
+        // one line per pass drawn with RenderText
+        void RenderGPUTimes(const Vec2& position, const std::string& font_id, const float size, const uint32_t frame_buffer_index, const Vec4& colour = Vec4(1.0f));
+
+        // every batch flush gets recorded with its reason while this is on, the results are per frame (SwapBuffers ends a frame)
+        void EnableBatchBreakDiagnostics();
+        void DisableBatchBreakDiagnostics();
+        bool BatchBreakDiagnosticsEnabled();
+
+        // set for this thread while a HONEYBEAR_CALL_SITE call runs, nested wrapped calls keep the outermost site
+        struct CallSite
+        {
+            bool entered = false;
+
+            CallSite(const char* file, const int line);
+            ~CallSite();
+        };
+
+        void RecordBatchBreak(const BatchBreakReason reason, const char* file, const int line, const uint32_t vertex_count, const uint32_t index_count, const uint32_t instance_count);
+        void RecordBatchBufferWait();
+        void EndBatchBreakFrame();
+
+        // the last finished frame
+        std::vector<BatchBreak> GetBatchBreaks();
+        BatchBreakSummary GetBatchBreakSummary();
+        const char* GetBatchBreakReasonName(const BatchBreakReason reason);
+
+        // writes the summary and then every break of the last finished frame as text
+        bool DumpBatchBreaks(const std::string& file_name);
+    };
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,69 @@
+#ifndef TILEMAP_H
+#define TILEMAP_H
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+#include "maths.h"
+#include "geometry.h"
+
+// tile maps are split into chunks of this many tiles square, each chunk is baked into its own static batch
+#define TILE_MAP_CHUNK_SIZE 32
+
+// tile ids are sprite ids, this one means there's nothing there
+#define EMPTY_TILE 0xffffffff
+
+namespace Honeybear
+{
+    struct TileMapChunk
+    {
+        uint32_t tiles[TILE_MAP_CHUNK_SIZE * TILE_MAP_CHUNK_SIZE];
+
+        // only rebaked when a tile in the chunk changes
+        bool dirty = true;
+        bool has_static_batch = false;
+        uint32_t static_batch_index = 0;
+    };
+
+    struct TileMap
+    {
+        // size in tiles
+        uint32_t width;
+        uint32_t height;
+
+        float tile_width;
+        float tile_height;
+
+        Vec2 position;
+        uint32_t frame_buffer_index;
+
+        uint32_t chunks_x;
+        uint32_t chunks_y;
+        std::vector<TileMapChunk> chunks;
+
+        // the game scale the chunks were baked at, everything gets rebaked if it changes
+        float baked_scale = 0.0f;
+    };
+
+    namespace TileMaps
+    {
+        TileMap* CreateTileMap(const uint32_t width, const uint32_t height, const float tile_width, const float tile_height, const uint32_t frame_buffer_index);
+        void DeleteTileMap(TileMap* tile_map);
+
+        void SetTile(TileMap* tile_map, const uint32_t x, const uint32_t y, const uint32_t tile_id);
+        uint32_t GetTile(const TileMap* tile_map, const uint32_t x, const uint32_t y);
+
+        void RenderTileMap(TileMap* tile_map, const Rect& view);
+        void BakeChunk(TileMap* tile_map, const uint32_t chunk_x, const uint32_t chunk_y);
+
+        // binary maps store the tiles already split into chunks so loading is just a read per chunk
+        TileMap* LoadTileMap(const std::string& file_name, const uint32_t frame_buffer_index);
+        bool SaveTileMap(const TileMap* tile_map, const std::string& file_name);
+
+        // only the first tile layer of csv encoded maps is imported, tile ids are the tiled gid minus the first gid
+        TileMap* ImportTiledJSON(const std::string& file_name, const uint32_t frame_buffer_index);
+    };
+};
+
+#endif
\ No newline at end of file
@@ -8,6 +8,7 @@
 #include "honeybear/geometry.h"
 #include "honeybear/stb_image.h"
 #include "honeybear/engine.h"
+#include "honeybear/capture.h"
 
 using namespace Honeybear;
 
@@ -218,6 +219,10 @@ void Implementation::BeginFrame()
         full_screen = !full_screen;
         Graphics::ToggleFullscreen(full_screen);
     }
+    if(Input::WasKeyPressed(Input::KEY_F9))
+    {
+        Capture::BeginCapture("capture.hbcp", 120);
+    }
     if(Input::WasKeyPressed(Input::KEY_F10))
     {
         v_sync = !v_sync;
@@ -1,4 +1,5 @@
 #include <cmath>
+#include <cstring>
 #include "maths.h"
 
 using namespace Honeybear;
@@ -508,4 +509,58 @@ Vec2& Honeybear::operator/=(Vec2& a, const float b)
     a.x /= b;
     a.y /= b;
     return a;
+}
+
+uint16_t Honeybear::FloatToHalf(const float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+
+    uint32_t sign = (bits >> 16) & 0x8000;
+    int32_t exponent = (int32_t)((bits >> 23) & 0xff) - 127 + 15;
+    uint32_t mantissa = bits & 0x7fffff;
+
+    // too small for a half (no denormals), flush to zero
+    if(exponent <= 0) return sign;
+
+    // too big (or inf/nan), clamp to infinity
+    if(exponent >= 31) return sign | 0x7c00;
+
+    // round to nearest, a carry out of the mantissa correctly bumps the exponent
+    uint32_t half = sign | (exponent << 10) | (mantissa >> 13);
+    if(mantissa & 0x1000) half++;
+
+    return half;
+}
+
+// the tables are built by the compiler, nothing is computed at start up
+namespace
+{
+    constexpr UnitCircleTable<8> unit_circle_8;
+    constexpr UnitCircleTable<16> unit_circle_16;
+    constexpr UnitCircleTable<32> unit_circle_32;
+    constexpr UnitCircleTable<64> unit_circle_64;
+    constexpr UnitCircleTable<128> unit_circle_128;
+    constexpr UnitCircleTable<256> unit_circle_256;
+    constexpr UnitCircleTable<512> unit_circle_512;
+
+    static_assert(UNIT_CIRCLE_MIN_SIDES == 8 && UNIT_CIRCLE_MAX_SIDES == 512, "unit circle tables don't match the side range");
+}
+
+UnitCircle Honeybear::GetUnitCircle(const int min_sides)
+{
+    if(min_sides <= 8) return { unit_circle_8.x, unit_circle_8.y, 8 };
+    if(min_sides <= 16) return { unit_circle_16.x, unit_circle_16.y, 16 };
+    if(min_sides <= 32) return { unit_circle_32.x, unit_circle_32.y, 32 };
+    if(min_sides <= 64) return { unit_circle_64.x, unit_circle_64.y, 64 };
+    if(min_sides <= 128) return { unit_circle_128.x, unit_circle_128.y, 128 };
+    if(min_sides <= 256) return { unit_circle_256.x, unit_circle_256.y, 256 };
+    return { unit_circle_512.x, unit_circle_512.y, 512 };
+}
+
+int Honeybear::CircleSidesForRadius(const float radius_in_pixels)
+{
+    // small angle version of acos(2 * (1 - e / r)^2 - 1) with e = 0.25, saves the acos per circle
+    if(radius_in_pixels <= 0.0f) return UNIT_CIRCLE_MIN_SIDES;
+    return (int)std::ceil(2.0f * (float)PI * std::sqrt(radius_in_pixels * 0.5f));
 }
\ No newline at end of file
@@ -0,0 +1,439 @@
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <cstdio>
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include "graphics.h"
+#include "profiler.h"
+
+using namespace Honeybear;
+
+namespace
+{
+    const uint32_t FRAME_END_LABEL = 0xffffffff;
+
+    struct GPUTimerFrame
+    {
+        GLuint queries[GPU_TIMER_MAX_QUERIES_PER_FRAME];
+        uint32_t labels[GPU_TIMER_MAX_QUERIES_PER_FRAME];
+        uint32_t count = 0;
+
+        // written but not read back yet
+        bool pending = false;
+    };
+
+    std::atomic<bool> gpu_timers_enabled(false);
+
+    // everything below here belongs to the thread with the gl context
+    bool queries_created = false;
+    bool in_gpu_frame = false;
+    GPUTimerFrame gpu_frames[GPU_TIMER_FRAME_LATENCY];
+    uint32_t current_gpu_frame = 0;
+
+    std::vector<std::string> labels;
+    std::unordered_map<std::string, uint32_t> label_ids;
+    std::vector<uint32_t> frame_buffer_label_ids;
+    std::vector<uint32_t> pass_stack;
+
+    // the last frame read back, the only thing other threads look at
+    std::mutex results_mutex;
+    std::vector<GPUPassTime> results;
+    float frame_milliseconds = 0.0f;
+
+    std::atomic<bool> batch_break_diagnostics_enabled(false);
+
+    // breaks are collected on the thread that draws the batch, the finished frame is copied out under the mutex
+    std::vector<BatchBreak> current_batch_breaks;
+    std::mutex batch_breaks_mutex;
+    std::vector<BatchBreak> last_batch_breaks;
+    uint32_t current_buffer_waits = 0;
+    uint32_t last_buffer_waits = 0;
+
+    // the game's call site while a HONEYBEAR_CALL_SITE call runs on this thread
+    thread_local const char* call_site_file = nullptr;
+    thread_local int call_site_line = 0;
+
+    const char* batch_break_reason_names[BATCH_BREAK_REASON_COUNT] = {
+        "other",
+        "capacity",
+        "batch type",
+        "texture slots",
+        "shader",
+        "shader uniform",
+        "frame buffer",
+        "render frame buffer",
+        "render state",
+        "deferred queue"
+    };
+
+    uint32_t GetLabelID(const std::string& name)
+    {
+        auto it = label_ids.find(name);
+        if(it != label_ids.end()) return it->second;
+
+        uint32_t id = labels.size();
+        labels.push_back(name);
+        label_ids[name] = id;
+        return id;
+    }
+
+    void WriteTimestamp(const uint32_t label)
+    {
+        GPUTimerFrame& frame = gpu_frames[current_gpu_frame];
+
+        // the last query is always kept for the end of the frame
+        if(label != FRAME_END_LABEL && frame.count >= GPU_TIMER_MAX_QUERIES_PER_FRAME - 1) return;
+
+        // nothing to time if the pass hasn't changed
+        if(frame.count > 0 && frame.labels[frame.count - 1] == label) return;
+
+        glQueryCounter(frame.queries[frame.count], GL_TIMESTAMP);
+        frame.labels[frame.count] = label;
+        frame.count++;
+    }
+
+    void ReadBackFrame(GPUTimerFrame& frame)
+    {
+        frame.pending = false;
+        if(frame.count < 2) return;
+
+        // the queries finish in order so if the last one is there they all are, if it isn't the frame is just dropped
+        GLint available = 0;
+        glGetQueryObjectiv(frame.queries[frame.count - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if(!available) return;
+
+        GLuint64 timestamps[GPU_TIMER_MAX_QUERIES_PER_FRAME];
+        for(uint32_t i = 0; i < frame.count; ++i)
+        {
+            glGetQueryObjectui64v(frame.queries[i], GL_QUERY_RESULT, &timestamps[i]);
+        }
+
+        // each pass gets the time from its timestamp to the next one, passes stay in the order they first appeared
+        std::vector<GPUPassTime> frame_results;
+        std::unordered_map<uint32_t, size_t> result_indices;
+        for(uint32_t i = 0; i + 1 < frame.count; ++i)
+        {
+            uint32_t label = frame.labels[i];
+            float milliseconds = (float)((timestamps[i + 1] - timestamps[i]) / 1000000.0);
+
+            auto it = result_indices.find(label);
+            if(it == result_indices.end())
+            {
+                result_indices[label] = frame_results.size();
+                frame_results.push_back({ labels[label], milliseconds, 1 });
+            }
+            else
+            {
+                frame_results[it->second].milliseconds += milliseconds;
+                frame_results[it->second].count++;
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(results_mutex);
+        results.swap(frame_results);
+        frame_milliseconds = (float)((timestamps[frame.count - 1] - timestamps[0]) / 1000000.0);
+    }
+}
+
+void Profiler::EnableGPUTimers()
+{
+    gpu_timers_enabled = true;
+}
+
+void Profiler::DisableGPUTimers()
+{
+    gpu_timers_enabled = false;
+}
+
+bool Profiler::GPUTimersEnabled()
+{
+    return gpu_timers_enabled;
+}
+
+void Profiler::BeginGPUFrame()
+{
+    if(!gpu_timers_enabled)
+    {
+        if(queries_created)
+        {
+            for(uint32_t i = 0; i < GPU_TIMER_FRAME_LATENCY; ++i)
+            {
+                glDeleteQueries(GPU_TIMER_MAX_QUERIES_PER_FRAME, gpu_frames[i].queries);
+                gpu_frames[i].count = 0;
+                gpu_frames[i].pending = false;
+            }
+            queries_created = false;
+        }
+        return;
+    }
+
+    if(!queries_created)
+    {
+        for(uint32_t i = 0; i < GPU_TIMER_FRAME_LATENCY; ++i)
+        {
+            glGenQueries(GPU_TIMER_MAX_QUERIES_PER_FRAME, gpu_frames[i].queries);
+        }
+        queries_created = true;
+    }
+
+    // this slot was last used GPU_TIMER_FRAME_LATENCY frames ago
+    GPUTimerFrame& frame = gpu_frames[current_gpu_frame];
+    if(frame.pending) ReadBackFrame(frame);
+    frame.count = 0;
+
+    // anything before the first pass (clearing and so on)
+    pass_stack.clear();
+    pass_stack.push_back(GetLabelID("other"));
+    WriteTimestamp(pass_stack.back());
+
+    in_gpu_frame = true;
+}
+
+void Profiler::EndGPUFrame()
+{
+    if(!in_gpu_frame) return;
+
+    WriteTimestamp(FRAME_END_LABEL);
+    gpu_frames[current_gpu_frame].pending = true;
+    current_gpu_frame = (current_gpu_frame + 1) % GPU_TIMER_FRAME_LATENCY;
+
+    in_gpu_frame = false;
+}
+
+void Profiler::MarkGPUPass(const std::string& name)
+{
+    if(!in_gpu_frame) return;
+
+    uint32_t label = GetLabelID(name);
+    pass_stack.back() = label;
+    WriteTimestamp(label);
+}
+
+void Profiler::MarkFrameBufferPass(const uint32_t frame_buffer_index)
+{
+    if(!in_gpu_frame) return;
+
+    // the names are only built once per frame buffer
+    while(frame_buffer_label_ids.size() <= frame_buffer_index)
+    {
+        frame_buffer_label_ids.push_back(GetLabelID("frame buffer " + std::to_string(frame_buffer_label_ids.size())));
+    }
+
+    uint32_t label = frame_buffer_label_ids[frame_buffer_index];
+    pass_stack.back() = label;
+    WriteTimestamp(label);
+}
+
+void Profiler::BeginGPUPass(const std::string& name)
+{
+    if(Graphics::RecordDrawListCall([=]() { BeginGPUPass(name); })) return;
+    if(!in_gpu_frame) return;
+
+    Graphics::CheckAndStartNewBatch();
+
+    uint32_t label = GetLabelID(name);
+    pass_stack.push_back(label);
+    WriteTimestamp(label);
+}
+
+void Profiler::EndGPUPass()
+{
+    if(Graphics::RecordDrawListCall([=]() { EndGPUPass(); })) return;
+    if(!in_gpu_frame || pass_stack.size() < 2) return;
+
+    Graphics::CheckAndStartNewBatch();
+
+    pass_stack.pop_back();
+    WriteTimestamp(pass_stack.back());
+}
+
+std::vector<GPUPassTime> Profiler::GetGPUPassTimes()
+{
+    std::lock_guard<std::mutex> lock(results_mutex);
+    return results;
+}
+
+float Profiler::GetGPUPassTime(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(results_mutex);
+    for(size_t i = 0; i < results.size(); ++i)
+    {
+        if(results[i].name == name) return results[i].milliseconds;
+    }
+
+    return 0.0f;
+}
+
+float Profiler::GetGPUFrameTime()
+{
+    std::lock_guard<std::mutex> lock(results_mutex);
+    return frame_milliseconds;
+}
+
+void Profiler::RenderGPUTimes(const Vec2& position, const std::string& font_id, const float size, const uint32_t frame_buffer_index, const Vec4& colour)
+{
+    std::vector<GPUPassTime> pass_times = GetGPUPassTimes();
+    float total = GetGPUFrameTime();
+
+    char line[128];
+    Vec2 cursor = position;
+
+    std::snprintf(line, sizeof(line), "gpu %.3f ms", total);
+    Graphics::RenderText(line, cursor, font_id, size, frame_buffer_index, colour);
+
+    for(size_t i = 0; i < pass_times.size(); ++i)
+    {
+        cursor.y += size;
+        std::snprintf(line, sizeof(line), "%s %.3f ms (%u)", pass_times[i].name.c_str(), pass_times[i].milliseconds, pass_times[i].count);
+        Graphics::RenderText(line, cursor, font_id, size, frame_buffer_index, colour);
+    }
+}
+
+void Profiler::EnableBatchBreakDiagnostics()
+{
+    batch_break_diagnostics_enabled = true;
+}
+
+void Profiler::DisableBatchBreakDiagnostics()
+{
+    batch_break_diagnostics_enabled = false;
+}
+
+bool Profiler::BatchBreakDiagnosticsEnabled()
+{
+    return batch_break_diagnostics_enabled;
+}
+
+Profiler::CallSite::CallSite(const char* file, const int line)
+{
+    if(call_site_file) return;
+
+    entered = true;
+    call_site_file = file;
+    call_site_line = line;
+}
+
+Profiler::CallSite::~CallSite()
+{
+    if(entered) call_site_file = nullptr;
+}
+
+void Profiler::RecordBatchBreak(const BatchBreakReason reason, const char* file, const int line, const uint32_t vertex_count, const uint32_t index_count, const uint32_t instance_count)
+{
+    if(call_site_file)
+    {
+        current_batch_breaks.push_back({ reason, call_site_file, call_site_line, vertex_count, index_count, instance_count });
+        return;
+    }
+
+    current_batch_breaks.push_back({ reason, file, line, vertex_count, index_count, instance_count });
+}
+
+void Profiler::RecordBatchBufferWait()
+{
+    current_buffer_waits++;
+}
+
+void Profiler::EndBatchBreakFrame()
+{
+    if(!batch_break_diagnostics_enabled && current_batch_breaks.empty() && current_buffer_waits == 0) return;
+
+    std::lock_guard<std::mutex> lock(batch_breaks_mutex);
+    last_batch_breaks.swap(current_batch_breaks);
+    current_batch_breaks.clear();
+    last_buffer_waits = current_buffer_waits;
+    current_buffer_waits = 0;
+}
+
+std::vector<BatchBreak> Profiler::GetBatchBreaks()
+{
+    std::lock_guard<std::mutex> lock(batch_breaks_mutex);
+    return last_batch_breaks;
+}
+
+BatchBreakSummary Profiler::GetBatchBreakSummary()
+{
+    std::vector<BatchBreak> batch_breaks = GetBatchBreaks();
+
+    BatchBreakSummary summary = {};
+    summary.total = batch_breaks.size();
+    {
+        std::lock_guard<std::mutex> lock(batch_breaks_mutex);
+        summary.buffer_waits = last_buffer_waits;
+    }
+
+    for(size_t i = 0; i < batch_breaks.size(); ++i)
+    {
+        const BatchBreak& batch_break = batch_breaks[i];
+        summary.reason_counts[batch_break.reason]++;
+        summary.vertex_count += batch_break.vertex_count;
+        summary.index_count += batch_break.index_count;
+        summary.instance_count += batch_break.instance_count;
+
+        // the file strings come from __builtin_FILE so the same file is (almost always) the same pointer, compare the text anyway
+        auto site = std::find_if(summary.sites.begin(), summary.sites.end(), [&](const BatchBreakSite& s)
+        {
+            return s.reason == batch_break.reason && s.line == batch_break.line && std::string(s.file) == batch_break.file;
+        });
+
+        if(site == summary.sites.end())
+        {
+            summary.sites.push_back({ batch_break.reason, batch_break.file, batch_break.line, 1 });
+        }
+        else
+        {
+            site->count++;
+        }
+    }
+
+    std::stable_sort(summary.sites.begin(), summary.sites.end(), [](const BatchBreakSite& a, const BatchBreakSite& b) { return a.count > b.count; });
+
+    return summary;
+}
+
+const char* Profiler::GetBatchBreakReasonName(const BatchBreakReason reason)
+{
+    if(reason >= BATCH_BREAK_REASON_COUNT) return "unknown";
+    return batch_break_reason_names[reason];
+}
+
+bool Profiler::DumpBatchBreaks(const std::string& file_name)
+{
+    std::ofstream file(file_name);
+    if(!file.is_open())
+    {
+        std::cout << "ERROR::PROFILER: Failed to open batch break dump file: " << file_name << std::endl;
+        return false;
+    }
+
+    std::vector<BatchBreak> batch_breaks = GetBatchBreaks();
+    BatchBreakSummary summary = GetBatchBreakSummary();
+
+    file << "batches: " << summary.total << " vertices: " << summary.vertex_count << " indices: " << summary.index_count << " instances: " << summary.instance_count << " buffer waits: " << summary.buffer_waits << "\n\n";
+
+    file << "by reason\n";
+    for(int i = 0; i < BATCH_BREAK_REASON_COUNT; ++i)
+    {
+        if(summary.reason_counts[i] == 0) continue;
+        file << "    " << GetBatchBreakReasonName((BatchBreakReason)i) << ": " << summary.reason_counts[i] << "\n";
+    }
+
+    file << "\nby site\n";
+    for(size_t i = 0; i < summary.sites.size(); ++i)
+    {
+        const BatchBreakSite& site = summary.sites[i];
+        file << "    " << site.count << " x " << GetBatchBreakReasonName(site.reason) << " at " << site.file << ":" << site.line << "\n";
+    }
+
+    file << "\nin order\n";
+    for(size_t i = 0; i < batch_breaks.size(); ++i)
+    {
+        const BatchBreak& batch_break = batch_breaks[i];
+        file << "    " << i << ": " << GetBatchBreakReasonName(batch_break.reason) << " at " << batch_break.file << ":" << batch_break.line;
+        file << " (" << batch_break.vertex_count << " vertices, " << batch_break.index_count << " indices, " << batch_break.instance_count << " instances)\n";
+    }
+
+    return true;
+}
\ No newline at end of file
@@ -0,0 +1,364 @@
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include "engine.h"
+#include "graphics.h"
+#include "tilemap.h"
+
+using namespace Honeybear;
+
+namespace
+{
+    const char TILE_MAP_FILE_MAGIC[4] = { 'H', 'B', 'T', 'M' };
+    const uint32_t TILE_MAP_FILE_VERSION = 1;
+
+    // tiled stores the flip flags in the top bits of each gid
+    const uint32_t TILED_GID_MASK = 0x1fffffff;
+
+    // finds "key" in the outermost object of the json and reads the number after it
+    bool FindTopLevelNumber(const std::string& json, const std::string& key, double* value)
+    {
+        std::string quoted_key = "\"" + key + "\"";
+        int depth = 0;
+        bool in_string = false;
+
+        for(size_t i = 0; i < json.size(); ++i)
+        {
+            char c = json[i];
+            if(in_string)
+            {
+                if(c == '\\') ++i;
+                else if(c == '"') in_string = false;
+                continue;
+            }
+
+            if(c == '"')
+            {
+                if(depth == 1 && json.compare(i, quoted_key.size(), quoted_key) == 0)
+                {
+                    size_t colon = json.find(':', i + quoted_key.size());
+                    if(colon == std::string::npos) return false;
+                    *value = std::strtod(json.c_str() + colon + 1, nullptr);
+                    return true;
+                }
+                in_string = true;
+            }
+            else if(c == '{' || c == '[') depth++;
+            else if(c == '}' || c == ']') depth--;
+        }
+
+        return false;
+    }
+
+    TileMapChunk* GetChunk(TileMap* tile_map, const uint32_t x, const uint32_t y)
+    {
+        uint32_t chunk_x = x / TILE_MAP_CHUNK_SIZE;
+        uint32_t chunk_y = y / TILE_MAP_CHUNK_SIZE;
+        return &tile_map->chunks[chunk_y * tile_map->chunks_x + chunk_x];
+    }
+}
+
+TileMap* TileMaps::CreateTileMap(const uint32_t width, const uint32_t height, const float tile_width, const float tile_height, const uint32_t frame_buffer_index)
+{
+    TileMap* tile_map = new TileMap();
+    tile_map->width = width;
+    tile_map->height = height;
+    tile_map->tile_width = tile_width;
+    tile_map->tile_height = tile_height;
+    tile_map->position = Vec2(0.0f);
+    tile_map->frame_buffer_index = frame_buffer_index;
+
+    tile_map->chunks_x = (width + TILE_MAP_CHUNK_SIZE - 1) / TILE_MAP_CHUNK_SIZE;
+    tile_map->chunks_y = (height + TILE_MAP_CHUNK_SIZE - 1) / TILE_MAP_CHUNK_SIZE;
+    tile_map->chunks.resize(tile_map->chunks_x * tile_map->chunks_y);
+
+    for(size_t i = 0; i < tile_map->chunks.size(); ++i)
+    {
+        std::fill(tile_map->chunks[i].tiles, tile_map->chunks[i].tiles + TILE_MAP_CHUNK_SIZE * TILE_MAP_CHUNK_SIZE, EMPTY_TILE);
+    }
+
+    return tile_map;
+}
+
+void TileMaps::DeleteTileMap(TileMap* tile_map)
+{
+    for(size_t i = 0; i < tile_map->chunks.size(); ++i)
+    {
+        if(tile_map->chunks[i].has_static_batch)
+        {
+            Graphics::DeleteStaticBatch(tile_map->chunks[i].static_batch_index);
+        }
+    }
+
+    delete tile_map;
+}
+
+void TileMaps::SetTile(TileMap* tile_map, const uint32_t x, const uint32_t y, const uint32_t tile_id)
+{
+    if(x >= tile_map->width || y >= tile_map->height) return;
+
+    TileMapChunk* chunk = GetChunk(tile_map, x, y);
+    uint32_t* tile = &chunk->tiles[(y % TILE_MAP_CHUNK_SIZE) * TILE_MAP_CHUNK_SIZE + (x % TILE_MAP_CHUNK_SIZE)];
+
+    if(*tile != tile_id)
+    {
+        *tile = tile_id;
+        chunk->dirty = true;
+    }
+}
+
+uint32_t TileMaps::GetTile(const TileMap* tile_map, const uint32_t x, const uint32_t y)
+{
+    if(x >= tile_map->width || y >= tile_map->height) return EMPTY_TILE;
+
+    const TileMapChunk& chunk = tile_map->chunks[(y / TILE_MAP_CHUNK_SIZE) * tile_map->chunks_x + (x / TILE_MAP_CHUNK_SIZE)];
+    return chunk.tiles[(y % TILE_MAP_CHUNK_SIZE) * TILE_MAP_CHUNK_SIZE + (x % TILE_MAP_CHUNK_SIZE)];
+}
+
+void TileMaps::RenderTileMap(TileMap* tile_map, const Rect& view)
+{
+    // baking makes gl calls, so inside a draw list the whole thing waits until the list is submitted
+    if(Graphics::RecordDrawListCall([=]() { RenderTileMap(tile_map, view); })) return;
+
+    if(tile_map->chunks.empty()) return;
+
+    // baked vertices are already scaled, so a new game scale means baking everything again
+    float pixel_size = 1.0f;
+    if(Graphics::frame_buffers[tile_map->frame_buffer_index].use_auto_scaling) pixel_size = Honeybear::game_scale;
+    if(tile_map->baked_scale != pixel_size)
+    {
+        for(size_t i = 0; i < tile_map->chunks.size(); ++i)
+        {
+            tile_map->chunks[i].dirty = true;
+        }
+        tile_map->baked_scale = pixel_size;
+    }
+
+    // work out which chunks the view covers
+    float chunk_width = tile_map->tile_width * TILE_MAP_CHUNK_SIZE;
+    float chunk_height = tile_map->tile_height * TILE_MAP_CHUNK_SIZE;
+
+    int first_x = (int)std::floor((view.Left() - tile_map->position.x) / chunk_width);
+    int last_x = (int)std::floor((view.Right() - tile_map->position.x) / chunk_width);
+    int first_y = (int)std::floor((view.Top() - tile_map->position.y) / chunk_height);
+    int last_y = (int)std::floor((view.Bottom() - tile_map->position.y) / chunk_height);
+
+    first_x = std::max(first_x, 0);
+    first_y = std::max(first_y, 0);
+    last_x = std::min(last_x, (int)tile_map->chunks_x - 1);
+    last_y = std::min(last_y, (int)tile_map->chunks_y - 1);
+
+    if(first_x > last_x || first_y > last_y) return;
+
+    // bake before drawing anything so the static batch recording doesn't get split up by the draws
+    for(int y = first_y; y <= last_y; ++y)
+    {
+        for(int x = first_x; x <= last_x; ++x)
+        {
+            if(tile_map->chunks[y * tile_map->chunks_x + x].dirty)
+            {
+                BakeChunk(tile_map, x, y);
+            }
+        }
+    }
+
+    for(int y = first_y; y <= last_y; ++y)
+    {
+        for(int x = first_x; x <= last_x; ++x)
+        {
+            const TileMapChunk& chunk = tile_map->chunks[y * tile_map->chunks_x + x];
+            if(!chunk.has_static_batch) continue;
+
+            Vec2 chunk_position(tile_map->position.x + x * chunk_width, tile_map->position.y + y * chunk_height);
+            Graphics::DrawStaticBatch(chunk.static_batch_index, tile_map->frame_buffer_index, chunk_position);
+        }
+    }
+}
+
+void TileMaps::BakeChunk(TileMap* tile_map, const uint32_t chunk_x, const uint32_t chunk_y)
+{
+    TileMapChunk& chunk = tile_map->chunks[chunk_y * tile_map->chunks_x + chunk_x];
+    chunk.dirty = false;
+
+    if(chunk.has_static_batch)
+    {
+        Graphics::DeleteStaticBatch(chunk.static_batch_index);
+        chunk.has_static_batch = false;
+    }
+
+    // empty chunks don't get a static batch at all
+    bool empty = true;
+    for(size_t i = 0; i < TILE_MAP_CHUNK_SIZE * TILE_MAP_CHUNK_SIZE; ++i)
+    {
+        if(chunk.tiles[i] != EMPTY_TILE)
+        {
+            empty = false;
+            break;
+        }
+    }
+    if(empty) return;
+
+    Vec2 tile_size(tile_map->tile_width, tile_map->tile_height);
+
+    Graphics::BeginStaticBatch();
+
+    for(uint32_t y = 0; y < TILE_MAP_CHUNK_SIZE; ++y)
+    {
+        for(uint32_t x = 0; x < TILE_MAP_CHUNK_SIZE; ++x)
+        {
+            uint32_t tile_id = chunk.tiles[y * TILE_MAP_CHUNK_SIZE + x];
+            if(tile_id == EMPTY_TILE) continue;
+
+            Sprite* sprite = Graphics::GetSprite(tile_id);
+            if(!sprite) continue;
+
+            // positions are relative to the chunk, where the chunk is gets applied when it's drawn
+            Graphics::RenderSprite(*sprite, Vec2(x * tile_size.x, y * tile_size.y), tile_size, tile_map->frame_buffer_index);
+        }
+    }
+
+    chunk.static_batch_index = Graphics::EndStaticBatch();
+    chunk.has_static_batch = true;
+}
+
+TileMap* TileMaps::LoadTileMap(const std::string& file_name, const uint32_t frame_buffer_index)
+{
+    std::ifstream file(file_name, std::ios::binary);
+    if(!file.is_open())
+    {
+        std::cout << "Failed to open tile map " << file_name << std::endl;
+        return nullptr;
+    }
+
+    char magic[4];
+    uint32_t version, width, height, chunk_size;
+    float tile_width, tile_height;
+
+    file.read(magic, sizeof(magic));
+    file.read((char*)&version, sizeof(version));
+    file.read((char*)&width, sizeof(width));
+    file.read((char*)&height, sizeof(height));
+    file.read((char*)&tile_width, sizeof(tile_width));
+    file.read((char*)&tile_height, sizeof(tile_height));
+    file.read((char*)&chunk_size, sizeof(chunk_size));
+
+    if(!file || std::memcmp(magic, TILE_MAP_FILE_MAGIC, sizeof(magic)) != 0 || version != TILE_MAP_FILE_VERSION || chunk_size != TILE_MAP_CHUNK_SIZE)
+    {
+        std::cout << "Invalid tile map " << file_name << std::endl;
+        return nullptr;
+    }
+
+    // the size is only as good as the file, so check there's a chunk's worth of tiles in it for every chunk before
+    // allocating them. done in 64 bits so a huge width or height can't wrap around to something small
+    uint64_t chunks_x = ((uint64_t)width + TILE_MAP_CHUNK_SIZE - 1) / TILE_MAP_CHUNK_SIZE;
+    uint64_t chunks_y = ((uint64_t)height + TILE_MAP_CHUNK_SIZE - 1) / TILE_MAP_CHUNK_SIZE;
+    std::streampos header_end = file.tellg();
+    file.seekg(0, std::ios::end);
+    uint64_t chunk_bytes = (uint64_t)(file.tellg() - header_end);
+    file.seekg(header_end);
+
+    if(chunks_x * chunks_y > chunk_bytes / sizeof(TileMapChunk::tiles))
+    {
+        std::cout << "Tile map " << file_name << " is " << width << "x" << height << " tiles but doesn't have that many in it" << std::endl;
+        return nullptr;
+    }
+
+    TileMap* tile_map = CreateTileMap(width, height, tile_width, tile_height, frame_buffer_index);
+    for(size_t i = 0; i < tile_map->chunks.size(); ++i)
+    {
+        file.read((char*)tile_map->chunks[i].tiles, sizeof(tile_map->chunks[i].tiles));
+    }
+
+    if(!file)
+    {
+        std::cout << "Tile map " << file_name << " is truncated" << std::endl;
+        delete tile_map;
+        return nullptr;
+    }
+
+    return tile_map;
+}
+
+bool TileMaps::SaveTileMap(const TileMap* tile_map, const std::string& file_name)
+{
+    std::ofstream file(file_name, std::ios::binary);
+    if(!file.is_open()) return false;
+
+    uint32_t chunk_size = TILE_MAP_CHUNK_SIZE;
+
+    file.write(TILE_MAP_FILE_MAGIC, sizeof(TILE_MAP_FILE_MAGIC));
+    file.write((const char*)&TILE_MAP_FILE_VERSION, sizeof(TILE_MAP_FILE_VERSION));
+    file.write((const char*)&tile_map->width, sizeof(tile_map->width));
+    file.write((const char*)&tile_map->height, sizeof(tile_map->height));
+    file.write((const char*)&tile_map->tile_width, sizeof(tile_map->tile_width));
+    file.write((const char*)&tile_map->tile_height, sizeof(tile_map->tile_height));
+    file.write((const char*)&chunk_size, sizeof(chunk_size));
+
+    for(size_t i = 0; i < tile_map->chunks.size(); ++i)
+    {
+        file.write((const char*)tile_map->chunks[i].tiles, sizeof(tile_map->chunks[i].tiles));
+    }
+
+    return (bool)file;
+}
+
+TileMap* TileMaps::ImportTiledJSON(const std::string& file_name, const uint32_t frame_buffer_index)
+{
+    std::ifstream file(file_name);
+    if(!file.is_open())
+    {
+        std::cout << "Failed to open tiled map " << file_name << std::endl;
+        return nullptr;
+    }
+
+    std::stringstream json_ss;
+    json_ss << file.rdbuf();
+    std::string json = json_ss.str();
+
+    double width, height, tile_width, tile_height;
+    if(!FindTopLevelNumber(json, "width", &width) || !FindTopLevelNumber(json, "height", &height) ||
+       !FindTopLevelNumber(json, "tilewidth", &tile_width) || !FindTopLevelNumber(json, "tileheight", &tile_height))
+    {
+        std::cout << "Tiled map " << file_name << " is missing its size" << std::endl;
+        return nullptr;
+    }
+
+    uint32_t first_gid = 1;
+    size_t first_gid_pos = json.find("\"firstgid\"");
+    if(first_gid_pos != std::string::npos)
+    {
+        first_gid = std::strtoul(json.c_str() + json.find(':', first_gid_pos) + 1, nullptr, 10);
+    }
+
+    // the data of the first tile layer, base64 and compressed layers aren't supported
+    size_t data_pos = json.find("\"data\"");
+    size_t array_pos = data_pos == std::string::npos ? std::string::npos : json.find_first_not_of(" \t\r\n:", data_pos + 6);
+    if(array_pos == std::string::npos || json[array_pos] != '[')
+    {
+        std::cout << "Tiled map " << file_name << " has no csv tile layer" << std::endl;
+        return nullptr;
+    }
+
+    TileMap* tile_map = CreateTileMap((uint32_t)width, (uint32_t)height, (float)tile_width, (float)tile_height, frame_buffer_index);
+
+    const char* c = json.c_str() + array_pos + 1;
+    for(uint32_t i = 0; i < tile_map->width * tile_map->height; ++i)
+    {
+        char* end;
+        uint32_t gid = std::strtoul(c, &end, 10) & TILED_GID_MASK;
+        if(end == c) break;
+
+        // gid 0 is an empty tile in tiled
+        uint32_t tile_id = gid == 0 ? EMPTY_TILE : gid - first_gid;
+        SetTile(tile_map, i % tile_map->width, i / tile_map->width, tile_id);
+
+        c = end;
+        while(*c == ',' || *c == ' ' || *c == '\r' || *c == '\n' || *c == '\t') ++c;
+    }
+
+    return tile_map;
+}
\ No newline at end of file
@@ -0,0 +1,437 @@
+#include <cmath>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <GLFW/glfw3.h>
+#include "honeybear/graphics.h"
+#include "honeybear/engine.h"
+#include "honeybear/profiler.h"
+
+using namespace Honeybear;
+
+// draws a fixed set of stress scenes in a hidden window and prints the per frame timings as json, run it from the
+// repo root so res/ resolves. on a machine without a display run it under a virtual one (xvfb-run), mesa's llvmpipe is fine
+//
+//   honeybear_bench [--frames n] [--warmup n] [--scene name] [--width w] [--height h] [--output file.json]
+
+namespace
+{
+    const uint32_t SPRITE_IDS[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13 };
+    const uint32_t NUM_SPRITE_IDS = sizeof(SPRITE_IDS) / sizeof(SPRITE_IDS[0]);
+    const uint32_t COMPOSITE_FRAME_BUFFERS = 8;
+
+    struct Scene
+    {
+        const char* name;
+        void (*setup)();
+        void (*draw)(const uint32_t frame);
+
+        // optional, runs each frame before the timer starts
+        void (*prepare)(const uint32_t frame);
+    };
+
+    struct SceneResult
+    {
+        std::string name;
+        uint32_t frames;
+        double cpu_ms;
+        double cpu_ms_p95;
+        double frame_ms;
+        double gpu_ms;
+        double batches;
+        double vertices;
+    };
+
+    uint32_t width = 1920;
+    uint32_t height = 1080;
+
+    uint32_t scene_frame_buffer;
+    uint32_t msaa_frame_buffer;
+    bool msaa_frame_buffer_added = false;
+    std::vector<uint32_t> composite_frame_buffers;
+
+    // every scene draws the same thing on every run
+    uint32_t random_state = 1;
+
+    float Random(const float min, const float max)
+    {
+        random_state ^= random_state << 13;
+        random_state ^= random_state >> 17;
+        random_state ^= random_state << 5;
+        return min + (max - min) * (random_state & 0xffffff) / (float)0xffffff;
+    }
+
+    struct Instance
+    {
+        Vec2 position;
+        Vec2 velocity;
+        float size;
+        float angle;
+        Vec4 colour;
+        uint32_t sprite_id;
+    };
+
+    std::vector<Instance> instances;
+    std::vector<Graphics::SpriteDraw> sprite_draws;
+    std::vector<std::string> strings;
+    std::vector<Vec2> points;
+
+    void MakeInstances(const uint32_t count)
+    {
+        random_state = 1;
+        instances.resize(count);
+        for(size_t i = 0; i < instances.size(); ++i)
+        {
+            Instance& instance = instances[i];
+            instance.position = Vec2(Random(0.0f, width), Random(0.0f, height));
+            instance.velocity = Vec2(Random(-2.0f, 2.0f), Random(-2.0f, 2.0f));
+            instance.size = Random(4.0f, 32.0f);
+            instance.angle = Random(0.0f, 360.0f);
+            instance.colour = Vec4(Random(0.2f, 1.0f), Random(0.2f, 1.0f), Random(0.2f, 1.0f), 1.0f);
+            instance.sprite_id = SPRITE_IDS[i % NUM_SPRITE_IDS];
+        }
+    }
+
+    // the instances drift so no two frames are identical
+    Vec2 InstancePosition(const Instance& instance, const uint32_t frame)
+    {
+        float x = std::fmod(instance.position.x + instance.velocity.x * frame + width, (float)width);
+        float y = std::fmod(instance.position.y + instance.velocity.y * frame + height, (float)height);
+        return Vec2(x, y);
+    }
+
+    void SetUpSprites10k()  { MakeInstances(10000); }
+    void SetUpSprites100k() { MakeInstances(100000); }
+
+    void DrawSprites(const uint32_t frame)
+    {
+        for(size_t i = 0; i < instances.size(); ++i)
+        {
+            const Instance& instance = instances[i];
+            Graphics::RenderSprite(*Graphics::GetSprite(instance.sprite_id), InstancePosition(instance, frame), scene_frame_buffer, instance.colour);
+        }
+    }
+
+    // sprites_100k_scalar and sprites_100k_batched submit the same draws (natural size, rotated, same order), filled in
+    // here outside the timed region, so the only difference between them is RenderSprite per sprite vs RenderSprites
+    void PrepareSpriteDraws(const uint32_t frame)
+    {
+        sprite_draws.resize(instances.size());
+        for(size_t i = 0; i < instances.size(); ++i)
+        {
+            const Instance& instance = instances[i];
+            Graphics::SpriteDraw& sprite_draw = sprite_draws[i];
+            sprite_draw.sprite = Graphics::GetSprite(instance.sprite_id);
+            Vec2 position = InstancePosition(instance, frame);
+            sprite_draw.position = Vec3(position.x, position.y, 0.0f);
+            sprite_draw.size = Vec2(sprite_draw.sprite->width, sprite_draw.sprite->height);
+            sprite_draw.origin = sprite_draw.size * 0.5f;
+            sprite_draw.angle_degrees = instance.angle + frame;
+            sprite_draw.colour = instance.colour;
+            sprite_draw.sprite_sheet_layer = DIFFUSE;
+        }
+    }
+
+    void DrawSpritesScalar(const uint32_t)
+    {
+        for(size_t i = 0; i < sprite_draws.size(); ++i)
+        {
+            const Graphics::SpriteDraw& sprite_draw = sprite_draws[i];
+            Graphics::RenderSprite(*sprite_draw.sprite, sprite_draw.position, sprite_draw.size, sprite_draw.angle_degrees, sprite_draw.origin, scene_frame_buffer, sprite_draw.sprite_sheet_layer, sprite_draw.colour);
+        }
+    }
+
+    void DrawSpritesBatched(const uint32_t)
+    {
+        Graphics::RenderSprites(sprite_draws.data(), sprite_draws.size(), scene_frame_buffer);
+    }
+
+    void DrawRotatedSprites(const uint32_t frame)
+    {
+        for(size_t i = 0; i < instances.size(); ++i)
+        {
+            const Instance& instance = instances[i];
+            Graphics::RenderSprite(*Graphics::GetSprite(instance.sprite_id), InstancePosition(instance, frame), instance.angle + frame, Vec2(16.0f), scene_frame_buffer, instance.colour);
+        }
+    }
+
+    void SetUpText()
+    {
+        MakeInstances(1000);
+        strings.resize(instances.size());
+        for(size_t i = 0; i < strings.size(); ++i)
+        {
+            strings[i] = "honeybear text " + std::to_string(i);
+        }
+    }
+
+    void DrawText(const uint32_t frame)
+    {
+        for(size_t i = 0; i < instances.size(); ++i)
+        {
+            const Instance& instance = instances[i];
+            Graphics::RenderText(strings[i], InstancePosition(instance, frame), "roboto_mono", instance.size, scene_frame_buffer, instance.colour);
+        }
+    }
+
+    void DrawCircles(const uint32_t frame)
+    {
+        for(size_t i = 0; i < instances.size(); ++i)
+        {
+            const Instance& instance = instances[i];
+            if(i % 2 == 0) Graphics::FillCircle(InstancePosition(instance, frame), instance.size, scene_frame_buffer, instance.colour);
+            else Graphics::DrawCircle(InstancePosition(instance, frame), instance.size, scene_frame_buffer, instance.colour);
+        }
+    }
+
+    void DrawPolygons(const uint32_t frame)
+    {
+        points.resize(6);
+        for(size_t i = 0; i < instances.size(); ++i)
+        {
+            const Instance& instance = instances[i];
+            Vec2 centre = InstancePosition(instance, frame);
+            float angle = DegreesToRadians(instance.angle + frame);
+            for(size_t j = 0; j < points.size(); ++j)
+            {
+                float point_angle = angle + j * 2.0f * PI / points.size();
+                points[j] = Vec2(centre.x + std::cos(point_angle) * instance.size, centre.y + std::sin(point_angle) * instance.size);
+            }
+
+            if(i % 2 == 0) Graphics::FillConvexPoly(points, scene_frame_buffer, instance.colour);
+            else Graphics::DrawPoly(points, scene_frame_buffer, instance.colour);
+        }
+    }
+
+    // buffers are only added when their scene runs, every frame buffer gets cleared every frame from then on
+    void SetUpComposite()
+    {
+        MakeInstances(8000);
+        while(composite_frame_buffers.size() < COMPOSITE_FRAME_BUFFERS)
+        {
+            uint32_t frame_buffer_index = Graphics::AddFrameBuffer(width, height);
+            Graphics::SetClearColour(frame_buffer_index, Vec4(0.0f));
+            composite_frame_buffers.push_back(frame_buffer_index);
+        }
+    }
+
+    void DrawComposite(const uint32_t frame)
+    {
+        for(size_t i = 0; i < instances.size(); ++i)
+        {
+            const Instance& instance = instances[i];
+            uint32_t frame_buffer_index = composite_frame_buffers[i % COMPOSITE_FRAME_BUFFERS];
+            Graphics::RenderSprite(*Graphics::GetSprite(instance.sprite_id), InstancePosition(instance, frame), frame_buffer_index, instance.colour);
+        }
+
+        for(size_t i = 0; i < composite_frame_buffers.size(); ++i)
+        {
+            Graphics::RenderFrameBufferToFrameBuffer(composite_frame_buffers[i], scene_frame_buffer);
+        }
+    }
+
+    void SetUpMSAA()
+    {
+        MakeInstances(10000);
+        if(!msaa_frame_buffer_added)
+        {
+            msaa_frame_buffer = Graphics::AddMultiSampledFrameBuffer(width, height, 4);
+            msaa_frame_buffer_added = true;
+        }
+    }
+
+    void DrawMSAA(const uint32_t frame)
+    {
+        for(size_t i = 0; i < instances.size(); ++i)
+        {
+            const Instance& instance = instances[i];
+            Vec2 position = InstancePosition(instance, frame);
+            if(i % 2 == 0) Graphics::FillCircle(position, instance.size, msaa_frame_buffer, instance.colour);
+            else Graphics::FillTriangle(position, position + Vec2(instance.size, instance.size * 0.5f), position + Vec2(0.0f, instance.size), msaa_frame_buffer, instance.colour);
+        }
+
+        Graphics::RenderFrameBufferToFrameBuffer(msaa_frame_buffer, scene_frame_buffer);
+    }
+
+    // scenes that add frame buffers go last so they don't slow down the ones before them
+    const Scene SCENES[] = {
+        { "sprites_10k",          SetUpSprites10k,  DrawSprites,        nullptr },
+        { "sprites_100k",         SetUpSprites100k, DrawSprites,        nullptr },
+        { "sprites_100k_scalar",  SetUpSprites100k, DrawSpritesScalar,  PrepareSpriteDraws },
+        { "sprites_100k_batched", SetUpSprites100k, DrawSpritesBatched, PrepareSpriteDraws },
+        { "rotated_sprites_10k",  SetUpSprites10k,  DrawRotatedSprites, nullptr },
+        { "text_1k",              SetUpText,        DrawText,           nullptr },
+        { "circles_10k",          SetUpSprites10k,  DrawCircles,        nullptr },
+        { "polygons_10k",         SetUpSprites10k,  DrawPolygons,       nullptr },
+        { "composite_8_buffers",  SetUpComposite,   DrawComposite,      nullptr },
+        { "msaa_4x",              SetUpMSAA,        DrawMSAA,           nullptr },
+    };
+
+    SceneResult RunScene(const Scene& scene, const uint32_t warmup_frames, const uint32_t frames)
+    {
+        scene.setup();
+
+        std::vector<double> cpu_times;
+        double frame_total = 0.0;
+        double gpu_total = 0.0;
+        uint32_t gpu_samples = 0;
+        uint64_t batch_total = 0;
+        uint64_t vertex_total = 0;
+
+        for(uint32_t frame = 0; frame < warmup_frames + frames; ++frame)
+        {
+            if(scene.prepare) scene.prepare(frame);
+            double start = glfwGetTime();
+
+            Profiler::BeginGPUFrame();
+            Graphics::Clear();
+            Graphics::ClearFrameBuffers();
+
+            scene.draw(frame);
+            Graphics::RenderFrameBuffer(scene_frame_buffer);
+            double submitted = glfwGetTime();
+
+            Graphics::SwapBuffers();
+            glfwPollEvents();
+            double end = glfwGetTime();
+
+            if(frame < warmup_frames) continue;
+
+            cpu_times.push_back((submitted - start) * 1000.0);
+            frame_total += (end - start) * 1000.0;
+
+            // the batch flushes of the frame just swapped. that isn't the draw call count, frame buffer composites and
+            // static batches are drawn outside the batch so they aren't in it
+            BatchBreakSummary summary = Profiler::GetBatchBreakSummary();
+            batch_total += summary.total;
+            vertex_total += summary.vertex_count;
+
+            // gpu results are a few frames behind, the warm up keeps the previous scene's out of these
+            float gpu_time = Profiler::GetGPUFrameTime();
+            if(gpu_time > 0.0f)
+            {
+                gpu_total += gpu_time;
+                gpu_samples++;
+            }
+        }
+
+        SceneResult result;
+        result.name = scene.name;
+        result.frames = frames;
+
+        double cpu_total = 0.0;
+        for(size_t i = 0; i < cpu_times.size(); ++i)
+        {
+            cpu_total += cpu_times[i];
+        }
+        std::sort(cpu_times.begin(), cpu_times.end());
+
+        result.cpu_ms = cpu_total / frames;
+        result.cpu_ms_p95 = cpu_times[std::min(cpu_times.size() - 1, (size_t)(cpu_times.size() * 0.95))];
+        result.frame_ms = frame_total / frames;
+        result.gpu_ms = gpu_samples ? gpu_total / gpu_samples : -1.0;
+        result.batches = (double)batch_total / frames;
+        result.vertices = (double)vertex_total / frames;
+        return result;
+    }
+
+    std::string JsonString(const char* text)
+    {
+        std::string result = "\"";
+        for(const char* c = text ? text : ""; *c; ++c)
+        {
+            if(*c == '"' || *c == '\\') result += '\\';
+            result += *c;
+        }
+        return result + "\"";
+    }
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t frames = 300;
+    uint32_t warmup_frames = 30;
+    std::string scene_filter;
+    std::string output_file_name;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        bool has_value = i + 1 < argc;
+        if(std::strcmp(argv[i], "--frames") == 0 && has_value)      frames = std::max(1, std::atoi(argv[++i]));
+        else if(std::strcmp(argv[i], "--warmup") == 0 && has_value) warmup_frames = std::max(0, std::atoi(argv[++i]));
+        else if(std::strcmp(argv[i], "--scene") == 0 && has_value)  scene_filter = argv[++i];
+        else if(std::strcmp(argv[i], "--width") == 0 && has_value)  width = std::max(1, std::atoi(argv[++i]));
+        else if(std::strcmp(argv[i], "--height") == 0 && has_value) height = std::max(1, std::atoi(argv[++i]));
+        else if(std::strcmp(argv[i], "--output") == 0 && has_value) output_file_name = argv[++i];
+        else
+        {
+            std::cout << "usage: honeybear_bench [--frames n] [--warmup n] [--scene name] [--width w] [--height h] [--output file.json]" << std::endl;
+            return 1;
+        }
+    }
+
+    // the gpu timers need this many frames before the first result comes back
+    warmup_frames = std::max(warmup_frames, (uint32_t)GPU_TIMER_FRAME_LATENCY);
+
+    Graphics::Init(width, height, "Honeybear Bench", true);
+    if(Graphics::window == nullptr) return 1;
+
+    Graphics::LoadSpritesFile("res/images/sprites.txt", Graphics::NEAREST);
+    Graphics::LoadMSDFFont("roboto_mono", "res/fonts/roboto_mono/atlas.png", "res/fonts/roboto_mono/data.csv");
+
+    scene_frame_buffer = Graphics::AddFrameBuffer(width, height);
+    Graphics::SetClearColour(Vec4(0.0f, 0.0f, 0.0f, 1.0f));
+
+    Profiler::EnableGPUTimers();
+    Profiler::EnableBatchBreakDiagnostics();
+
+    std::vector<SceneResult> results;
+    for(const Scene& scene : SCENES)
+    {
+        if(!scene_filter.empty() && scene_filter != scene.name) continue;
+
+        std::cerr << "running " << scene.name << "..." << std::endl;
+        results.push_back(RunScene(scene, warmup_frames, frames));
+    }
+
+    std::stringstream json;
+    json << "{\n";
+    json << "    \"renderer\": " << JsonString((const char*)glGetString(GL_RENDERER)) << ",\n";
+    json << "    \"gl_version\": " << JsonString((const char*)glGetString(GL_VERSION)) << ",\n";
+    json << "    \"width\": " << width << ",\n";
+    json << "    \"height\": " << height << ",\n";
+    json << "    \"frames\": " << frames << ",\n";
+    json << "    \"scenes\": [\n";
+    for(size_t i = 0; i < results.size(); ++i)
+    {
+        const SceneResult& result = results[i];
+        json << "        { \"name\": " << JsonString(result.name.c_str())
+             << ", \"cpu_ms\": " << result.cpu_ms
+             << ", \"cpu_ms_p95\": " << result.cpu_ms_p95
+             << ", \"frame_ms\": " << result.frame_ms
+             << ", \"gpu_ms\": " << (result.gpu_ms < 0.0 ? std::string("null") : std::to_string(result.gpu_ms))
+             << ", \"batches\": " << result.batches
+             << ", \"vertices\": " << result.vertices
+             << " }" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    json << "    ]\n";
+    json << "}\n";
+
+    if(output_file_name.empty())
+    {
+        std::cout << json.str();
+    }
+    else
+    {
+        std::ofstream file(output_file_name);
+        file << json.str();
+    }
+
+    glfwTerminate();
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,94 @@
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <algorithm>
+#include <GLFW/glfw3.h>
+#include "honeybear/graphics.h"
+#include "honeybear/engine.h"
+#include "honeybear/profiler.h"
+#include "honeybear/capture.h"
+
+using namespace Honeybear;
+
+// replays a capture made with Capture::BeginCapture in a hidden window and prints how long the frames took,
+// run it from the game's directory so the resource file names in the capture resolve
+//
+//   honeybear_replay capture.hbcp [loops]
+
+int main(int argc, char** argv)
+{
+    if(argc < 2)
+    {
+        std::cout << "usage: honeybear_replay <capture file> [loops]" << std::endl;
+        return 1;
+    }
+
+    int loops = argc > 2 ? std::max(1, std::atoi(argv[2])) : 100;
+
+    CaptureFile capture;
+    if(!Capture::LoadCapture(argv[1], capture)) return 1;
+    if(capture.frames.empty())
+    {
+        std::cout << "ERROR::CAPTURE: Capture has no frames: " << argv[1] << std::endl;
+        return 1;
+    }
+
+    Graphics::Init(capture.window_width, capture.window_height, "Honeybear Replay", true);
+    if(Graphics::window == nullptr) return 1;
+
+    Capture::ReplaySetup(capture);
+
+    Profiler::EnableGPUTimers();
+    Profiler::EnableBatchBreakDiagnostics();
+
+    double cpu_total = 0.0;
+    double gpu_total = 0.0;
+    uint64_t gpu_samples = 0;
+    uint64_t batch_total = 0;
+    uint64_t frames_timed = 0;
+
+    // the first pass through is a warm up, it also defines the strings the later frames refer to
+    for(int loop = -1; loop < loops; ++loop)
+    {
+        for(uint32_t i = 0; i < capture.frames.size(); ++i)
+        {
+            Profiler::BeginGPUFrame();
+            Graphics::Clear();
+            Graphics::ClearFrameBuffers();
+
+            double start = glfwGetTime();
+            Capture::ReplayFrame(capture, i);
+            double submitted = glfwGetTime();
+
+            Graphics::SwapBuffers();
+            glfwPollEvents();
+
+            if(loop < 0) continue;
+
+            cpu_total += submitted - start;
+            batch_total += Profiler::GetBatchBreakSummary().total;
+            frames_timed++;
+
+            // the gpu times come back a few frames late, they're only averaged so that doesn't matter
+            float gpu_time = Profiler::GetGPUFrameTime();
+            if(gpu_time > 0.0f)
+            {
+                gpu_total += gpu_time;
+                gpu_samples++;
+            }
+        }
+    }
+
+    std::cout << "frames:      " << frames_timed << " (" << capture.frames.size() << " x " << loops << ")" << std::endl;
+    std::cout << "cpu submit:  " << cpu_total * 1000.0 / frames_timed << " ms/frame" << std::endl;
+    std::cout << "gpu:         " << (gpu_samples ? gpu_total / gpu_samples : 0.0) << " ms/frame" << std::endl;
+    std::cout << "batches:     " << (double)batch_total / frames_timed << " /frame" << std::endl;
+
+    for(const GPUPassTime& pass : Profiler::GetGPUPassTimes())
+    {
+        std::cout << "    " << pass.name << ": " << pass.milliseconds << " ms" << std::endl;
+    }
+
+    glfwTerminate();
+    return 0;
+}
\ No newline at end of file